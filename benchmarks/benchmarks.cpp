@@ -0,0 +1,234 @@
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+#include "pack/msgpack.hpp"
+#include "pack/parallel.hpp"
+
+/***** Backends *****/
+// Each backend packs to and unpacks from one kind of storage, which is reused between
+// iterations so that only serialization is being measured.
+
+struct StringStreamBackend {
+   std::stringstream stream {std::ios::binary | std::ios::out | std::ios::in};
+
+   template<typename F>
+   void Encode(F &&write) {
+      pack::Packer packer(stream);
+      write(packer);
+   }
+
+   template<typename F>
+   void Decode(F &&read) {
+      stream.clear();
+      pack::Unpacker unpacker(stream);
+      read(unpacker);
+   }
+};
+
+struct FileStreamBackend {
+   std::filesystem::path path {std::filesystem::temp_directory_path() /
+                               "pack_benchmark.bin"};
+   std::fstream stream {path, std::ios::binary | std::ios::out | std::ios::in |
+                                  std::ios::trunc};
+
+   ~FileStreamBackend() {
+      stream.close();
+      std::filesystem::remove(path);
+   }
+
+   template<typename F>
+   void Encode(F &&write) {
+      pack::Packer packer(stream);
+      write(packer);
+   }
+
+   template<typename F>
+   void Decode(F &&read) {
+      stream.clear();
+      pack::Unpacker unpacker(stream);
+      read(unpacker);
+   }
+};
+
+struct BufferBackend {
+   pack::ByteArray buffer;
+
+   template<typename F>
+   void Encode(F &&write) {
+      pack::BufferPacker packer(buffer);
+      write(packer);
+   }
+
+   template<typename F>
+   void Decode(F &&read) {
+      pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+      read(unpacker);
+   }
+};
+
+/***** Cases *****/
+// A case is a value to serialize, and how many copies of it make up one batch. Small
+// values are batched so that constructing the packer doesn't dominate.
+
+#define PACK_SCALAR_CASE(Name, T, value)               \
+   struct Name {                                       \
+      using Type = T;                                  \
+      static constexpr size_t BATCH = 4096;            \
+      static Type Make() { return value; }             \
+   }
+
+PACK_SCALAR_CASE(Bool, bool, true);
+PACK_SCALAR_CASE(PositiveFixint, uint8_t, 100);
+PACK_SCALAR_CASE(Uint8, uint8_t, 200);
+PACK_SCALAR_CASE(Uint16, uint16_t, 60000);
+PACK_SCALAR_CASE(Uint32, uint32_t, 4000000000u);
+PACK_SCALAR_CASE(Uint64, uint64_t, UINT64_MAX);
+PACK_SCALAR_CASE(NegativeFixint, int8_t, -20);
+PACK_SCALAR_CASE(Int8, int8_t, -100);
+PACK_SCALAR_CASE(Int16, int16_t, -30000);
+PACK_SCALAR_CASE(Int32, int32_t, INT32_MIN);
+PACK_SCALAR_CASE(Int64, int64_t, INT64_MIN);
+PACK_SCALAR_CASE(Float, float, 3.14159f);
+PACK_SCALAR_CASE(Double, double, 2.718281828459045);
+
+template<size_t LEN, size_t COUNT>
+struct StringCase {
+   using Type = std::string;
+   static constexpr size_t BATCH = COUNT;
+   static Type Make() { return std::string(LEN, 'x'); }
+};
+
+using FixStr = StringCase<16, 1024>;
+using Str8 = StringCase<200, 256>;
+using Str16 = StringCase<4000, 32>;
+using Str32 = StringCase<100000, 1>;
+
+struct SmallArray {
+   using Type = std::vector<int32_t>;
+   static constexpr size_t BATCH = 512;
+   static Type Make() { return {1, -2, 300, -40000, 5, 600000, -7, 8}; }
+};
+
+struct LargeArray {
+   using Type = std::vector<float>;
+   static constexpr size_t BATCH = 1;
+   static Type Make() {
+      Type out(65536);
+      for (size_t i = 0; i < out.size(); i++) { out[i] = (float)i * 0.5f; }
+      return out;
+   }
+};
+
+struct Blob {
+   using Type = pack::ByteArray;
+   static constexpr size_t BATCH = 1;
+   static Type Make() {
+      Type out(1 << 20);
+      for (size_t i = 0; i < out.size(); i++) { out[i] = (pack::Byte)(i * 31); }
+      return out;
+   }
+};
+
+struct NestedArray {
+   using Type = std::vector<std::vector<uint16_t>>;
+   static constexpr size_t BATCH = 16;
+   static Type Make() {
+      Type out(64);
+      for (size_t i = 0; i < out.size(); i++) { out[i].assign(16, (uint16_t)(i * 1000)); }
+      return out;
+   }
+};
+
+/***** Benchmarks *****/
+
+template<typename Backend, typename Case>
+void BM_Encode(benchmark::State &state) {
+   Backend backend;
+   const typename Case::Type value = Case::Make();
+   size_t bytes = 0;
+   for (auto _ : state) {
+      backend.Encode([&](auto &packer) {
+         for (size_t i = 0; i < Case::BATCH; i++) { packer.Serialize(value); }
+         bytes = packer.ByteCount();
+      });
+      benchmark::ClobberMemory();
+   }
+   state.SetBytesProcessed(state.iterations() * bytes);
+   state.SetItemsProcessed(state.iterations() * Case::BATCH);
+}
+
+template<typename Backend, typename Case>
+void BM_Decode(benchmark::State &state) {
+   Backend backend;
+   const typename Case::Type value = Case::Make();
+   size_t bytes = 0;
+   backend.Encode([&](auto &packer) {
+      for (size_t i = 0; i < Case::BATCH; i++) { packer.Serialize(value); }
+      bytes = packer.ByteCount();
+   });
+
+   typename Case::Type out {};
+   for (auto _ : state) {
+      backend.Decode([&](auto &unpacker) {
+         for (size_t i = 0; i < Case::BATCH; i++) {
+            unpacker.Deserialize(out);
+            benchmark::DoNotOptimize(out);
+         }
+      });
+   }
+   state.SetBytesProcessed(state.iterations() * bytes);
+   state.SetItemsProcessed(state.iterations() * Case::BATCH);
+}
+
+// Encodes one large array of strings with SerializeParallel, on state.range(0) threads.
+void BM_EncodeParallel(benchmark::State &state) {
+   BufferBackend backend;
+   const std::vector<std::string> value(1 << 20, std::string(48, 'x'));
+   size_t bytes = 0;
+   for (auto _ : state) {
+      backend.Encode([&](auto &packer) {
+         pack::SerializeParallel(packer, value, state.range(0));
+         bytes = packer.ByteCount();
+      });
+      benchmark::ClobberMemory();
+   }
+   state.SetBytesProcessed(state.iterations() * bytes);
+   state.SetItemsProcessed(state.iterations() * value.size());
+}
+
+#define PACK_BENCHMARK_BACKEND(Backend, Case)          \
+   BENCHMARK_TEMPLATE(BM_Encode, Backend, Case);       \
+   BENCHMARK_TEMPLATE(BM_Decode, Backend, Case)
+
+#define PACK_BENCHMARK(Case)                           \
+   PACK_BENCHMARK_BACKEND(StringStreamBackend, Case);  \
+   PACK_BENCHMARK_BACKEND(FileStreamBackend, Case);    \
+   PACK_BENCHMARK_BACKEND(BufferBackend, Case)
+
+PACK_BENCHMARK(Bool);
+PACK_BENCHMARK(PositiveFixint);
+PACK_BENCHMARK(Uint8);
+PACK_BENCHMARK(Uint16);
+PACK_BENCHMARK(Uint32);
+PACK_BENCHMARK(Uint64);
+PACK_BENCHMARK(NegativeFixint);
+PACK_BENCHMARK(Int8);
+PACK_BENCHMARK(Int16);
+PACK_BENCHMARK(Int32);
+PACK_BENCHMARK(Int64);
+PACK_BENCHMARK(Float);
+PACK_BENCHMARK(Double);
+PACK_BENCHMARK(FixStr);
+PACK_BENCHMARK(Str8);
+PACK_BENCHMARK(Str16);
+PACK_BENCHMARK(Str32);
+PACK_BENCHMARK(SmallArray);
+PACK_BENCHMARK(LargeArray);
+PACK_BENCHMARK(NestedArray);
+PACK_BENCHMARK(Blob);
+BENCHMARK(BM_EncodeParallel)->RangeMultiplier(2)->Range(1, 16)->UseRealTime();
+
+BENCHMARK_MAIN();
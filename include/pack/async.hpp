@@ -0,0 +1,267 @@
+#pragma once
+
+#include <coroutine>
+#include <tuple>
+
+#include "msgpack.hpp"
+
+// Coroutine front ends for non-blocking I/O. Nothing here does any I/O itself: an event
+// loop hands received bytes to an AsyncUnpacker, and takes bytes to send from an
+// AsyncPacker, and suspended coroutines are resumed from inside those calls.
+
+namespace pack {
+
+/**
+ * @brief How much unsent data an AsyncPacker holds by default before Serialize suspends.
+ */
+constexpr size_t ASYNC_HIGH_WATER = 64 * 1024;
+
+/**
+ * @brief Deserializes values as they arrive, suspending the coroutine that asked for them
+ * until they have.
+ *
+ * Received bytes are passed to Feed, which resumes the waiting coroutine once the values
+ * it is waiting for are complete. Values are scanned with an IncrementalUnpacker, so each
+ * is only scanned once however many pieces it arrives in, and nothing is decoded until
+ * it is complete. Only one coroutine may wait on an unpacker at a time.
+ */
+class AsyncUnpacker {
+   template<bool THROW, typename... T>
+   class Awaiter;
+
+  public:
+   AsyncUnpacker() = default;
+   AsyncUnpacker(const AsyncUnpacker &) = delete;
+   AsyncUnpacker &operator=(const AsyncUnpacker &) = delete;
+
+   /**
+    * @brief Deserializes values, one top-level value each, suspending until they have
+    * all arrived.
+    *
+    * @code co_await unpacker.Deserialize(header, body); @endcode
+    * @throws std::invalid_argument from co_await if Close is called before they arrive.
+    * @throws Any exception BasicUnpacker::Deserialize would throw, from co_await. Values
+    * before the one that failed have been taken.
+    */
+   template<typename... T>
+   requires(sizeof...(T) > 0)
+   [[nodiscard]] Awaiter<true, T...> Deserialize(T &...values) {
+      return {*this, values...};
+   }
+
+   /**
+    * @brief Deserializes values as with Deserialize, but co_await returns the result as
+    * an Errc instead of throwing. Errc::EndOfData means Close was called first.
+    */
+   template<typename... T>
+   requires(sizeof...(T) > 0)
+   [[nodiscard]] Awaiter<false, T...> TryDeserialize(T &...values) {
+      return {*this, values...};
+   }
+
+   /**
+    * @brief Hands over the next bytes received. If a coroutine is waiting and this
+    * completes what it is waiting for, it is resumed before Feed returns.
+    */
+   void Feed(std::span<const Byte> bytes) {
+      mIncremental.Feed(bytes);
+      Wake();
+   }
+
+   /**
+    * @brief Marks the end of the input, such as when the peer has closed the
+    * connection. A coroutine that is waiting is resumed with Errc::EndOfData, as is any
+    * that waits on values which have not already fully arrived.
+    */
+   void Close() {
+      mClosed = true;
+      Wake();
+   }
+
+   /**
+    * @brief Gets the number of bytes received but not yet deserialized.
+    */
+   size_t Buffered() const { return mIncremental.Buffered(); }
+
+  private:
+   /**
+    * @brief What a suspended coroutine is waiting on. retry attempts to deserialize the
+    * rest of its values, keeping the result for co_await to return, and returns
+    * Errc::EndOfData while they are incomplete.
+    */
+   struct Waiter {
+      std::coroutine_handle<> handle;
+      void *awaiter;
+      Errc (*retry)(void *awaiter);
+   };
+
+   template<bool THROW, typename... T>
+   class Awaiter {
+     public:
+      Awaiter(AsyncUnpacker &unpacker, T &...values) :
+         mUnpacker(unpacker), mValues(values...) {}
+
+      bool await_ready() {
+         mErr = Attempt();
+         return mErr != Errc::EndOfData || mUnpacker.mClosed;
+      }
+
+      void await_suspend(std::coroutine_handle<> handle) {
+         if (mUnpacker.mWaiter.handle) {
+            Throw<std::logic_error>("Only one coroutine may wait on an AsyncUnpacker");
+         }
+         mUnpacker.mWaiter = {handle, this, [](void *self) {
+                                 Awaiter &awaiter = *static_cast<Awaiter *>(self);
+                                 return awaiter.mErr = awaiter.Attempt();
+                              }};
+      }
+
+      auto await_resume() {
+         if constexpr (THROW) {
+            if (mErr != Errc::Ok) { ThrowError(mErr); }
+         } else {
+            return mErr;
+         }
+      }
+
+     private:
+      /**
+       * @brief Deserializes as many of the remaining values as have arrived.
+       */
+      Errc Attempt() {
+         return [this]<size_t... I>(std::index_sequence<I...>) {
+            Errc err = Errc::Ok;
+            (void)((I < mDone || ((err = Take<I>()) == Errc::Ok)) && ...);
+            return err;
+         }(std::index_sequence_for<T...>());
+      }
+
+      template<size_t I>
+      Errc Take() {
+         Errc err = mUnpacker.mIncremental.TryDeserialize(std::get<I>(mValues));
+         if (err == Errc::Ok) { mDone++; }
+         return err;
+      }
+
+      AsyncUnpacker &mUnpacker;
+      std::tuple<T &...> mValues;
+      size_t mDone {0};
+      Errc mErr {Errc::Ok};
+   };
+
+   /**
+    * @brief Resumes the waiting coroutine, if what it is waiting for has arrived.
+    */
+   void Wake() {
+      if (!mWaiter.handle) { return; }
+      Errc err = mWaiter.retry(mWaiter.awaiter);
+      if (err == Errc::EndOfData && !mClosed) { return; }
+
+      // Cleared before resuming, as the coroutine may go straight on to wait again.
+      std::exchange(mWaiter, {}).handle.resume();
+   }
+
+   IncrementalUnpacker mIncremental;
+   Waiter mWaiter {};
+   bool mClosed {false};
+};
+
+/**
+ * @brief Serializes values into a send buffer, suspending the coroutine that serialized
+ * them while the buffer is too full.
+ *
+ * Values are serialized as soon as Serialize is called, so they need not outlive it.
+ * The event loop sends what is Pending whenever the connection can take more, and
+ * reports how much it sent with Consume, which resumes the waiting coroutine once the
+ * buffer has drained enough. Only one coroutine may wait on a packer at a time.
+ */
+class AsyncPacker {
+  public:
+   /**
+    * @brief Suspends the coroutine that awaits it until no more than limit bytes are
+    * pending.
+    */
+   class Awaiter {
+     public:
+      Awaiter(AsyncPacker &packer, size_t limit) : mPacker(packer), mLimit(limit) {}
+
+      bool await_ready() const { return mPacker.Pending().size() <= mLimit; }
+
+      void await_suspend(std::coroutine_handle<> handle) {
+         if (mPacker.mWaiter) {
+            Throw<std::logic_error>("Only one coroutine may wait on an AsyncPacker");
+         }
+         mPacker.mWaiter = handle;
+         mPacker.mWaitLimit = mLimit;
+      }
+
+      void await_resume() const {}
+
+     private:
+      AsyncPacker &mPacker;
+      size_t mLimit;
+   };
+
+   /**
+    * @brief Construct a new, empty AsyncPacker.
+    *
+    * @param highWater How many bytes may be pending before Serialize suspends.
+    */
+   AsyncPacker(size_t highWater = ASYNC_HIGH_WATER) : mHighWater(highWater) {}
+
+   AsyncPacker(const AsyncPacker &) = delete;
+   AsyncPacker &operator=(const AsyncPacker &) = delete;
+
+   /**
+    * @brief Serializes values onto the end of the send buffer straight away, then
+    * suspends while more than the high water mark is pending.
+    *
+    * @code co_await packer.Serialize(header, body); @endcode
+    * @throws Any exception BasicPacker::Serialize would throw, before suspending.
+    */
+   template<typename... T>
+   [[nodiscard]] Awaiter Serialize(const T &...values) {
+      if (mStart > 0) {
+         mBuf.erase(mBuf.begin(), mBuf.begin() + mStart);
+         mStart = 0;
+      }
+      BufferPacker packer(mBuf, mBuf.size());
+      packer.Serialize(values...);
+      return {*this, mHighWater};
+   }
+
+   /**
+    * @brief Suspends until everything serialized so far has been consumed.
+    */
+   [[nodiscard]] Awaiter Flush() { return {*this, 0}; }
+
+   /**
+    * @brief Gets the bytes serialized but not yet consumed, to be sent next. They stay
+    * valid until the next call to Serialize.
+    */
+   std::span<const Byte> Pending() const { return std::span(mBuf).subspan(mStart); }
+
+   /**
+    * @brief Marks the first len pending bytes as sent. If a coroutine is waiting and
+    * this drains the buffer enough, it is resumed before Consume returns.
+    */
+   void Consume(size_t len) {
+      mStart += std::min(len, Pending().size());
+      if (mStart == mBuf.size()) {
+         mBuf.clear();
+         mStart = 0;
+      }
+      if (mWaiter && Pending().size() <= mWaitLimit) {
+         // Cleared before resuming, as the coroutine may go straight on to wait again.
+         std::exchange(mWaiter, {}).resume();
+      }
+   }
+
+  private:
+   ByteArray mBuf;
+   size_t mStart {0}; // Where the pending bytes start.
+   size_t mHighWater;
+   std::coroutine_handle<> mWaiter {};
+   size_t mWaitLimit {0};
+};
+}; // namespace pack
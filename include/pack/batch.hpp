@@ -0,0 +1,345 @@
+#pragma once
+
+#include <cerrno>
+#include <climits>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "msgpack.hpp"
+
+// Batches of framed messages, gathered for writev. These use POSIX iovecs, so are kept out
+// of msgpack.hpp.
+
+namespace pack {
+
+/**
+ * @brief The size of the length prefix in front of every frame in a batch. It holds the
+ * length of the rest of the frame, as a big endian uint32_t.
+ */
+constexpr size_t BATCH_FRAME_HEADER = 4;
+
+/**
+ * @brief The shortest string or bin payload that a BatchPacker references in place by
+ * default, rather than copying. Shorter ones cost less to copy than an extra iovec.
+ */
+constexpr size_t BATCH_REFERENCE_MIN = 1024;
+
+/**
+ * @brief A Sink that gathers serialized data as a list of segments for a scatter-gather
+ * write. Segments either lie in an arena of copied bytes, or point at payloads that were
+ * referenced in place.
+ */
+class BatchSink {
+  public:
+   /**
+    * @brief A contiguous run of output. Its bytes are at offset into the arena if data
+    * is null, or else at data.
+    */
+   struct Segment {
+      const Byte *data;
+      size_t offset;
+      size_t len;
+   };
+
+   /**
+    * @brief Everything gathered so far. It is kept outside the sink so that it can be
+    * read and cleared while the sink is in use.
+    */
+   struct Buffers {
+      ByteArray arena;
+      std::vector<Segment> segments;
+      size_t count {0};
+   };
+
+   /**
+    * @brief Construct a new BatchSink, appending to buffers.
+    *
+    * @param buffers Where to gather output. It must outlive the sink.
+    * @param referenceMin The shortest payload to reference in place instead of copying.
+    */
+   BatchSink(Buffers &buffers, size_t referenceMin) :
+      mBufs(buffers), mReferenceMin(referenceMin) {}
+
+   /**
+    * @brief Copies a block of bytes onto the end of the arena.
+    */
+   void Write(const Byte *data, size_t len) {
+      std::vector<Segment> &segments = mBufs.segments;
+      if (segments.empty() || segments.back().data != nullptr) {
+         segments.push_back({nullptr, mBufs.arena.size(), 0});
+      }
+      segments.back().len += len;
+      mBufs.arena.insert(mBufs.arena.end(), data, data + len);
+      mBufs.count += len;
+   }
+
+   /**
+    * @brief Adds a block of bytes as a segment of its own, without copying it, if it is
+    * at least referenceMin long. The bytes must stay unchanged until the batch is written.
+    */
+   void WriteReference(const Byte *data, size_t len) {
+      if (len < mReferenceMin) {
+         Write(data, len);
+         return;
+      }
+      mBufs.segments.push_back({data, 0, len});
+      mBufs.count += len;
+   }
+
+   /**
+    * @brief Grows the arena geometrically to fit len more bytes. Reservations of at least
+    * referenceMin are skipped, as they are mostly for payloads that will be referenced,
+    * and anything copied after all still grows the arena geometrically as it is written.
+    */
+   void Reserve(size_t len) {
+      if (len >= mReferenceMin) { return; }
+      size_t required = mBufs.arena.size() + len;
+      if (required > mBufs.arena.capacity()) {
+         mBufs.arena.reserve(std::max(required, mBufs.arena.capacity() * 2));
+      }
+   }
+
+   void Flush() {}
+   size_t Count() const { return mBufs.count; }
+
+  private:
+   Buffers &mBufs;
+   size_t mReferenceMin;
+};
+
+/**
+ * @brief Serializes many messages into one batch, each as a length prefixed frame, to be
+ * sent with a single writev or sendmsg.
+ *
+ * Small values are copied into an arena that is reused from batch to batch. Strings and
+ * bins at least referenceMin bytes long are referenced where they are instead, so they
+ * must stay alive and unchanged until the batch has been written. The frames can be read
+ * back with BatchUnpacker.
+ */
+class BatchPacker {
+  public:
+   /**
+    * @brief Construct a new, empty BatchPacker.
+    *
+    * @param referenceMin The shortest string or bin payload to reference in place
+    * instead of copying. SIZE_MAX copies everything.
+    */
+   BatchPacker(size_t referenceMin = BATCH_REFERENCE_MIN) : mPacker(mBufs, referenceMin) {}
+
+   BatchPacker(const BatchPacker &) = delete;
+   BatchPacker &operator=(const BatchPacker &) = delete;
+
+   /**
+    * @brief Serializes values as the next frame of the batch. If serializing any of them
+    * fails, the batch is left as it was.
+    *
+    * @throws std::length_error if the frame would be more than UINT32_MAX bytes.
+    * @throws Any exception from serializing the values.
+    */
+   template<typename... T>
+   void Serialize(const T &...values) {
+      size_t arenaLen = mBufs.arena.size();
+      size_t segmentCount = mBufs.segments.size();
+      size_t start = mBufs.count;
+      Byte header[BATCH_FRAME_HEADER] = {};
+      mPacker.SerializeRaw(header);
+
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+      try {
+#endif
+         mPacker.Serialize(values...);
+         if (mBufs.count - start - BATCH_FRAME_HEADER > UINT32_MAX) {
+            Throw<std::length_error>("Frame exceeds max length");
+         }
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+      } catch (...) {
+         mBufs.arena.resize(arenaLen);
+         mBufs.segments.resize(segmentCount);
+         if (segmentCount > 0 && mBufs.segments.back().data == nullptr) {
+            mBufs.segments.back().len = arenaLen - mBufs.segments.back().offset;
+         }
+         mBufs.count = start;
+         throw;
+      }
+#endif
+
+      size_t len = mBufs.count - start - BATCH_FRAME_HEADER;
+      StoreBigEndian(mBufs.arena.data() + arenaLen, (uint32_t)len);
+      mFrames++;
+   }
+
+   /**
+    * @brief Gets the batch as a list of iovecs, ready to pass to writev or sendmsg. They
+    * stay valid until the next call to Serialize or Clear.
+    */
+   std::span<const iovec> Segments() {
+      mIovecs.clear();
+      for (const BatchSink::Segment &segment : mBufs.segments) {
+         const Byte *data = segment.data ? segment.data : mBufs.arena.data() + segment.offset;
+         mIovecs.push_back({(void *)data, segment.len});
+      }
+      return mIovecs;
+   }
+
+   /**
+    * @brief Writes the whole batch to a blocking file descriptor, such as a socket, with
+    * as few calls to writev as IOV_MAX allows. The batch is left as it is.
+    *
+    * @return size_t The number of bytes written, which is always ByteCount.
+    * @throws std::runtime_error if writing failed.
+    */
+   size_t WriteTo(int fd) {
+      Segments();
+      size_t next = 0;
+      while (next < mIovecs.size()) {
+         int count = (int)std::min<size_t>(mIovecs.size() - next, IOV_MAX);
+         ssize_t written = ::writev(fd, mIovecs.data() + next, count);
+         if (written < 0) {
+            if (errno == EINTR) { continue; }
+            Throw<std::runtime_error>("Failed to write batch");
+         }
+
+         // Step over whatever was written, which may end partway through a segment.
+         size_t remaining = written;
+         while (next < mIovecs.size() && remaining >= mIovecs[next].iov_len) {
+            remaining -= mIovecs[next++].iov_len;
+         }
+         if (remaining > 0) {
+            mIovecs[next].iov_base = (Byte *)mIovecs[next].iov_base + remaining;
+            mIovecs[next].iov_len -= remaining;
+         }
+      }
+      return mBufs.count;
+   }
+
+   /**
+    * @brief Gets the total size of the batch, in bytes.
+    */
+   size_t ByteCount() const { return mBufs.count; }
+
+   /**
+    * @brief Gets the number of frames in the batch.
+    */
+   size_t FrameCount() const { return mFrames; }
+
+   /**
+    * @brief Empties the batch to start on the next one. The arena keeps its capacity.
+    */
+   void Clear() {
+      mBufs.arena.clear();
+      mBufs.segments.clear();
+      mBufs.count = 0;
+      mFrames = 0;
+   }
+
+  private:
+   BatchSink::Buffers mBufs;
+   std::vector<iovec> mIovecs;
+   size_t mFrames {0};
+   BasicPacker<BatchSink> mPacker;
+};
+
+/**
+ * @brief Reads the frames written by a BatchPacker back out of a receive buffer, one
+ * frame per call.
+ *
+ * Frames are decoded straight out of the buffer, so strings can be borrowed from it. The
+ * buffer may end partway through a frame, which is left for Remaining.
+ */
+class BatchUnpacker {
+  public:
+   /**
+    * @brief Construct a new BatchUnpacker that reads frames from the start of buffer.
+    *
+    * @param buffer The received data. It must outlive the unpacker.
+    */
+   BatchUnpacker(std::span<const Byte> buffer) : mBuf(buffer) {}
+
+   /**
+    * @brief Sets whether deserialized strings are checked to be valid UTF-8, as with
+    * BasicUnpacker::ValidateUtf8.
+    */
+   void ValidateUtf8(bool enable) { mValidateUtf8 = enable; }
+
+   /**
+    * @brief Whether the buffer holds another complete frame.
+    */
+   bool HasFrame() const {
+      std::span<const Byte> frame;
+      return Peek(frame);
+   }
+
+   /**
+    * @brief Takes the next complete frame, without deserializing it.
+    *
+    * @return Errc::EndOfData if there is no complete frame left.
+    */
+   Errc Next(std::span<const Byte> &frame) {
+      if (!Peek(frame)) { return Errc::EndOfData; }
+      mPos += BATCH_FRAME_HEADER + frame.size();
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Deserializes the values in the next frame. Any values in the frame after
+    * them are skipped.
+    *
+    * @return Errc::EndOfData if there is no complete frame left. Otherwise, the result
+    * of deserializing the frame. The frame is only taken if that succeeds, so on failure
+    * it can be retried as other types, or dropped with Next.
+    */
+   template<typename... T>
+   requires(sizeof...(T) > 0)
+   Errc TryDeserialize(T &...values) {
+      std::span<const Byte> frame;
+      if (!Peek(frame)) { return Errc::EndOfData; }
+      BasicUnpacker<SpanSource> unpacker {frame};
+      unpacker.ValidateUtf8(mValidateUtf8);
+      if (Errc err = unpacker.TryDeserialize(values...); err != Errc::Ok) { return err; }
+      mPos += BATCH_FRAME_HEADER + frame.size();
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Deserializes the values in the next frame.
+    *
+    * @throws std::invalid_argument if there is no complete frame left.
+    * @throws Any exception Deserialize would throw for the values.
+    */
+   template<typename... T>
+   requires(sizeof...(T) > 0)
+   void Deserialize(T &...values) {
+      if (Errc err = TryDeserialize(values...); err != Errc::Ok) { ThrowError(err); }
+   }
+
+   /**
+    * @brief Gets the bytes after the last frame taken. When the buffer ends partway
+    * through a frame, these should be kept and received into.
+    */
+   std::span<const Byte> Remaining() const { return mBuf.subspan(mPos); }
+
+   /**
+    * @brief Gets the number of bytes taken so far, including frame headers.
+    */
+   size_t ByteCount() const { return mPos; }
+
+  private:
+   /**
+    * @brief Finds the body of the next frame, if it has fully arrived.
+    */
+   bool Peek(std::span<const Byte> &frame) const {
+      std::span<const Byte> rest = Remaining();
+      if (rest.size() < BATCH_FRAME_HEADER) { return false; }
+      size_t len = LoadBigEndian<uint32_t>(rest.data());
+      if (len > rest.size() - BATCH_FRAME_HEADER) { return false; }
+      frame = rest.subspan(BATCH_FRAME_HEADER, len);
+      return true;
+   }
+
+   std::span<const Byte> mBuf;
+   size_t mPos {0};
+   bool mValidateUtf8 {false};
+};
+}; // namespace pack
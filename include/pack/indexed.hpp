@@ -0,0 +1,327 @@
+#pragma once
+
+#include <array>
+#include <filesystem>
+
+#include "batch.hpp"
+#include "mmap.hpp"
+#include "parallel.hpp"
+
+// Indexed record files. An indexed file is a run of frames, one per record, as written by
+// a BatchPacker, followed by an index of where each record starts:
+//
+//    frame...  index  trailer
+//
+// The index is a msgpack map (see FileIndex), and the trailer is the offset of the index
+// as a big endian uint64_t followed by INDEX_MAGIC. Records are grouped into blocks of a
+// fixed number of records, which may each have a checksum.
+
+namespace pack {
+
+/**
+ * @brief The last four bytes of every indexed file.
+ */
+constexpr std::array<Byte, 4> INDEX_MAGIC = {'P', 'K', 'I', 'X'};
+
+/**
+ * @brief The size of the trailer at the end of an indexed file.
+ */
+constexpr size_t INDEX_TRAILER = 8 + INDEX_MAGIC.size();
+
+/**
+ * @brief The number of records per block that IndexedWriter uses by default.
+ */
+constexpr size_t INDEX_BLOCK_RECORDS = 1024;
+
+/**
+ * @brief Computes the CRC-32 (as used by zlib) of data, continuing from crc.
+ */
+constexpr uint32_t Crc32(std::span<const Byte> data, uint32_t crc = 0) {
+   constexpr std::array<uint32_t, 256> TABLE = [] {
+      std::array<uint32_t, 256> table {};
+      for (uint32_t i = 0; i < table.size(); i++) {
+         uint32_t c = i;
+         for (int bit = 0; bit < 8; bit++) { c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1; }
+         table[i] = c;
+      }
+      return table;
+   }();
+
+   crc = ~crc;
+   for (Byte byte : data) { crc = TABLE[(crc ^ byte) & 0xff] ^ (crc >> 8); }
+   return ~crc;
+}
+
+/**
+ * @brief The index at the end of an indexed file.
+ */
+struct FileIndex {
+   uint32_t version {1};
+   uint32_t blockRecords {0};       // The number of records in each block but the last.
+   std::vector<uint64_t> offsets;   // Where the frame of each record starts.
+   std::vector<uint32_t> checksums; // The Crc32 of the frames in each block, or empty.
+   PACK_AS_MAP(version, blockRecords, offsets, checksums)
+};
+
+/**
+ * @brief Writes records to an indexed file.
+ *
+ * Records are gathered a block at a time in a BatchPacker, and each block is written
+ * with a single writev. The index is written by Close, or else when the writer is
+ * destroyed, and a file without its index can't be read by IndexedReader.
+ */
+class IndexedWriter {
+  public:
+   /**
+    * @brief Creates or truncates the file at path.
+    *
+    * @param path The file to write records to.
+    * @param blockRecords The number of records in each block.
+    * @param checksums Whether to store the checksum of each block in the index.
+    * @throws std::runtime_error if the file could not be created.
+    */
+   IndexedWriter(const std::filesystem::path &path,
+                 size_t blockRecords = INDEX_BLOCK_RECORDS, bool checksums = true) :
+      mBatch(SIZE_MAX), mChecksums(checksums) {
+      mIndex.blockRecords = (uint32_t)std::clamp<size_t>(blockRecords, 1, UINT32_MAX);
+      mFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (mFd < 0) { Throw<std::runtime_error>("Failed to open file"); }
+   }
+
+   IndexedWriter(const IndexedWriter &) = delete;
+   IndexedWriter &operator=(const IndexedWriter &) = delete;
+
+   ~IndexedWriter() {
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+      try {
+         Close();
+      } catch (...) {
+         // Nothing more can be done from a destructor. Close reports the error.
+      }
+#else
+      Close();
+#endif
+   }
+
+   /**
+    * @brief Serializes values as the next record.
+    *
+    * @throws std::runtime_error if this finishes a block, and writing it failed.
+    * @throws Any exception from serializing the values, in which case no record is added.
+    */
+   template<typename... T>
+   void Write(const T &...values) {
+      uint64_t offset = mWritten + mBatch.ByteCount();
+      mBatch.Serialize(values...);
+      mIndex.offsets.push_back(offset);
+      if (mBatch.FrameCount() == mIndex.blockRecords) { WriteBlock(); }
+   }
+
+   /**
+    * @brief Gets the number of records written so far.
+    */
+   size_t Count() const { return mIndex.offsets.size(); }
+
+   /**
+    * @brief Writes out the last block and the index, and closes the file. Does nothing
+    * if the file has already been closed.
+    *
+    * @throws std::runtime_error if writing to the file failed.
+    */
+   void Close() {
+      if (mFd < 0) { return; }
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+      try {
+#endif
+         WriteBlock();
+         ByteArray tail;
+         {
+            BufferPacker packer(tail);
+            packer.Serialize(mIndex);
+         }
+         tail.resize(tail.size() + INDEX_TRAILER);
+         StoreBigEndian(tail.data() + tail.size() - INDEX_TRAILER, mWritten);
+         std::copy(INDEX_MAGIC.begin(), INDEX_MAGIC.end(), tail.end() - INDEX_MAGIC.size());
+         WriteAll(tail);
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+      } catch (...) {
+         ::close(mFd);
+         mFd = -1;
+         throw;
+      }
+#endif
+      int fd = mFd;
+      mFd = -1;
+      if (::close(fd) != 0) { Throw<std::runtime_error>("Failed to close file"); }
+   }
+
+  private:
+   /**
+    * @brief Writes out the records gathered so far as a block, and starts the next one.
+    */
+   void WriteBlock() {
+      if (mBatch.FrameCount() == 0) { return; }
+      if (mChecksums) {
+         uint32_t crc = 0;
+         for (const iovec &segment : mBatch.Segments()) {
+            crc = Crc32({(const Byte *)segment.iov_base, segment.iov_len}, crc);
+         }
+         mIndex.checksums.push_back(crc);
+      }
+      mWritten += mBatch.WriteTo(mFd);
+      mBatch.Clear();
+   }
+
+   void WriteAll(std::span<const Byte> data) {
+      while (!data.empty()) {
+         ssize_t written = ::write(mFd, data.data(), data.size());
+         if (written < 0) {
+            if (errno == EINTR) { continue; }
+            Throw<std::runtime_error>("Failed to write file");
+         }
+         data = data.subspan(written);
+      }
+   }
+
+   int mFd {-1};
+   BatchPacker mBatch;
+   bool mChecksums;
+   uint64_t mWritten {0};
+   FileIndex mIndex;
+};
+
+/**
+ * @brief Reads records out of an indexed file, through a memory mapping.
+ *
+ * Any record can be decoded without reading the ones before it, so records can be
+ * decoded on several threads at once with ForEach. Records are decoded straight out of
+ * the mapping, so strings can be borrowed from it for as long as the reader is alive.
+ */
+class IndexedReader {
+  public:
+   /**
+    * @brief Maps the file at path and reads its index.
+    *
+    * @throws std::runtime_error if the file could not be mapped, or is not an indexed
+    * file.
+    */
+   IndexedReader(const std::filesystem::path &path) : mFile(path, false) {
+      std::span<const Byte> bytes = mFile.Bytes();
+      if (bytes.size() < INDEX_TRAILER ||
+          !std::equal(INDEX_MAGIC.begin(), INDEX_MAGIC.end(),
+                      bytes.end() - INDEX_MAGIC.size())) {
+         Throw<std::runtime_error>("Not an indexed file");
+      }
+      mEnd = LoadBigEndian<uint64_t>(&bytes[bytes.size() - INDEX_TRAILER]);
+      if (mEnd > bytes.size() - INDEX_TRAILER) { Throw<std::runtime_error>("Corrupt index"); }
+
+      SpanUnpacker unpacker {bytes.subspan(mEnd, bytes.size() - INDEX_TRAILER - mEnd)};
+      if (unpacker.TryDeserialize(mIndex) != Errc::Ok || mIndex.blockRecords == 0 ||
+          (!mIndex.checksums.empty() && mIndex.checksums.size() != BlockCount())) {
+         Throw<std::runtime_error>("Corrupt index");
+      }
+   }
+
+   /**
+    * @brief Gets the number of records in the file.
+    */
+   size_t Count() const { return mIndex.offsets.size(); }
+
+   /**
+    * @brief Gets the number of blocks the records are grouped into.
+    */
+   size_t BlockCount() const {
+      return (Count() + mIndex.blockRecords - 1) / mIndex.blockRecords;
+   }
+
+   /**
+    * @brief Gets the number of records in each block, except perhaps the last.
+    */
+   size_t BlockRecords() const { return mIndex.blockRecords; }
+
+   /**
+    * @brief Gets the encoded values of a record.
+    *
+    * @throws std::out_of_range if there is no such record.
+    * @throws std::runtime_error if the record's frame runs past the end of the records.
+    */
+   std::span<const Byte> Record(size_t index) const {
+      if (index >= Count()) { Throw<std::out_of_range>("No such record"); }
+      uint64_t offset = mIndex.offsets[index];
+      if (offset > mEnd || mEnd - offset < BATCH_FRAME_HEADER) {
+         Throw<std::runtime_error>("Corrupt index");
+      }
+      const Byte *frame = mFile.Bytes().data() + offset;
+      size_t len = LoadBigEndian<uint32_t>(frame);
+      if (len > mEnd - offset - BATCH_FRAME_HEADER) {
+         Throw<std::runtime_error>("Corrupt record");
+      }
+      return {frame + BATCH_FRAME_HEADER, len};
+   }
+
+   /**
+    * @brief Deserializes the values of a record.
+    *
+    * @throws std::out_of_range if there is no such record.
+    * @throws Any exception SpanUnpacker::Deserialize would throw for the values.
+    */
+   template<typename... T>
+   void Read(size_t index, T &...values) const {
+      SpanUnpacker unpacker {Record(index)};
+      unpacker.Deserialize(values...);
+   }
+
+   /**
+    * @brief Checks the checksum of a block, if the file has checksums.
+    *
+    * @return Whether the block is intact, or true if there are no checksums.
+    */
+   bool Verify(size_t block) const {
+      if (mIndex.checksums.empty()) { return true; }
+      auto [first, last] = BlockRange(block);
+      if (first == last) { return true; }
+      std::span<const Byte> bytes = mFile.Bytes();
+      size_t begin = mIndex.offsets[first];
+      size_t end = last < Count() ? mIndex.offsets[last] : mEnd;
+      if (begin > end || end > mEnd) { return false; }
+      return Crc32(bytes.subspan(begin, end - begin)) == mIndex.checksums[block];
+   }
+
+   /**
+    * @brief Calls visit(index, unpacker) for every record, on up to threads threads 
+    * at once, where unpacker is a SpanUnpacker over that record.
+    *
+    * Threads take a block at a time, and visit its records in order, but blocks are
+    * visited in no particular order. Each block is checked against its checksum first,
+    * if there is one.
+    *
+    * @param visit Called with the index and an unpacker over each record, from several
+    * threads at once.
+    * @param threads The number of threads to decode on, including the calling thread. 0
+    * uses std::thread::hardware_concurrency.
+    * @throws std::runtime_error if a block does not match its checksum.
+    * @throws Any exception from visit. See ParallelFor.
+    */
+   template<typename F>
+   void ForEach(F &&visit, size_t threads = 0) const {
+      ParallelFor(BlockCount(), threads, [&](size_t block) {
+         if (!Verify(block)) { Throw<std::runtime_error>("Block checksum mismatch"); }
+         auto [first, last] = BlockRange(block);
+         for (size_t index = first; index < last; index++) {
+            SpanUnpacker unpacker {Record(index)};
+            visit(index, unpacker);
+         }
+      });
+   }
+
+  private:
+   std::pair<size_t, size_t> BlockRange(size_t block) const {
+      size_t first = block * mIndex.blockRecords;
+      return {std::min(first, Count()), std::min(first + mIndex.blockRecords, Count())};
+   }
+
+   MappedFile mFile;
+   uint64_t mEnd {0}; // Where the records end, and the index starts.
+   FileIndex mIndex;
+};
+}; // namespace pack
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <filesystem>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "msgpack.hpp"
+
+// Memory mapped file backends. These use POSIX mmap, so are kept out of msgpack.hpp.
+
+namespace pack {
+
+/**
+ * @brief A read only memory mapping of an entire file.
+ */
+class MappedFile {
+  public:
+   /**
+    * @brief Maps the file at path into memory.
+    * 
+    * @param path The file to map.
+    * @param sequential Whether to hint to the kernel that the file will be read from 
+    * front to back, so that it reads ahead aggressively.
+    * @throws std::runtime_error if the file could not be opened or mapped.
+    */
+   MappedFile(const std::filesystem::path &path, bool sequential = true) {
+      int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+      if (fd < 0) { Throw<std::runtime_error>("Failed to open file"); }
+
+      struct stat info;
+      if (::fstat(fd, &info) != 0) {
+         ::close(fd);
+         Throw<std::runtime_error>("Failed to open file");
+      }
+
+      // An empty file can't be mapped, but there is nothing to read anyway.
+      mSize = info.st_size;
+      if (mSize > 0) {
+         void *addr = ::mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+         ::close(fd);
+         if (addr == MAP_FAILED) { Throw<std::runtime_error>("Failed to map file"); }
+         if (sequential) { ::madvise(addr, mSize, MADV_SEQUENTIAL); }
+         mData = (const Byte *)addr;
+      } else {
+         ::close(fd);
+      }
+   }
+
+   MappedFile(const MappedFile &) = delete;
+   MappedFile &operator=(const MappedFile &) = delete;
+
+   ~MappedFile() {
+      if (mData != nullptr) { ::munmap((void *)mData, mSize); }
+   }
+
+   /**
+    * @brief Gets the contents of the file.
+    */
+   std::span<const Byte> Bytes() const { return {mData, mSize}; }
+
+  private:
+   const Byte *mData {nullptr};
+   size_t mSize {0};
+};
+
+/**
+ * @brief A Source that reads serialized data directly out of a memory mapped file.
+ * 
+ * It is a SpanSource over the mapping, so strings can be borrowed straight out of the 
+ * file, and remain valid for as long as the source is alive.
+ */
+class MappedSource : private MappedFile, public SpanSource {
+  public:
+   /**
+    * @brief Maps the file at path, and reads from the beginning of it.
+    * 
+    * @throws std::runtime_error if the file could not be opened or mapped.
+    */
+   MappedSource(const std::filesystem::path &path) : MappedFile(path), SpanSource(Bytes()) {}
+
+   /**
+    * @brief A MappedSource stays on its own file.
+    */
+   void Reset(std::span<const Byte>) = delete;
+};
+
+/**
+ * @brief A Sink that writes serialized data out to a memory mapped file.
+ * 
+ * The file is grown and remapped geometrically as it fills up, so writes are a plain 
+ * copy into the mapping. Until the sink is destroyed the file may be longer than the 
+ * data written to it, after which it is truncated to exactly Count bytes.
+ */
+class MappedSink {
+  public:
+   /**
+    * @brief Creates or truncates the file at path, and maps it for writing.
+    * 
+    * @param path The file to pack serialized data out to.
+    * @param capacity The size to map the file with initially, in bytes.
+    * @throws std::runtime_error if the file could not be created or mapped.
+    */
+   MappedSink(const std::filesystem::path &path, size_t capacity = 1 << 20) {
+      mFd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+      if (mFd < 0) { Throw<std::runtime_error>("Failed to open file"); }
+
+      // The destructor won't run if mapping fails, so the file is closed here instead.
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+      try {
+#endif
+         Remap(std::max<size_t>(capacity, 1));
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+      } catch (...) {
+         ::close(mFd);
+         throw;
+      }
+#endif
+   }
+
+   MappedSink(const MappedSink &) = delete;
+   MappedSink &operator=(const MappedSink &) = delete;
+
+   ~MappedSink() {
+      if (mData != nullptr) { ::munmap(mData, mCapacity); }
+      if (::ftruncate(mFd, mPos) != 0) {
+         // Nothing more can be done from a destructor. The data is intact, just padded.
+      }
+      ::close(mFd);
+   }
+
+   /**
+    * @brief Copies a block of bytes into the mapping, growing the file if needed.
+    * 
+    * @throws std::runtime_error if the file could not be grown.
+    */
+   void Write(const Byte *data, size_t len) {
+      if (mPos + len > mCapacity) { Grow(len); }
+      std::memcpy(mData + mPos, data, len);
+      mPos += len;
+   }
+
+   void Reserve(size_t len) {
+      if (mPos + len > mCapacity) { Grow(len); }
+   }
+
+   /**
+    * @brief Schedules everything written so far to be written back to disk.
+    * 
+    * @throws std::runtime_error if the write back could not be started.
+    */
+   void Flush() {
+      if (::msync(mData, mCapacity, MS_ASYNC) != 0) {
+         Throw<std::runtime_error>("Failed to flush mapped file");
+      }
+   }
+
+   size_t Count() const { return mPos; }
+
+  private:
+   void Grow(size_t len) { Remap(std::max(mCapacity * 2, mPos + len)); }
+
+   /**
+    * @brief Maps the file at a new size. The old mapping is only let go of once the new 
+    * one is in place, so if growing fails the sink carries on as it was.
+    */
+   void Remap(size_t capacity) {
+      if (::ftruncate(mFd, capacity) != 0) {
+         Throw<std::runtime_error>("Failed to grow mapped file");
+      }
+      void *addr = ::mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, mFd, 0);
+      if (addr == MAP_FAILED) {
+         if (::ftruncate(mFd, mCapacity) != 0) {
+            // The old mapping is still whole, the file is just padded further.
+         }
+         Throw<std::runtime_error>("Failed to map file");
+      }
+      ::madvise(addr, capacity, MADV_SEQUENTIAL);
+
+      if (mData != nullptr) { ::munmap(mData, mCapacity); }
+      mData = (Byte *)addr;
+      mCapacity = capacity;
+   }
+
+   int mFd {-1};
+   Byte *mData {nullptr};
+   size_t mCapacity {0};
+   size_t mPos {0};
+};
+
+using MappedPacker = BasicPacker<MappedSink>;
+using MappedUnpacker = BasicUnpacker<MappedSource>;
+}; // namespace pack
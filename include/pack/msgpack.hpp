@@ -2,14 +2,35 @@
 
 #include <numeric>
 #include <cstdint>
+#include <cstddef>
+#include <cstring>
 #include <vector>
 #include <stdexcept>
+#include <cstdlib>
 #include <ostream>
 #include <istream>
 #include <bit>
 #include <string>
 #include <span>
 #include <array>
+#include <algorithm>
+#include <concepts>
+#include <ranges>
+#include <utility>
+#include <tuple>
+#include <memory>
+#include <deque>
+#include <unordered_map>
+#include <optional>
+#include <variant>
+#include <chrono>
+#include <exception>
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 namespace pack {
 
@@ -33,22 +54,31 @@ constexpr int8_t NEG_FIXINT_MIN     = 0b11100000;
 constexpr uint8_t POS_FIXINT_MASK   = 0b10000000;
 constexpr uint8_t FIXSTR_MASK       = 0b10100000;
 constexpr uint8_t FIXARR_MASK       = 0b10010000;
+constexpr uint8_t FIXMAP_MASK       = 0b10000000;
+constexpr uint8_t FIXSTR_TYPE_MASK  = 0b11100000;
+constexpr uint8_t FIXARR_TYPE_MASK  = 0b11110000;
+constexpr uint8_t FIXMAP_TYPE_MASK  = 0b11110000;
 
 constexpr uint8_t FIXSTR_MAX        = 0b11111;
+constexpr uint8_t FIXARR_MAX        = 0b1111;
+constexpr uint8_t FIXMAP_MAX        = 0b1111;
 
 enum Formats : Byte {
    POS_FIXINT   = 0b00000000, // 0XXXXXXX
    NEG_FIXINT   = 0b11100000, // 111xxxxx
-   FIXMAP       = 0b10000000, // 1000xxxx   @TODO
+   FIXMAP       = 0b10000000, // 1000xxxx
    FIXARR       = 0b10010000, // 1001xxxx
    FIXSTR       = 0b10100000, // 101xxxxx
 
-   NIL          = 0b11000000, // 0xc0       @TODO
+   NIL          = 0b11000000, // 0xc0
    BFALSE       = 0b11000010, // 0xc2
    BTRUE        = 0b11000011, // 0xc3
-   EXT8         = 0b11000111, // 0xc7       @TODO
-   EXT16        = 0b11001000, // 0xc8       @TODO
-   EXT32        = 0b11001001, // 0xc9       @TODO
+   BIN8         = 0b11000100, // 0xc4
+   BIN16        = 0b11000101, // 0xc5
+   BIN32        = 0b11000110, // 0xc6
+   EXT8         = 0b11000111, // 0xc7
+   EXT16        = 0b11001000, // 0xc8
+   EXT32        = 0b11001001, // 0xc9
    FLOAT32      = 0b11001010, // 0xca
    FLOAT64      = 0b11001011, // 0xcb
    UINT8        = 0b11001100, // 0xcc
@@ -59,20 +89,69 @@ enum Formats : Byte {
    INT16        = 0b11010001, // 0xd1
    INT32        = 0b11010010, // 0xd2
    INT64        = 0b11010011, // 0xd3
-   FIXEXT1      = 0b11010100, // 0xd4       @TODO
-   FIXEXT2      = 0b11010101, // 0xd5       @TODO
-   FIXEXT4      = 0b11010110, // 0xd6       @TODO
-   FIXEXT8      = 0b11010111, // 0xd7       @TODO
-   FIXEXT16     = 0b11011000, // 0xd8       @TODO
+   FIXEXT1      = 0b11010100, // 0xd4
+   FIXEXT2      = 0b11010101, // 0xd5
+   FIXEXT4      = 0b11010110, // 0xd6
+   FIXEXT8      = 0b11010111, // 0xd7
+   FIXEXT16     = 0b11011000, // 0xd8
    STR8         = 0b11011001, // 0xd9
    STR16        = 0b11011010, // 0xda
    STR32        = 0b11011011, // 0xdb
    ARR16        = 0b11011100, // 0xdc
    ARR32        = 0b11011101, // 0xdd
-   MAP16        = 0b11011110, // 0xde       @TODO
-   MAP32        = 0b11011111, // 0xdf       @TODO
+   MAP16        = 0b11011110, // 0xde
+   MAP32        = 0b11011111, // 0xdf
+};
+
+/*****************************************************************************************
+ *************************************   Errors   ****************************************
+ ****************************************************************************************/
+/**
+ * @brief The reasons that deserializing a value can fail.
+ * 
+ * BasicUnpacker::TryDeserialize returns these directly. Deserialize throws the 
+ * exception noted alongside each one instead.
+ */
+enum class Errc : uint8_t {
+   Ok = 0,
+   EndOfData,      // The source ran out before the value did. (std::invalid_argument)
+   TypeMismatch,   // The value is not encoded as the requested type. (std::runtime_error)
+   Narrowing,      // The value may not fit in the requested type. (std::length_error)
+   OutputTooSmall, // There are more elements than the output can hold. (std::length_error)
+   InvalidUtf8,    // A string is not valid UTF-8, when checked. (std::runtime_error)
+   Misaligned      // A typed array can't be borrowed, as it is misaligned. (std::runtime_error)
 };
 
+/**
+ * @brief Throws an exception of type E, or aborts if exceptions are disabled.
+ * 
+ * All errors in this header are raised through here, so that it can be compiled with 
+ * -fno-exceptions. The non-throwing TryDeserialize API should be used in that case.
+ */
+template<typename E>
+[[noreturn]] void Throw(const char *what) {
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+   throw E(what);
+#else
+   (void)what;
+   std::abort();
+#endif
+}
+
+/**
+ * @brief Throws the exception that corresponds to err.
+ */
+[[noreturn]] inline void ThrowError(Errc err) {
+   switch (err) {
+      case Errc::EndOfData: Throw<std::invalid_argument>("No more data to read");
+      case Errc::TypeMismatch: Throw<std::runtime_error>("ByteArray does not match type");
+      case Errc::Narrowing: Throw<std::length_error>("Narrowing conversion");
+      case Errc::InvalidUtf8: Throw<std::runtime_error>("String is not valid UTF-8");
+      case Errc::Misaligned: Throw<std::runtime_error>("Typed array is misaligned in memory");
+      default: Throw<std::length_error>("Output is not large enough");
+   }
+}
+
 /*****************************************************************************************
  *************************************   Concepts   **************************************
  ****************************************************************************************/
@@ -86,22 +165,154 @@ template<class T>
 concept SignedInt =
     std::is_signed_v<T> && !(std::same_as<T, bool>) && !(std::floating_point<T>);
 
+/**
+ * Types that serialize as nil: std::nullptr_t, and std::monostate as the empty 
+ * alternative of a std::variant.
+ */
+template<class T>
+concept NilType = IsType<T, std::nullptr_t> || IsType<T, std::monostate>;
+
+template<class T>
+concept StringType = std::convertible_to<T, std::string_view> && !NilType<T>;
+
+/**
+ * A std::basic_string of char with any traits and allocator, such as std::pmr::string.
+ */
+template<class T>
+concept CharString =
+    requires { typename T::traits_type; typename T::allocator_type; } &&
+    IsType<T, std::basic_string<char, typename T::traits_type, typename T::allocator_type>>;
+
+template<class T>
+concept PairType = requires(T &p) { p.first; p.second; } &&
+                   (std::tuple_size<std::remove_cv_t<T>>::value == 2);
+
+template<class T>
+concept MapType = std::ranges::sized_range<const T> && PairType<std::ranges::range_value_t<T>>;
+
+template<class T>
+concept FlatMapType = MapType<T> && requires(T &m, size_t n) { m.resize(n); m.data(); };
+
+template<class T>
+concept ByteLike = IsType<std::remove_cv_t<T>, Byte> || IsType<std::remove_cv_t<T>, std::byte>;
+
+/**
+ * Contiguous raw bytes, such as a ByteArray or std::span<const std::byte>. These are 
+ * serialized as bin rather than as an array of integers.
+ */
+template<class T>
+concept BinaryType = requires(T &a) { { std::span(a) }; } &&
+                     ByteLike<std::ranges::range_value_t<T>>;
+
+template<class T>
+concept ArrayType = requires(T &a) { { std::span(a) }; } && !StringType<T> && !MapType<T> &&
+                    !BinaryType<T>;
+
+template<class T>
+concept RangeType = std::ranges::sized_range<const T> && !ArrayType<T> && !StringType<T> &&
+                    !MapType<T> && !BinaryType<T>;
+
+template<class T>
+concept NumericType = UnsignedInt<T> || SignedInt<T> || std::floating_point<T>;
+
 template<class T>
-concept StringType = std::convertible_to<T, std::string_view>;
+concept OptionalType = requires { typename T::value_type; } &&
+                       IsType<T, std::optional<typename T::value_type>>;
 
 template<class T>
-concept ArrayType = requires(T &a) { { std::span(a) }; } && !StringType<T>;
+concept VariantType = requires { std::variant_size<T>::value; };
+
+template<class T>
+concept ConstSpanType = requires { typename T::element_type; } &&
+                        IsType<T, std::span<const typename T::element_type>>;
+
+template<class T>
+concept NumericVector =
+    requires { typename T::value_type; typename T::allocator_type; } &&
+    IsType<T, std::vector<typename T::value_type, typename T::allocator_type>> &&
+    NumericType<typename T::value_type>;
 
 // TODO: ResizableArray concept
 
+/**
+ * A Sink is the destination that a BasicPacker writes serialized bytes to. Sinks are
+ * responsible for reporting their own write failures by throwing.
+ */
+template<class T>
+concept Sink = requires(T &sink, const Byte *data, size_t len) {
+   { sink.Write(data, len) };
+   { sink.Reserve(len) };
+   { sink.Flush() };
+   { sink.Count() } -> std::convertible_to<size_t>;
+};
+
+/**
+ * A Sink that can keep a pointer to a payload instead of copying it, such as one that 
+ * gathers output for writev. BasicPacker hands it the payloads of strings and bins, 
+ * which must then outlive whatever the sink gathers.
+ */
+template<class T>
+concept ReferencingSink = Sink<T> && requires(T &sink, const Byte *data, size_t len) {
+   { sink.WriteReference(data, len) };
+};
+
 // clang-format on
 
+/**
+ * A Source is where a BasicUnpacker reads serialized bytes in from. Peek and Get 
+ * return EOF once the source is exhausted. Read either reads all of the requested 
+ * bytes or consumes nothing and returns false. Rewind steps back over bytes that were 
+ * just consumed, and is only needed on error paths.
+ */
+template<class T>
+concept Source = requires(T &src, Byte *data, size_t len) {
+   { src.Peek() } -> std::same_as<int>;
+   { src.Get() } -> std::same_as<int>;
+   { src.Read(data, len) } -> std::same_as<bool>;
+   { src.Rewind(len) };
+   { src.Count() } -> std::convertible_to<size_t>;
+};
+
+/**
+ * A ContiguousSource reads from memory, and can lend out views into it. Borrow returns 
+ * nullptr, consuming nothing, if fewer than len bytes remain. Available returns every 
+ * remaining byte without consuming any.
+ */
+template<class T>
+concept ContiguousSource = Source<T> && requires(T &src, size_t len) {
+   { src.Borrow(len) } -> std::same_as<const Byte *>;
+   { src.Available() } -> std::same_as<std::span<const Byte>>;
+};
+
 /*****************************************************************************************
  *********************************   Byte Utilities   ************************************
  ****************************************************************************************/
+/**
+ * @brief Reverses the byte order of a value.
+ * 
+ * 2, 4 and 8 byte values compile down to a single bswap instruction where the 
+ * compiler provides one.
+ */
 template<typename T>
 requires std::has_unique_object_representations_v<T>
 T Byteswap(T value) {
+#if defined(__GNUC__) || defined(__clang__)
+   if constexpr (sizeof(T) == 2) {
+      return std::bit_cast<T>(__builtin_bswap16(std::bit_cast<uint16_t>(value)));
+   } else if constexpr (sizeof(T) == 4) {
+      return std::bit_cast<T>(__builtin_bswap32(std::bit_cast<uint32_t>(value)));
+   } else if constexpr (sizeof(T) == 8) {
+      return std::bit_cast<T>(__builtin_bswap64(std::bit_cast<uint64_t>(value)));
+   }
+#elif defined(_MSC_VER)
+   if constexpr (sizeof(T) == 2) {
+      return std::bit_cast<T>(_byteswap_ushort(std::bit_cast<uint16_t>(value)));
+   } else if constexpr (sizeof(T) == 4) {
+      return std::bit_cast<T>(_byteswap_ulong(std::bit_cast<uint32_t>(value)));
+   } else if constexpr (sizeof(T) == 8) {
+      return std::bit_cast<T>(_byteswap_uint64(std::bit_cast<uint64_t>(value)));
+   }
+#endif
    auto temp = std::bit_cast<std::array<uint8_t, sizeof(T)>>(value);
    std::ranges::reverse(temp);
    return std::bit_cast<T>(temp);
@@ -120,868 +331,4771 @@ T ToBigEndian(T in) {
 template<typename T>
 requires std::has_unique_object_representations_v<T>
 T ToLittleEndian(T in) {
-   if constexpr (std::endian::native == std::endian::little) {
+   if constexpr (std::endian::native == std::endian::big) {
       return Byteswap(in);
    } else {
       return in;
    }
 }
 
+/**
+ * @brief Converts a big endian value, such as one read from msgpack data, to native 
+ * byte order.
+ */
+template<typename T>
+requires std::has_unique_object_representations_v<T>
+T FromBigEndian(T in) {
+   // Swapping is its own inverse.
+   return ToBigEndian(in);
+}
+
+/**
+ * @brief Stores an unsigned integer into a byte buffer in big endian order.
+ * 
+ * @param out The buffer to write to. Must have room for at least sizeof(T) bytes.
+ * @param val The value to store.
+ */
+template<typename T>
+requires std::is_unsigned_v<T>
+void StoreBigEndian(Byte *out, T val) {
+   val = ToBigEndian(val);
+   std::memcpy(out, &val, sizeof(T));
+}
+
+/**
+ * @brief Loads an unsigned integer stored in big endian order from a byte buffer.
+ * 
+ * @param in The buffer to read from. Must hold at least sizeof(T) bytes.
+ */
+template<typename T>
+requires std::is_unsigned_v<T>
+T LoadBigEndian(const Byte *in) {
+   T val;
+   std::memcpy(&val, in, sizeof(T));
+   return FromBigEndian(val);
+}
+
 /*****************************************************************************************
- **************************************   Classes   **************************************
+ ***********************************   Kernels   *****************************************
  ****************************************************************************************/
-class Packer {
-  public:
-   /**
-   * @brief Construct a new Packer object, setting stream to the beginning of the 
-   * buffer.
-   * 
-   * @param stream The byte stream to pack serialized data out to. Must have the 
-   * std::ios::binary and std::ios::out mode flags set.
-   */
-   Packer(std::ostream &stream) : mRef(stream) {
-      mRef.seekp(std::ios::beg);
-      mStreamStart = mRef.tellp();
-   }
+// Bulk byte order conversion. Each kernel has a scalar version plus SSSE3 and AVX2 
+// versions on x86 and a NEON version on ARM. When the target ISA is enabled at compile 
+// time that version is called directly, and otherwise x86 builds pick one at runtime.
+namespace kernels {
 
-   /**
-   * @brief Construct a new Packer object, setting the stream to a specified start 
-   * position.
-   * 
-   * Useful if you want to serialize data out to a specified position in a file.
-   * 
-   * @param stream The byte stream to pack serialized data out to. Must have the 
-   * std::ios::binary and std::ios::out mode flags set.
-   * @param start The start offset, in bytes, from the beginning of the stream.
-   */
-   Packer(std::ostream &stream, size_t start) : mRef(stream) {
-      mRef.seekp(start);
-      mStreamStart = mRef.tellp();
-   }
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PACK_X86_KERNELS 1
+#define PACK_TARGET(isa) __attribute__((target(isa)))
+#endif
 
-   ~Packer() { mRef.flush(); }
+#if defined(__ARM_NEON) && defined(__aarch64__)
+#define PACK_NEON_KERNELS 1
+#endif
 
-   /**
-    * @brief Gets a count of the number of bytes that have been successfully serialized 
-    * so far.
-    * 
-    * Note that just because bytes have been serialized, does not mean they have 
-    * successfully been written. Serialized data is only guarunteed to be written out 
-    * on a call to the destructor.
-    * 
-    * @return size_t The number of bytes successfully serialized so far.
-    */
-   size_t ByteCount() { return (uint64_t)mRef.tellp() - mStreamStart; }
+enum class SimdLevel { Scalar, Ssse3, Avx2, Neon };
 
-   /**
-    * @brief Serializes any number of values to the bytestream.
-    * 
-    * @tparam T The type of the first value to serialize.
-    * @tparam Rest The rest of the types to serialize.
-    * @param next The next value to serialize.
-    * @param rest A parameter pack consisting of the rest of the values.
-    */
-   template<typename T, typename... Rest>
-   void Serialize(const T &next, const Rest &...rest) {
-      Serialize(next);
-      Serialize(rest...);
-   }
+/**
+ * @brief Gets the best kernel implementation for the machine we are running on.
+ */
+inline SimdLevel DetectSimd() {
+#if defined(__AVX2__)
+   return SimdLevel::Avx2;
+#elif defined(PACK_X86_KERNELS)
+   static const SimdLevel level = __builtin_cpu_supports("avx2")    ? SimdLevel::Avx2
+                                  : __builtin_cpu_supports("ssse3") ? SimdLevel::Ssse3
+                                                                    : SimdLevel::Scalar;
+   return level;
+#elif defined(PACK_NEON_KERNELS)
+   return SimdLevel::Neon;
+#else
+   return SimdLevel::Scalar;
+#endif
+}
 
-   /**
-    * @brief Serialize a single boolean value to the bytestream.
-    * 
-    * @param val The value to serialize
-    * @throws std::runtime_error if there was a failure writing to the stream.
-    */
-   template<typename T>
-   requires IsType<T, bool>
-   void Serialize(T val) {
-      char data = val ? Formats::BTRUE : Formats::BFALSE;
-      mRef.put(data);
-      if (mRef.fail()) {
-         mRef.clear();
-         throw std::runtime_error("stream write error");
-      }
+/**
+ * @brief Shuffle control that reverses each W byte group within a 16 byte block.
+ */
+template<size_t W>
+constexpr std::array<Byte, 16> SWAP_SHUFFLE = [] {
+   std::array<Byte, 16> mask {};
+   for (size_t i = 0; i < 16; i++) { mask[i] = (i / W) * W + (W - 1 - i % W); }
+   return mask;
+}();
+
+template<size_t W>
+void SwapScalar(const Byte *in, Byte *out, size_t count) {
+   using U = std::conditional_t<W == 2, uint16_t, std::conditional_t<W == 4, uint32_t, uint64_t>>;
+   for (size_t i = 0; i < count; i++) {
+      U val;
+      std::memcpy(&val, in + i * W, W);
+      val = Byteswap(val);
+      std::memcpy(out + i * W, &val, W);
    }
+}
 
-   /**
-    * @brief Serialize a single unsigned integer to the bytestream
-    * 
-    * Can serialize 8, 16, 32, 64 bit unsigned integers into 1, 2, 3, 5, or 9 bytes of 
-    * serialized data.
-    * 
-    * @tparam T The unsigned integer width type to serialize
-    * @param val The value to serialize
-    * @throws std::runtime_error if there was a failure writing to the stream.
-    */
-   template<typename T>
-   requires UnsignedInt<T>
-   void Serialize(T val) {
-      if (val <= POS_FIXINT_MAX) {
-         mRef.put(val);
-      } else if (val <= UINT8_MAX) {
-         mRef.put(Formats::UINT8);
-         mRef.put(val);
-      } else if (val <= UINT16_MAX) {
-         mRef.put(Formats::UINT16);
-         uint16_t convert = ToBigEndian((uint16_t)val);
-         mRef.write((char *)&convert, 2);
-      } else if (val <= UINT32_MAX) {
-         mRef.put(Formats::UINT32);
-         uint32_t convert = ToBigEndian((uint32_t)val);
-         mRef.write((char *)&convert, 4);
-      } else {
-         mRef.put(Formats::UINT64);
-         uint64_t convert = ToBigEndian((uint64_t)val);
-         mRef.write((char *)&convert, 8);
-      }
+#if defined(PACK_X86_KERNELS)
+template<size_t W>
+PACK_TARGET("ssse3")
+void SwapSsse3(const Byte *in, Byte *out, size_t count) {
+   const __m128i mask = _mm_loadu_si128((const __m128i *)SWAP_SHUFFLE<W>.data());
+   size_t bytes = count * W;
+   size_t i = 0;
+   for (; i + 16 <= bytes; i += 16) {
+      __m128i block = _mm_loadu_si128((const __m128i *)(in + i));
+      _mm_storeu_si128((__m128i *)(out + i), _mm_shuffle_epi8(block, mask));
+   }
+   SwapScalar<W>(in + i, out + i, (bytes - i) / W);
+}
 
-      if (mRef.fail()) {
-         mRef.clear();
-         throw std::runtime_error("stream write error");
-      };
+template<size_t W>
+PACK_TARGET("avx2")
+void SwapAvx2(const Byte *in, Byte *out, size_t count) {
+   // vpshufb shuffles within each 128 bit lane, so the same control is used twice.
+   const __m128i half = _mm_loadu_si128((const __m128i *)SWAP_SHUFFLE<W>.data());
+   const __m256i mask = _mm256_broadcastsi128_si256(half);
+   size_t bytes = count * W;
+   size_t i = 0;
+   for (; i + 32 <= bytes; i += 32) {
+      __m256i block = _mm256_loadu_si256((const __m256i *)(in + i));
+      _mm256_storeu_si256((__m256i *)(out + i), _mm256_shuffle_epi8(block, mask));
    }
+   SwapScalar<W>(in + i, out + i, (bytes - i) / W);
+}
+#endif
 
-   /**
-    * @brief Serialize a single signed integer to the bytestream.
-    * 
-    * Can serialize 8, 16, 32, 64 bit signed integers into 1, 2, 3, 5, or 9 bytes of 
-    * serialized data.
-    * 
-    * @tparam T The unsigned integer width type to serialize
-    * @param val The value to serialize
-    * @throws std::runtime_error if there was a failure writing to the stream.
-    */
-   template<typename T>
-   requires SignedInt<T>
-   void Serialize(T val) {
-      if (val < 0 && val >= NEG_FIXINT_MIN) {
-         mRef.put(val);
-      } else if (val >= 0 && val <= POS_FIXINT_MAX) {
-         mRef.put(val);
-      } else if (val <= INT8_MAX && val >= INT8_MIN) {
-         mRef.put(Formats::INT8);
-         mRef.put(val);
-      } else if (val <= INT16_MAX && val >= INT16_MIN) {
-         mRef.put(Formats::INT16);
-         int16_t convert = ToBigEndian((uint16_t)val);
-         mRef.write((char *)&convert, 2);
-      } else if (val <= INT32_MAX && val >= INT32_MIN) {
-         mRef.put(Formats::INT32);
-         int32_t convert = ToBigEndian((uint32_t)val);
-         mRef.write((char *)&convert, 4);
+#if defined(PACK_NEON_KERNELS)
+template<size_t W>
+void SwapNeon(const Byte *in, Byte *out, size_t count) {
+   size_t bytes = count * W;
+   size_t i = 0;
+   for (; i + 16 <= bytes; i += 16) {
+      uint8x16_t block = vld1q_u8(in + i);
+      if constexpr (W == 2) {
+         block = vrev16q_u8(block);
+      } else if constexpr (W == 4) {
+         block = vrev32q_u8(block);
       } else {
-         mRef.put(Formats::INT64);
-         int64_t convert = ToBigEndian((uint64_t)val);
-         mRef.write((char *)&convert, 8);
+         block = vrev64q_u8(block);
       }
+      vst1q_u8(out + i, block);
+   }
+   SwapScalar<W>(in + i, out + i, (bytes - i) / W);
+}
+#endif
 
-      if (mRef.fail()) {
-         mRef.clear();
-         throw std::runtime_error("stream write error");
-      };
+/**
+ * @brief Reverses the byte order of count W byte values. in and out may be equal.
+ */
+template<size_t W>
+void Swap(const Byte *in, Byte *out, size_t count) {
+   switch (DetectSimd()) {
+#if defined(PACK_X86_KERNELS)
+      case SimdLevel::Avx2: return SwapAvx2<W>(in, out, count);
+      case SimdLevel::Ssse3: return SwapSsse3<W>(in, out, count);
+#endif
+#if defined(PACK_NEON_KERNELS)
+      case SimdLevel::Neon: return SwapNeon<W>(in, out, count);
+#endif
+      default: return SwapScalar<W>(in, out, count);
    }
+}
 
-   /**
-    * @brief Serialize a single UTF-8 null-terminated string.
-    * 
-    * @tparam T The string type to serialize (fixed length char array, std::string)
-    * @param val The data to serialize.
-    * @throws std::runtime_error if there was a failure writing to the stream.
-    */
-   template<typename T>
-   requires StringType<T>
-   void Serialize(const T &val) {
-      std::string_view view(val);
-      if (view.length() > UINT32_MAX) {
-         throw std::length_error("String exceeds max length");
-      } else if (view.length() <= FIXSTR_MAX) {
-         uint8_t fmt = FIXSTR_MASK | view.length();
-         mRef.put(fmt);
-         mRef.write(view.data(), view.length());
-      } else if (view.length() <= UINT8_MAX) {
-         mRef.put(Formats::STR8);
-         mRef.put(view.length());
-         mRef.write(view.data(), view.length());
-      } else if (view.length() <= UINT16_MAX) {
-         mRef.put(Formats::STR16);
-         uint16_t lenBigEndian = ToBigEndian((uint16_t)view.length());
-         mRef.write((char *)&lenBigEndian, 2);
-         mRef.write(view.data(), view.length());
-      } else {
-         mRef.put(Formats::STR32);
-         uint32_t lenBigEndian = ToBigEndian((uint32_t)view.length());
-         mRef.write((char *)&lenBigEndian, 4);
-         mRef.write(view.data(), view.length());
-      }
+// Float records are the msgpack encoding of a float or double array: each element is a 
+// FLOAT32 or FLOAT64 format specifier followed by the big endian value. The vector 
+// kernels convert four floats or two doubles per iteration, using one shuffle to both 
+// swap the values and open up gaps for the format specifiers.
 
-      if (mRef.fail()) {
-         mRef.clear();
-         throw std::runtime_error("stream write error");
-      };
+/**
+ * @brief Shuffle control that spreads W byte values out into W + 1 byte records, 
+ * swapping each value and zeroing the byte its format specifier goes in.
+ */
+template<size_t W>
+constexpr std::array<Byte, 16> ENCODE_SHUFFLE = [] {
+   std::array<Byte, 16> mask {};
+   for (size_t i = 0; i < 16; i++) {
+      size_t pos = i % (W + 1);
+      mask[i] = pos == 0 ? 0x80 : (i / (W + 1)) * W + (W - pos);
    }
+   return mask;
+}();
 
-   /**
-    * @brief Serialize a double precision IEEE 754 floating value.
-    * 
-    * @param val The data to serialize.
-    * @throws std::runtime_error if there was a failure writing to the stream.
-    */
-   template<typename T>
-   requires IsType<T, double>
-   void Serialize(T val) {
-      uint64_t data = 0;
-      memcpy(&data, &val, 8);
-      data = ToBigEndian(data);
-      mRef.put(Formats::FLOAT64);
-      mRef.write((char *)&data, 8);
-
-      if (mRef.fail()) {
-         mRef.clear();
-         throw std::runtime_error("stream write error");
-      };
+/**
+ * @brief Shuffle control that gathers the values of W + 1 byte records back together, 
+ * swapped to little endian. Lanes for values not fully inside the block are zeroed.
+ */
+template<size_t W>
+constexpr std::array<Byte, 16> DECODE_SHUFFLE = [] {
+   std::array<Byte, 16> mask {};
+   for (size_t i = 0; i < 16; i++) {
+      size_t src = (i / W) * (W + 1) + (W - i % W);
+      mask[i] = src < 16 && i / W < 16 / (W + 1) ? src : 0x80;
    }
+   return mask;
+}();
 
-   /**
-    * @brief Serialize a single precision IEEE 754 floating value.
-    * 
-    * @param val The data to serialize.
-    * @throws std::runtime_error if there was a failure writing to the stream.
-    */
-   template<typename T>
-   requires IsType<T, float>
-   void Serialize(T val) {
-      uint32_t data = 0;
-      memcpy(&data, &val, 4);
-      data = ToBigEndian(data);
-      mRef.put(Formats::FLOAT32);
-      mRef.write((char *)&data, 4);
+template<size_t W>
+using FloatBits = std::conditional_t<W == 4, uint32_t, uint64_t>;
 
-      if (mRef.fail()) {
-         mRef.clear();
-         throw std::runtime_error("stream write error");
-      };
+template<size_t W>
+void EncodeRecordsScalar(const Byte *in, Byte fmt, Byte *out, size_t count) {
+   for (size_t i = 0; i < count; i++) {
+      FloatBits<W> bits;
+      std::memcpy(&bits, in + i * W, W);
+      out[i * (W + 1)] = fmt;
+      StoreBigEndian(out + i * (W + 1) + 1, bits);
    }
+}
 
-   template<typename T, size_t N>
-   requires(not IsType<T, char const>)
-   void Serialize(T (&arr)[N]) {
-      Serialize(std::span<T, N>(arr));
+template<size_t W>
+size_t DecodeRecordsScalar(const Byte *in, Byte fmt, Byte *out, size_t count) {
+   for (size_t i = 0; i < count; i++) {
+      if (in[i * (W + 1)] != fmt) { return i; }
+      FloatBits<W> bits = LoadBigEndian<FloatBits<W>>(in + i * (W + 1) + 1);
+      std::memcpy(out + i * W, &bits, W);
    }
+   return count;
+}
 
-   template<typename T>
-   requires ArrayType<T>
-   void Serialize(T arr) {
-      auto span = std::span(arr);
-      auto sz = span.size();
+#if defined(PACK_X86_KERNELS)
+template<size_t W>
+PACK_TARGET("ssse3")
+void EncodeRecordsSsse3(const Byte *in, Byte fmt, Byte *out, size_t count) {
+   constexpr size_t PER_BLOCK = 16 / W;
+   const __m128i mask = _mm_loadu_si128((const __m128i *)ENCODE_SHUFFLE<W>.data());
+   std::array<Byte, 16> fmtBytes {};
+   for (size_t i = 0; i < 16; i += W + 1) { fmtBytes[i] = fmt; }
+   const __m128i fmts = _mm_loadu_si128((const __m128i *)fmtBytes.data());
+
+   size_t i = 0;
+   for (; i + PER_BLOCK <= count; i += PER_BLOCK) {
+      __m128i block = _mm_loadu_si128((const __m128i *)(in + i * W));
+      Byte *dst = out + i * (W + 1);
+      _mm_storeu_si128((__m128i *)dst, _mm_or_si128(_mm_shuffle_epi8(block, mask), fmts));
+      // The tail of the last record in the block doesn't fit in 16 bytes.
+      for (size_t j = 16; j < PER_BLOCK * (W + 1); j++) {
+         dst[j] = in[i * W + PER_BLOCK * W - (j - (PER_BLOCK - 1) * (W + 1))];
+      }
+   }
+   EncodeRecordsScalar<W>(in + i * W, fmt, out + i * (W + 1), count - i);
+}
 
-      if (span.size() <= 15) {
-         uint8_t fmt = FIXARR_MASK | span.size();
-         mRef.put(fmt);
+template<size_t W>
+PACK_TARGET("ssse3")
+size_t DecodeRecordsSsse3(const Byte *in, Byte fmt, Byte *out, size_t count) {
+   constexpr size_t PER_BLOCK = 16 / W;
+   constexpr size_t RECORDS = PER_BLOCK * (W + 1);
+   const __m128i mask = _mm_loadu_si128((const __m128i *)DECODE_SHUFFLE<W>.data());
+   // The last value of a block is read from a second load that ends on the block end.
+   std::array<Byte, 16> tailMask;
+   tailMask.fill(0x80);
+   for (size_t i = 0; i < W; i++) { tailMask[16 - W + i] = 15 - i; }
+   const __m128i tail = _mm_loadu_si128((const __m128i *)tailMask.data());
+   const __m128i fmts = _mm_set1_epi8((char)fmt);
+   int fmtBits = 0;
+   for (size_t i = 0; i < 16; i += W + 1) { fmtBits |= 1 << i; }
 
-         for (auto element : span) { Serialize(element); }
-      } else if (span.size() <= UINT16_MAX) {
-         mRef.put(Formats::ARR16);
-         uint64_t bigEndian = ToBigEndian((uint16_t)span.size());
-         mRef.write((char *)&bigEndian, 2);
+   size_t i = 0;
+   for (; i + PER_BLOCK <= count; i += PER_BLOCK) {
+      const Byte *src = in + i * (W + 1);
+      __m128i head = _mm_loadu_si128((const __m128i *)src);
+      int match = _mm_movemask_epi8(_mm_cmpeq_epi8(head, fmts));
+      if ((match & fmtBits) != fmtBits) { break; }
+      __m128i last = _mm_loadu_si128((const __m128i *)(src + RECORDS - 16));
+      __m128i values = _mm_or_si128(_mm_shuffle_epi8(head, mask), _mm_shuffle_epi8(last, tail));
+      _mm_storeu_si128((__m128i *)(out + i * W), values);
+   }
+   return i + DecodeRecordsScalar<W>(in + i * (W + 1), fmt, out + i * W, count - i);
+}
+#endif
 
-         for (auto element : span) { Serialize(element); }
-      } else if (span.size() <= UINT32_MAX) {
-         mRef.put(Formats::ARR32);
-         uint64_t bigEndian = ToBigEndian((uint32_t)span.size());
-         mRef.write((char *)&bigEndian, 4);
+#if defined(PACK_NEON_KERNELS)
+template<size_t W>
+void EncodeRecordsNeon(const Byte *in, Byte fmt, Byte *out, size_t count) {
+   constexpr size_t PER_BLOCK = 16 / W;
+   const uint8x16_t mask = vld1q_u8(ENCODE_SHUFFLE<W>.data());
+   std::array<Byte, 16> fmtBytes {};
+   for (size_t i = 0; i < 16; i += W + 1) { fmtBytes[i] = fmt; }
+   const uint8x16_t fmts = vld1q_u8(fmtBytes.data());
 
-         for (auto element : span) { Serialize(element); }
-      } else {
-         throw std::invalid_argument("Array exceeds max allowable size");
+   size_t i = 0;
+   for (; i + PER_BLOCK <= count; i += PER_BLOCK) {
+      uint8x16_t block = vld1q_u8(in + i * W);
+      Byte *dst = out + i * (W + 1);
+      vst1q_u8(dst, vorrq_u8(vqtbl1q_u8(block, mask), fmts));
+      for (size_t j = 16; j < PER_BLOCK * (W + 1); j++) {
+         dst[j] = in[i * W + PER_BLOCK * W - (j - (PER_BLOCK - 1) * (W + 1))];
       }
    }
+   EncodeRecordsScalar<W>(in + i * W, fmt, out + i * (W + 1), count - i);
+}
+#endif
 
-  private:
-   size_t mStreamStart {0};
-   std::ostream &mRef;
-};
-
-class Unpacker {
-  public:
-   /**
-   * @brief Construct a new Unpacker object, setting stream to the beginning of the
-   * buffer.
-   * 
-   * @param stream The byte stream to unpack serialized data from. Must have the 
-   * std::ios::binary and std::ios::in mode flags set.
-   */
-   Unpacker(std::istream &stream) : mRef(stream) {
-      mRef.seekg(mRef.beg);
-      mStreamStart = mRef.tellg();
+/**
+ * @brief Encodes count floats (W = 4) or doubles (W = 8) as msgpack records.
+ * 
+ * @param in The native values, as raw bytes.
+ * @param fmt The format specifier to write in front of each value.
+ * @param out Must have room for count * (W + 1) bytes.
+ */
+template<size_t W>
+void EncodeRecords(const Byte *in, Byte fmt, Byte *out, size_t count) {
+   if constexpr (std::endian::native == std::endian::little) {
+      switch (DetectSimd()) {
+#if defined(PACK_X86_KERNELS)
+         case SimdLevel::Avx2:
+         case SimdLevel::Ssse3: return EncodeRecordsSsse3<W>(in, fmt, out, count);
+#endif
+#if defined(PACK_NEON_KERNELS)
+         case SimdLevel::Neon: return EncodeRecordsNeon<W>(in, fmt, out, count);
+#endif
+         default: break;
+      }
    }
+   EncodeRecordsScalar<W>(in, fmt, out, count);
+}
 
-   /**
-   * @brief Construct a new Unpacker object, setting the stream to a specified start 
-   * position.
-   * 
-   * Useful if you want to deserialize data not at the beginning of a file.
-   * 
-   * @param stream The byte stream to unpack serialized data from. Must have the 
-   * std::ios::binary and std::ios::in mode flags set.
-   */
-   Unpacker(std::istream &stream, size_t start) : mRef(stream) {
-      mRef.seekg(start);
-      mStreamStart = mRef.tellg();
+/**
+ * @brief Decodes up to count msgpack records of floats (W = 4) or doubles (W = 8).
+ * 
+ * @param in Must hold count * (W + 1) bytes.
+ * @param fmt The format specifier every record is expected to start with.
+ * @param out The native values, as raw bytes.
+ * @return size_t The number of records decoded before the first one that does not 
+ * start with fmt.
+ */
+template<size_t W>
+size_t DecodeRecords(const Byte *in, Byte fmt, Byte *out, size_t count) {
+#if defined(PACK_X86_KERNELS)
+   if (DetectSimd() != SimdLevel::Scalar) { return DecodeRecordsSsse3<W>(in, fmt, out, count); }
+#endif
+   return DecodeRecordsScalar<W>(in, fmt, out, count);
+}
+
+// UTF-8 validation copies while it checks, so that validating a decoded string costs no 
+// extra pass over it. The vector kernels copy runs of ASCII a block at a time, and only 
+// fall back to checking sequences one by one in blocks that contain multibyte 
+// characters.
+
+/**
+ * @brief Gets the length of the UTF-8 sequence at the start of in, or 0 if in does not 
+ * start with a complete, valid one. Overlong encodings and surrogates are invalid.
+ */
+inline size_t Utf8Sequence(const Byte *in, size_t avail) {
+   Byte lead = in[0];
+   if (lead < 0x80) { return 1; }
+
+   size_t len;
+   uint32_t point;
+   uint32_t min;
+   if ((lead & 0xe0) == 0xc0) {
+      len = 2, point = lead & 0x1f, min = 0x80;
+   } else if ((lead & 0xf0) == 0xe0) {
+      len = 3, point = lead & 0x0f, min = 0x800;
+   } else if ((lead & 0xf8) == 0xf0) {
+      len = 4, point = lead & 0x07, min = 0x10000;
+   } else {
+      return 0;
    }
+   if (avail < len) { return 0; }
 
-   /**
-    * @brief Gets a count of the number of bytes of serialized data that have been 
-    * successfully read in so far.
-    * 
-    * Note that the number of bytes deserialized is not the same as the number of bytes 
-    * actually returned by Deserialize.
-    * 
-    * @return size_t The number of bytes successfully deserialized so far.
-    */
-   size_t ByteCount() { return (uint64_t)mRef.tellg() - mStreamStart; }
+   for (size_t i = 1; i < len; i++) {
+      if ((in[i] & 0xc0) != 0x80) { return 0; }
+      point = point << 6 | (in[i] & 0x3f);
+   }
+   if (point < min || point > 0x10ffff || (point >= 0xd800 && point <= 0xdfff)) {
+      return 0;
+   }
+   return len;
+}
 
-   /**
-    * @brief Deserializes a variable number of values.
-    * 
-    * @throws std::invalid_argument if there are no more bytes to read in the stream.
-    * @throws std::runtime_error If a given type does not match its corresponding format 
-    * specifier.
-    * @throws std::length_error If deserializing the data into T would result in a 
-    * narrowing conversion. (eg, Deserialized data is UINT64 but T is uint32_t)
-    * @tparam T The first type to deserialize
-    * @tparam Rest A parameter pack containing the rest of the types to deserialize.
-    * @param next The next value to be filled with the deserialized data.
-    * @param rest The rest of the values to be filled with deserialized data.
-    */
-   template<typename T, typename... Rest>
-   void Deserialize(T &next, Rest &...rest) {
-      Deserialize(next);
-      Deserialize(rest...);
+/**
+ * @brief Validates and copies sequences from pos until at least end, returning the 
+ * position reached, or SIZE_MAX if a sequence is invalid.
+ */
+inline size_t CopyUtf8Sequences(const Byte *in, Byte *out, size_t len, size_t pos,
+                                size_t end) {
+   while (pos < end) {
+      size_t seq = Utf8Sequence(in + pos, len - pos);
+      if (seq == 0) { return SIZE_MAX; }
+      if (out != nullptr) {
+         for (size_t i = 0; i < seq; i++) { out[pos + i] = in[pos + i]; }
+      }
+      pos += seq;
    }
+   return pos;
+}
 
-   /**
-    * @brief Deserializes a single boolean value.
-    * 
-    * @param out The value to be filled with the deserialized data.
-    * @throws std::invalid_argument if the bytestream contains no more data.
-    * @throws std::runtime_error if the bytestream data does not encode a boolean.
-    * @returns The deserialized boolean value.
-    */
-   template<typename T>
-   requires IsType<T, bool>
-   void Deserialize(T &out) {
-      if (mRef.peek() == EOF) {
-         mRef.clear();
-         throw std::invalid_argument("No more data to read");
+inline bool CopyUtf8Scalar(const Byte *in, Byte *out, size_t len, size_t pos = 0) {
+   return CopyUtf8Sequences(in, out, len, pos, len) != SIZE_MAX;
+}
+
+#if defined(PACK_X86_KERNELS)
+PACK_TARGET("ssse3")
+inline bool CopyUtf8Ssse3(const Byte *in, Byte *out, size_t len) {
+   size_t i = 0;
+   while (i + 16 <= len) {
+      __m128i block = _mm_loadu_si128((const __m128i *)(in + i));
+      if (_mm_movemask_epi8(block) == 0) {
+         if (out != nullptr) { _mm_storeu_si128((__m128i *)(out + i), block); }
+         i += 16;
+      } else if ((i = CopyUtf8Sequences(in, out, len, i, i + 16)) == SIZE_MAX) {
+         return false;
       }
+   }
+   return CopyUtf8Scalar(in, out, len, i);
+}
 
-      char data = Formats::NIL;
-      mRef.get(data);
+PACK_TARGET("avx2")
+inline bool CopyUtf8Avx2(const Byte *in, Byte *out, size_t len) {
+   size_t i = 0;
+   while (i + 32 <= len) {
+      __m256i block = _mm256_loadu_si256((const __m256i *)(in + i));
+      if (_mm256_movemask_epi8(block) == 0) {
+         if (out != nullptr) { _mm256_storeu_si256((__m256i *)(out + i), block); }
+         i += 32;
+      } else if ((i = CopyUtf8Sequences(in, out, len, i, i + 32)) == SIZE_MAX) {
+         return false;
+      }
+   }
+   return CopyUtf8Scalar(in, out, len, i);
+}
+#endif
 
-      switch ((Formats)data) {
-         case Formats::BTRUE: {
-            out = true;
-            break;
-         }
-         case Formats::BFALSE: {
-            out = false;
-            break;
-         }
-         default: {
-            throw std::runtime_error("ByteArray does not match type bool");
-         }
+#if defined(PACK_NEON_KERNELS)
+inline bool CopyUtf8Neon(const Byte *in, Byte *out, size_t len) {
+   size_t i = 0;
+   while (i + 16 <= len) {
+      uint8x16_t block = vld1q_u8(in + i);
+      if (vmaxvq_u8(block) < 0x80) {
+         if (out != nullptr) { vst1q_u8(out + i, block); }
+         i += 16;
+      } else if ((i = CopyUtf8Sequences(in, out, len, i, i + 16)) == SIZE_MAX) {
+         return false;
       }
    }
+   return CopyUtf8Scalar(in, out, len, i);
+}
+#endif
 
-   /**
-    * @brief Deserializes a single unsigned integer value of width 8, 16, 32, 64 bits.
-    * 
-    * @tparam T The type of the out parameter. T must be able to accomodate the 
-    * deserialized value without narrowing conversions, else std::length_error is 
-    * generated.
-    * @param out The value to be filled with the deserialized data.
-    * @throws std::invalid_argument if the bytestream contains no more data.
-    * @throws std::runtime_error if the bytestream data does not encode an unsigned int.
+/**
+ * @brief Checks that len bytes at in are valid UTF-8, copying them to out as it goes.
+ * 
+ * @param out Where to copy to. May be the same as in, or nullptr to only validate.
+ * @return false if in is not valid UTF-8, in which case out is partly written.
+ */
+inline bool CopyUtf8(const Byte *in, Byte *out, size_t len) {
+   switch (DetectSimd()) {
+#if defined(PACK_X86_KERNELS)
+      case SimdLevel::Avx2: return CopyUtf8Avx2(in, out, len);
+      case SimdLevel::Ssse3: return CopyUtf8Ssse3(in, out, len);
+#endif
+#if defined(PACK_NEON_KERNELS)
+      case SimdLevel::Neon: return CopyUtf8Neon(in, out, len);
+#endif
+      default: return CopyUtf8Scalar(in, out, len);
+   }
+}
+
+} // namespace kernels
+
+/**
+ * @brief Reverses the byte order of every element of an array, using vector 
+ * instructions where available.
+ * 
+ * @param in The values to convert.
+ * @param out Must have room for in.size() elements. May be the same array as in.
+ */
+template<typename T>
+requires std::is_trivially_copyable_v<T> && (sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8)
+void ByteswapArray(std::span<const T> in, T *out) {
+   kernels::Swap<sizeof(T)>((const Byte *)in.data(), (Byte *)out, in.size());
+}
+
+/**
+ * @brief Converts an array of native values to big endian. This is a plain copy on big 
+ * endian hosts.
+ */
+template<typename T>
+requires std::is_trivially_copyable_v<T> && (sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8)
+void ToBigEndianArray(std::span<const T> in, T *out) {
+   if constexpr (std::endian::native == std::endian::little) {
+      ByteswapArray(in, out);
+   } else if ((const T *)out != in.data()) {
+      std::memmove(out, in.data(), in.size_bytes());
+   }
+}
+
+/**
+ * @brief Converts an array of big endian values to native byte order.
+ */
+template<typename T>
+requires std::is_trivially_copyable_v<T> && (sizeof(T) == 2 || sizeof(T) == 4 || sizeof(T) == 8)
+void FromBigEndianArray(std::span<const T> in, T *out) {
+   ToBigEndianArray(in, out);
+}
+
+/*****************************************************************************************
+ *******************************   Encoding Utilities   **********************************
+ ****************************************************************************************/
+// Number of elements that bulk array encode and decode stage at a time.
+constexpr size_t BULK_CHUNK = 256;
+
+// Maximum number of bytes a decoder allocates up front for a header that it can't 
+// check against the amount of input left.
+constexpr size_t MAX_UNTRUSTED_RESERVE = 1 << 20;
+
+// Maximum number of bytes that any single numeric value encodes to.
+constexpr size_t MAX_NUMERIC_SIZE = 9;
+
+/**
+ * Maps the bit width of an integer magnitude to a width class, so that format 
+ * selection is one table lookup instead of a chain of range compares. Class 0 is a 
+ * fixint, and classes 1 through 4 are the 8, 16, 32 and 64 bit formats.
+ */
+constexpr std::array<Byte, 65> WIDTH_CLASS = [] {
+   std::array<Byte, 65> table {};
+   for (size_t bits = 0; bits <= 64; bits++) {
+      table[bits] = bits <= 8 ? 1 : bits <= 16 ? 2 : bits <= 32 ? 3 : 4;
+   }
+   return table;
+}();
+
+/**
+ * @brief Encodes an unsigned integer into the most compact msgpack format that holds it.
+ * 
+ * @param out The buffer to encode into. Must have room for MAX_NUMERIC_SIZE bytes.
+ * @return size_t The number of bytes written.
+ */
+inline size_t EncodeUint(Byte *out, uint64_t val) {
+   if (val <= POS_FIXINT_MAX) {
+      out[0] = val;
+      return 1;
+   }
+
+   switch (WIDTH_CLASS[std::bit_width(val)]) {
+      case 1: {
+         out[0] = Formats::UINT8;
+         out[1] = val;
+         return 2;
+      }
+      case 2: {
+         out[0] = Formats::UINT16;
+         StoreBigEndian(out + 1, (uint16_t)val);
+         return 3;
+      }
+      case 3: {
+         out[0] = Formats::UINT32;
+         StoreBigEndian(out + 1, (uint32_t)val);
+         return 5;
+      }
+      default: {
+         out[0] = Formats::UINT64;
+         StoreBigEndian(out + 1, (uint64_t)val);
+         return 9;
+      }
+   }
+}
+
+/**
+ * @brief Encodes a signed integer into the most compact msgpack format that holds it.
+ * 
+ * @param out The buffer to encode into. Must have room for MAX_NUMERIC_SIZE bytes.
+ * @return size_t The number of bytes written.
+ */
+inline size_t EncodeInt(Byte *out, int64_t val) {
+   if (val >= NEG_FIXINT_MIN && val <= POS_FIXINT_MAX) {
+      out[0] = val;
+      return 1;
+   }
+
+   // Width of the magnitude, plus one bit for the sign.
+   uint64_t magnitude = val < 0 ? ~(uint64_t)val : (uint64_t)val;
+   switch (WIDTH_CLASS[std::bit_width(magnitude) + 1]) {
+      case 1: {
+         out[0] = Formats::INT8;
+         out[1] = val;
+         return 2;
+      }
+      case 2: {
+         out[0] = Formats::INT16;
+         StoreBigEndian(out + 1, (uint16_t)val);
+         return 3;
+      }
+      case 3: {
+         out[0] = Formats::INT32;
+         StoreBigEndian(out + 1, (uint32_t)val);
+         return 5;
+      }
+      default: {
+         out[0] = Formats::INT64;
+         StoreBigEndian(out + 1, (uint64_t)val);
+         return 9;
+      }
+   }
+}
+
+/**
+ * @brief Encodes any numeric value into the buffer.
+ * 
+ * @param out The buffer to encode into. Must have room for MAX_NUMERIC_SIZE bytes.
+ * @return size_t The number of bytes written.
+ */
+template<typename T>
+requires NumericType<T>
+size_t EncodeNumeric(Byte *out, T val) {
+   if constexpr (std::floating_point<T> && sizeof(T) == 4) {
+      out[0] = Formats::FLOAT32;
+      StoreBigEndian(out + 1, std::bit_cast<uint32_t>(val));
+      return 5;
+   } else if constexpr (std::floating_point<T>) {
+      static_assert(IsType<T, double>, "Only float and double can be serialized");
+      out[0] = Formats::FLOAT64;
+      StoreBigEndian(out + 1, std::bit_cast<uint64_t>(val));
+      return 9;
+   } else if constexpr (UnsignedInt<T>) {
+      return EncodeUint(out, val);
+   } else {
+      return EncodeInt(out, val);
+   }
+}
+
+/**
+ * @brief The families of msgpack values.
+ */
+enum class Family : uint8_t { Nil, Bool, Uint, Int, Float, Str, Bin, Array, Map, Ext, Invalid };
+
+/**
+ * @brief Everything the first byte of a value says about how its encoding is laid out.
+ */
+struct FormatInfo {
+   Family family;
+   uint8_t header;     // Bytes before the payload, including the format byte.
+   uint8_t lengthSize; // Width of the big endian length or count after the format byte.
+   uint8_t elements;   // Values per counted element: 1 for arrays, 2 for maps, else 0.
+   uint32_t count;     // If lengthSize is 0, the payload size in bytes, or for arrays and 
+                       // maps the number of elements.
+};
+
+/**
+ * @brief Gets the layout of a value from its first byte.
+ */
+constexpr FormatInfo GetFormatInfo(Byte fmt) {
+   using enum Family;
+   if ((fmt & POS_FIXINT_MASK) == 0) { return {Uint, 1, 0, 0, 0}; }
+   if ((fmt & NEG_FIXINT) == NEG_FIXINT) { return {Int, 1, 0, 0, 0}; }
+   if ((fmt & FIXMAP_TYPE_MASK) == FIXMAP_MASK) {
+      return {Map, 1, 0, 2, (uint32_t)(fmt & FIXMAP_MAX)};
+   }
+   if ((fmt & FIXARR_TYPE_MASK) == FIXARR_MASK) {
+      return {Array, 1, 0, 1, (uint32_t)(fmt & FIXARR_MAX)};
+   }
+   if ((fmt & FIXSTR_TYPE_MASK) == FIXSTR_MASK) {
+      return {Str, 1, 0, 0, (uint32_t)(fmt & FIXSTR_MAX)};
+   }
+
+   switch ((Formats)fmt) {
+      case NIL: return {Nil, 1, 0, 0, 0};
+      case BFALSE:
+      case BTRUE: return {Bool, 1, 0, 0, 0};
+      case BIN8: return {Bin, 2, 1, 0, 0};
+      case BIN16: return {Bin, 3, 2, 0, 0};
+      case BIN32: return {Bin, 5, 4, 0, 0};
+      case EXT8: return {Ext, 3, 1, 0, 0};
+      case EXT16: return {Ext, 4, 2, 0, 0};
+      case EXT32: return {Ext, 6, 4, 0, 0};
+      case FLOAT32: return {Float, 1, 0, 0, 4};
+      case FLOAT64: return {Float, 1, 0, 0, 8};
+      case UINT8: return {Uint, 1, 0, 0, 1};
+      case UINT16: return {Uint, 1, 0, 0, 2};
+      case UINT32: return {Uint, 1, 0, 0, 4};
+      case UINT64: return {Uint, 1, 0, 0, 8};
+      case INT8: return {Int, 1, 0, 0, 1};
+      case INT16: return {Int, 1, 0, 0, 2};
+      case INT32: return {Int, 1, 0, 0, 4};
+      case INT64: return {Int, 1, 0, 0, 8};
+      case FIXEXT1: return {Ext, 2, 0, 0, 1};
+      case FIXEXT2: return {Ext, 2, 0, 0, 2};
+      case FIXEXT4: return {Ext, 2, 0, 0, 4};
+      case FIXEXT8: return {Ext, 2, 0, 0, 8};
+      case FIXEXT16: return {Ext, 2, 0, 0, 16};
+      case STR8: return {Str, 2, 1, 0, 0};
+      case STR16: return {Str, 3, 2, 0, 0};
+      case STR32: return {Str, 5, 4, 0, 0};
+      case ARR16: return {Array, 3, 2, 1, 0};
+      case ARR32: return {Array, 5, 4, 1, 0};
+      case MAP16: return {Map, 3, 2, 2, 0};
+      case MAP32: return {Map, 5, 4, 2, 0};
+      default: return {Invalid, 1, 0, 0, 0}; // 0xc1 is never used
+   }
+}
+
+/**
+ * @brief GetFormatInfo for every possible first byte, so that finding the layout of a 
+ * value is a single lookup.
+ */
+constexpr std::array<FormatInfo, 256> FORMAT_TABLE = [] {
+   std::array<FormatInfo, 256> table {};
+   for (size_t i = 0; i < table.size(); i++) { table[i] = GetFormatInfo((Byte)i); }
+   return table;
+}();
+
+/**
+ * @brief Decodes a single numeric value out of contiguous memory.
+ * 
+ * Accepts the same formats as the matching Unpacker::Deserialize overload, but never 
+ * throws, so callers can use it to decode runs of values in a tight loop.
+ * 
+ * @param in The encoded data.
+ * @param avail The number of bytes available at in.
+ * @param out The value to be filled with the decoded data.
+ * @return size_t The number of bytes decoded, or 0 if in does not start with a 
+ * complete value that fits into T.
+ */
+template<typename T>
+requires NumericType<T>
+size_t DecodeNumeric(const Byte *in, size_t avail, T &out) {
+   if (avail == 0) { return 0; }
+   Byte fmt = in[0];
+   FormatInfo info = FORMAT_TABLE[fmt];
+
+   if constexpr (std::floating_point<T>) {
+      size_t width = info.count;
+      if (info.family != Family::Float || width > sizeof(T) || avail < width + 1) {
+         return 0;
+      }
+      if (width == 4) {
+         out = std::bit_cast<float>(LoadBigEndian<uint32_t>(in + 1));
+      } else {
+         out = std::bit_cast<double>(LoadBigEndian<uint64_t>(in + 1));
+      }
+      return width + 1;
+   } else {
+      constexpr Family family = SignedInt<T> ? Family::Int : Family::Uint;
+      if (info.count == 0 && (info.family == Family::Uint || info.family == family)) {
+         // Positive fixint, or negative fixint if T is signed
+         out = (T)(std::conditional_t<SignedInt<T>, int8_t, uint8_t>)fmt;
+         return 1;
+      }
+
+      size_t width = info.count;
+      if (info.family != family || width > sizeof(T) || avail < width + 1) { return 0; }
+
+      // clang-format off
+      switch (width) {
+         case 1: out = (T)(std::conditional_t<SignedInt<T>, int8_t, uint8_t>)in[1]; break;
+         case 2: out = (T)(std::conditional_t<SignedInt<T>, int16_t, uint16_t>)LoadBigEndian<uint16_t>(in + 1); break;
+         case 4: out = (T)(std::conditional_t<SignedInt<T>, int32_t, uint32_t>)LoadBigEndian<uint32_t>(in + 1); break;
+         default: out = (T)LoadBigEndian<uint64_t>(in + 1); break;
+      }
+      // clang-format on
+      return width + 1;
+   }
+}
+
+/**
+ * @brief Reads the length or count field of a value whose header is available at in.
+ */
+constexpr uint32_t ReadFormatCount(const Byte *in, FormatInfo info) {
+   switch (info.lengthSize) {
+      case 0: return info.count;
+      case 1: return in[1];
+      case 2: return (uint32_t)in[1] << 8 | in[2];
+      default: {
+         return (uint32_t)in[1] << 24 | (uint32_t)in[2] << 16 | (uint32_t)in[3] << 8 | in[4];
+      }
+   }
+}
+
+/**
+ * @brief How far a scan over encoded values has got. It can be resumed from here once 
+ * more data is available.
+ */
+struct ScanState {
+   size_t pos {0};     // Number of bytes scanned so far.
+   size_t pending {1}; // Number of values still to scan.
+};
+
+/**
+ * @brief Walks over encoded values using only their headers, without decoding them.
+ * 
+ * Scanning a value completes one pending value, and an array or map adds one pending 
+ * value for each of its elements, so nested containers don't need a stack.
+ * 
+ * @param in The encoded data, starting from where the scan began.
+ * @param state Where to resume the scan from. Updated with how far it got.
+ * @return Errc::Ok once no values are pending.
+ * @return Errc::EndOfData if in ends before the pending values do. The scan stops at 
+ * the start of the incomplete value.
+ * @return Errc::TypeMismatch if a value starts with a byte that no format uses.
+ */
+constexpr Errc ScanValues(std::span<const Byte> in, ScanState &state) {
+   while (state.pending > 0) {
+      size_t avail = in.size() - state.pos;
+      // Every value takes at least a byte, which also keeps pending from overflowing.
+      if (avail < state.pending) { return Errc::EndOfData; }
+
+      const Byte *data = in.data() + state.pos;
+      FormatInfo info = FORMAT_TABLE[data[0]];
+      if (info.family == Family::Invalid) { return Errc::TypeMismatch; }
+      if (avail < info.header) { return Errc::EndOfData; }
+
+      size_t count = ReadFormatCount(data, info);
+      size_t size = info.header + (info.elements == 0 ? count : 0);
+      if (avail < size) { return Errc::EndOfData; }
+
+      state.pos += size;
+      state.pending += count * info.elements - 1;
+   }
+   return Errc::Ok;
+}
+
+/**
+ * @brief Skips over the first value encoded in data, without decoding it.
+ * 
+ * @param data The encoded data. On success, it is advanced to just past the value.
+ * @return Errc::EndOfData if data ends before the value does.
+ * @return Errc::TypeMismatch if the value is malformed.
+ */
+constexpr Errc Skip(std::span<const Byte> &data) {
+   ScanState state;
+   Errc err = ScanValues(data, state);
+   if (err == Errc::Ok) { data = data.subspan(state.pos); }
+   return err;
+}
+
+/**
+ * @brief Checks that data holds nothing but complete, well formed values, without 
+ * decoding any of them.
+ * 
+ * Once a buffer has passed, it can be decoded with a TrustedUnpacker, which skips 
+ * checking for the end of the data.
+ * 
+ * @return Errc::EndOfData if the last value is incomplete, or a length or count runs 
+ * past the end of data.
+ * @return Errc::TypeMismatch if a value starts with a byte that no format uses.
+ */
+constexpr Errc Validate(std::span<const Byte> data) {
+   while (!data.empty()) {
+      if (Errc err = Skip(data); err != Errc::Ok) { return err; }
+   }
+   return Errc::Ok;
+}
+
+/*****************************************************************************************
+ *********************************   Reflection   ****************************************
+ ****************************************************************************************/
+/**
+ * @brief How a described struct is laid out when serialized.
+ */
+enum class Layout {
+   Array, // Fields in declaration order, as an array.
+   Map,   // Fields keyed by their names, as a map.
+};
+
+/**
+ * @brief Customization point that describes the fields of a user type.
+ * 
+ * Specialize it with a static Tie function for both const and non-const objects, which 
+ * returns a std::tuple of references to the fields, a static constexpr Layout layout, 
+ * and a static constexpr std::string_view names holding the comma separated field 
+ * names. Most types should just use PACK_AS_ARRAY or PACK_AS_MAP in their definition, 
+ * which fills it in automatically.
+ */
+template<typename T>
+struct Describe;
+
+template<typename T>
+requires requires(T &val) { val.PackTie(); }
+struct Describe<T> {
+   static constexpr auto Tie(T &val) { return val.PackTie(); }
+   static constexpr auto Tie(const T &val) { return val.PackTie(); }
+   static constexpr Layout layout = T::PackLayout;
+   static constexpr std::string_view names = T::PackNames;
+};
+
+template<class T>
+concept Described = requires(T &val, const T &constVal) {
+   { Describe<T>::Tie(val) };
+   { Describe<T>::Tie(constVal) };
+   { Describe<T>::layout } -> std::convertible_to<Layout>;
+   { Describe<T>::names } -> std::convertible_to<std::string_view>;
+};
+
+/**
+ * @brief Describes the fields of a struct, to be serialized as a msgpack array.
+ * 
+ * Place it in the struct definition, listing the fields in order: 
+ * `struct Point { int x; int y; PACK_AS_ARRAY(x, y) };`
+ */
+#define PACK_AS_ARRAY(...) PACK_DESCRIBE_FIELDS(::pack::Layout::Array, __VA_ARGS__)
+
+/**
+ * @brief Describes the fields of a struct, to be serialized as a msgpack map keyed by 
+ * the field names.
+ * 
+ * Place it in the struct definition, listing the fields: 
+ * `struct Point { int x; int y; PACK_AS_MAP(x, y) };`
+ */
+#define PACK_AS_MAP(...) PACK_DESCRIBE_FIELDS(::pack::Layout::Map, __VA_ARGS__)
+
+#define PACK_DESCRIBE_FIELDS(layout, ...)                                       \
+   constexpr auto PackTie() { return std::tie(__VA_ARGS__); }                   \
+   constexpr auto PackTie() const { return std::tie(__VA_ARGS__); }             \
+   static constexpr ::pack::Layout PackLayout = layout;                         \
+   static constexpr std::string_view PackNames = #__VA_ARGS__;
+
+/**
+ * @brief Everything about the encoding of a described struct that doesn't depend on 
+ * its field values, worked out at compile time.
+ * 
+ * The encoded form is split into one constant segment per field, which is written just 
+ * before that field's value. The first segment holds the array or map header. For maps, 
+ * each segment also holds the pre-encoded key for its field.
+ */
+template<Described T>
+struct StructLayout {
+   using Fields = decltype(Describe<T>::Tie(std::declval<T &>()));
+   static constexpr size_t COUNT = std::tuple_size_v<Fields>;
+   static constexpr bool IS_MAP = Describe<T>::layout == Layout::Map;
+
+   static constexpr std::array<std::string_view, COUNT> NAMES = [] {
+      std::array<std::string_view, COUNT> names {};
+      std::string_view list = Describe<T>::names;
+      for (size_t i = 0; i < COUNT; i++) {
+         size_t end = std::min(list.find(','), list.size());
+         std::string_view name = list.substr(0, end);
+         while (!name.empty() && (name.front() == ' ' || name.front() == '\n')) {
+            name.remove_prefix(1);
+         }
+         while (!name.empty() && (name.back() == ' ' || name.back() == '\n')) {
+            name.remove_suffix(1);
+         }
+         names[i] = name;
+         list.remove_prefix(std::min(end + 1, list.size()));
+      }
+      return names;
+   }();
+
+   static constexpr size_t HEADER_SIZE = COUNT <= 15 ? 1 : 3;
+
+   static constexpr size_t KeySize(std::string_view name) {
+      return IS_MAP ? (name.size() <= FIXSTR_MAX ? 1 : 2) + name.size() : 0;
+   }
+
+   // Offsets of each field's segment within SEGMENT_BYTES. Segment i is 
+   // [OFFSETS[i], OFFSETS[i + 1]).
+   static constexpr std::array<size_t, COUNT + 1> OFFSETS = [] {
+      std::array<size_t, COUNT + 1> offsets {};
+      size_t offset = HEADER_SIZE;
+      for (size_t i = 0; i < COUNT; i++) {
+         offset += KeySize(NAMES[i]);
+         offsets[i + 1] = offset;
+      }
+      return offsets;
+   }();
+
+   static constexpr std::array<Byte, OFFSETS[COUNT]> SEGMENT_BYTES = [] {
+      static_assert(COUNT <= UINT16_MAX, "Too many fields");
+      std::array<Byte, OFFSETS[COUNT]> bytes {};
+      if constexpr (COUNT <= 15) {
+         bytes[0] = (IS_MAP ? FIXMAP_MASK : FIXARR_MASK) | COUNT;
+      } else {
+         bytes[0] = IS_MAP ? Formats::MAP16 : Formats::ARR16;
+         bytes[1] = COUNT >> 8;
+         bytes[2] = COUNT & 0xff;
+      }
+
+      if constexpr (IS_MAP) {
+         for (size_t i = 0; i < COUNT; i++) {
+            std::string_view name = NAMES[i];
+            size_t pos = OFFSETS[i] + (i == 0 ? HEADER_SIZE : 0);
+            if (name.size() <= FIXSTR_MAX) {
+               bytes[pos++] = FIXSTR_MASK | name.size();
+            } else {
+               bytes[pos++] = Formats::STR8;
+               bytes[pos++] = name.size();
+            }
+            for (char c : name) { bytes[pos++] = c; }
+         }
+      }
+      return bytes;
+   }();
+
+   static constexpr size_t MAX_NAME = [] {
+      size_t longest = 0;
+      for (std::string_view name : NAMES) { longest = std::max(longest, name.size()); }
+      return longest;
+   }();
+   static_assert(COUNT > 0, "Described structs need at least one field");
+   static_assert(MAX_NAME <= UINT8_MAX, "Field names must be at most 255 bytes");
+};
+
+/*****************************************************************************************
+ **********************************   Extensions   ***************************************
+ ****************************************************************************************/
+// The extension type of timestamps, as defined by the msgpack specification.
+constexpr int8_t TIMESTAMP_TYPE = -1;
+
+// The extension type of typed arrays. Override it if it clashes with an application's 
+// own extension types.
+#ifndef PACK_TYPED_ARRAY_TYPE
+#define PACK_TYPED_ARRAY_TYPE 84
+#endif
+constexpr int8_t TYPED_ARRAY_TYPE = PACK_TYPED_ARRAY_TYPE;
+
+// The extension types of interned strings: a definition, whose payload is a string to 
+// add to the receiver's StringCache, and a reference, whose payload is the big endian 
+// index of a string defined earlier. Override them if they clash.
+#ifndef PACK_STRING_DEFINITION_TYPE
+#define PACK_STRING_DEFINITION_TYPE 85
+#endif
+#ifndef PACK_STRING_REFERENCE_TYPE
+#define PACK_STRING_REFERENCE_TYPE 86
+#endif
+constexpr int8_t STRING_DEFINITION_TYPE = PACK_STRING_DEFINITION_TYPE;
+constexpr int8_t STRING_REFERENCE_TYPE = PACK_STRING_REFERENCE_TYPE;
+
+/**
+ * @brief Customization point that registers a user type as a msgpack extension type.
+ * 
+ * Specialize it with a static constexpr int8_t TYPE, and static functions: Size, which 
+ * returns the number of payload bytes a value encodes to, Encode, which passes exactly 
+ * that many bytes to write(const Byte *data, size_t len), in one or more calls, and 
+ * Decode, which fills out from a payload and returns an Errc. See the specialization 
+ * for timestamps below for an example.
+ */
+template<typename T>
+struct Extension;
+
+template<class T>
+concept ExtensionType = requires(const T &val, T &out, std::span<const Byte> payload) {
+   { Extension<T>::TYPE } -> std::convertible_to<int8_t>;
+   { Extension<T>::Size(val) } -> std::convertible_to<size_t>;
+   { Extension<T>::Encode(val, [](const Byte *, size_t) {}) };
+   { Extension<T>::Decode(payload, out) } -> std::same_as<Errc>;
+};
+
+/**
+ * @brief Timestamps, as std::chrono::system_clock time points of any precision. They 
+ * are encoded in the smallest of the timestamp 32, 64 and 96 formats that holds them.
+ */
+template<typename D>
+struct Extension<std::chrono::time_point<std::chrono::system_clock, D>> {
+   using TimePoint = std::chrono::time_point<std::chrono::system_clock, D>;
+   static constexpr int8_t TYPE = TIMESTAMP_TYPE;
+
+   static constexpr size_t Size(const TimePoint &val) {
+      auto [secs, nanos] = Split(val);
+      if (secs >> 34 == 0) { return nanos == 0 && secs >> 32 == 0 ? 4 : 8; }
+      return 12;
+   }
+
+   template<typename W>
+   static void Encode(const TimePoint &val, W &&write) {
+      auto [secs, nanos] = Split(val);
+      std::array<Byte, 12> payload;
+      size_t len = Size(val);
+      if (len == 4) {
+         StoreBigEndian(payload.data(), (uint32_t)secs);
+      } else if (len == 8) {
+         StoreBigEndian(payload.data(), (uint64_t)nanos << 34 | (uint64_t)secs);
+      } else {
+         StoreBigEndian(payload.data(), nanos);
+         StoreBigEndian(payload.data() + 4, (uint64_t)secs);
+      }
+      write(payload.data(), len);
+   }
+
+   static Errc Decode(std::span<const Byte> payload, TimePoint &out) {
+      int64_t secs;
+      uint32_t nanos = 0;
+      switch (payload.size()) {
+         case 4: {
+            secs = LoadBigEndian<uint32_t>(payload.data());
+            break;
+         }
+         case 8: {
+            uint64_t bits = LoadBigEndian<uint64_t>(payload.data());
+            nanos = bits >> 34;
+            secs = bits & ((uint64_t(1) << 34) - 1);
+            break;
+         }
+         case 12: {
+            nanos = LoadBigEndian<uint32_t>(payload.data());
+            secs = (int64_t)LoadBigEndian<uint64_t>(payload.data() + 4);
+            break;
+         }
+         default: return Errc::TypeMismatch;
+      }
+      if (nanos >= 1000000000) { return Errc::TypeMismatch; }
+
+      // Converted separately, so that coarse time points don't overflow nanoseconds.
+      out = std::chrono::floor<D>(std::chrono::sys_seconds(std::chrono::seconds(secs))) +
+            std::chrono::floor<D>(std::chrono::nanoseconds(nanos));
+      return Errc::Ok;
+   }
+
+  private:
+   // Whole seconds since the epoch, rounded down, and the nanoseconds past them.
+   static constexpr std::pair<int64_t, uint32_t> Split(const TimePoint &val) {
+      auto secs = std::chrono::floor<std::chrono::seconds>(val);
+      auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(val - secs);
+      return {secs.time_since_epoch().count(), (uint32_t)nanos.count()};
+   }
+};
+
+/**
+ * @brief Marks a numeric array to be serialized as a typed array extension, which 
+ * holds the raw bytes of the elements in native byte order, instead of as a msgpack 
+ * array with one value per element.
+ * 
+ * Encoding is then a single copy. The elements are padded to start aligned, relative 
+ * to the start of the packer's output, so a typed array can be deserialized into a 
+ * std::span<const T> that points straight into the buffer, as well as into a 
+ * std::vector<T>. Only this library decodes the format, so it is for data that stays 
+ * within an application.
+ * 
+ * Borrowing a span only works if the packer's output starts at an alignment boundary 
+ * in memory, and decoding starts where the packer did. The padding is worked out from 
+ * the packer's Count, which starts from 0 at the sink's start offset or at a Reset, not 
+ * from the address the bytes end up at. A heap allocated ByteArray packed from its 
+ * beginning is suitably aligned. The payload is laid out as: 
+ * 
+ * [TYPED_ARRAY_CODE<T>] [padding length] [padding] [elements]
+ */
+template<typename T>
+requires NumericType<T>
+struct TypedArray {
+   template<typename R>
+   requires std::convertible_to<const R &, std::span<const T>>
+   TypedArray(const R &range) : elements(range) {}
+
+   std::span<const T> elements;
+};
+
+template<typename R>
+TypedArray(const R &) -> TypedArray<std::remove_cv_t<std::ranges::range_value_t<R>>>;
+
+/**
+ * @brief Identifies the element type of a typed array. Bits 0-1 are 0 for unsigned 
+ * integers, 1 for signed integers and 2 for floating point, bits 4-5 are the log2 of 
+ * the element width and bit 7 is set if the elements are big endian.
+ */
+template<typename T>
+constexpr Byte TYPED_ARRAY_CODE = (std::floating_point<T> ? 2 : SignedInt<T> ? 1 : 0) |
+                                  std::countr_zero(sizeof(T)) << 4 |
+                                  (std::endian::native == std::endian::big ? 0x80 : 0);
+
+// Typed arrays always use an ext32 header, so where the elements start doesn't depend 
+// on how many there are.
+constexpr size_t TYPED_ARRAY_PREFIX = 6 + 2;
+
+/*****************************************************************************************
+ *******************************   String Interning   ************************************
+ ****************************************************************************************/
+// How many strings a StringTable or StringCache holds by default. Indices then fit in 
+// two bytes, so no reference takes more than 4.
+constexpr size_t INTERN_CAPACITY = 65536;
+
+// The shortest string a StringTable interns by default. Shorter ones are no bigger 
+// written out in full.
+constexpr size_t INTERN_MIN_LENGTH = 4;
+
+/**
+ * @brief The sending side of string interning: the strings a packer has defined so far 
+ * on one stream, and their indices.
+ * 
+ * While a table is attached to a packer with InternStrings, the first time a string of 
+ * at least minLength bytes is serialized, it is written as a definition, and after that 
+ * as a reference of 3 or 4 bytes. That includes the keys of structs described with 
+ * PACK_AS_MAP. Once the table is full, new strings are written out in full as usual.
+ * 
+ * The receiver must decode everything written with the table, in order, with a 
+ * StringCache attached, so a table belongs to a single stream. Clear it when starting on 
+ * another.
+ */
+class StringTable {
+  public:
+   /**
+    * @brief Construct a new, empty StringTable.
+    * 
+    * @param capacity The most strings to define. It must be no more than the capacity 
+    * of the receiver's StringCache.
+    * @param minLength The shortest string to intern.
+    */
+   StringTable(size_t capacity = INTERN_CAPACITY, size_t minLength = INTERN_MIN_LENGTH) :
+      mCapacity(std::min<size_t>(capacity, UINT32_MAX)), mMinLength(minLength) {}
+
+   StringTable(const StringTable &) = delete;
+   StringTable &operator=(const StringTable &) = delete;
+
+   /**
+    * @brief Gets the index of a string that has been defined, or SIZE_MAX if it hasn't.
+    */
+   size_t Find(std::string_view str) const {
+      auto found = mIndices.find(str);
+      return found == mIndices.end() ? SIZE_MAX : found->second;
+   }
+
+   /**
+    * @brief Defines a string that isn't in the table yet, as the next index.
+    * 
+    * @return false, leaving the table as it was, if the string is too short or the 
+    * table is full.
+    */
+   bool Add(std::string_view str) {
+      if (str.size() < mMinLength || mIndices.size() >= mCapacity) { return false; }
+      mIndices.emplace(mStrings.emplace_back(str), (uint32_t)mIndices.size());
+      return true;
+   }
+
+   /**
+    * @brief Gets the number of strings defined.
+    */
+   size_t Size() const { return mIndices.size(); }
+
+   /**
+    * @brief Gets the shortest string that is interned.
+    */
+   size_t MinLength() const { return mMinLength; }
+
+   /**
+    * @brief Forgets every string, to start on a new stream.
+    */
+   void Clear() {
+      mIndices.clear();
+      mStrings.clear();
+   }
+
+  private:
+   std::deque<std::string> mStrings; // Owns the keys of mIndices, which never move.
+   std::unordered_map<std::string_view, uint32_t> mIndices;
+   size_t mCapacity;
+   size_t mMinLength;
+};
+
+/**
+ * @brief The receiving side of string interning: the strings defined so far on one 
+ * stream, in the order they were defined.
+ * 
+ * While a cache is attached to an unpacker with InternStrings, each definition is kept, 
+ * and references to it decode to the same string. Deserializing into a std::string_view 
+ * then points into the cache, and into a std::string copies, reusing its capacity. 
+ * Strings stay where they are until the cache is cleared or destroyed.
+ */
+class StringCache {
+  public:
+   /**
+    * @brief Construct a new, empty StringCache.
+    * 
+    * @param capacity The most strings to accept definitions of. Any more are treated 
+    * as an error, so that input can't grow the cache without limit.
+    */
+   StringCache(size_t capacity = INTERN_CAPACITY) : mCapacity(capacity) {}
+
+   StringCache(const StringCache &) = delete;
+   StringCache &operator=(const StringCache &) = delete;
+
+   /**
+    * @brief Gets a defined string, or an empty view if there is no such index.
+    */
+   std::string_view Find(size_t index) const {
+      return index < mStrings.size() ? std::string_view(mStrings[index]) : std::string_view();
+   }
+
+   /**
+    * @brief Keeps a newly defined string as the next index.
+    * 
+    * @return false, leaving the cache as it was, if it is full.
+    */
+   bool Add(std::string &&str) {
+      if (mStrings.size() >= mCapacity) { return false; }
+      mStrings.push_back(std::move(str));
+      return true;
+   }
+
+   /**
+    * @brief Gets the number of strings defined.
+    */
+   size_t Size() const { return mStrings.size(); }
+
+   /**
+    * @brief Forgets the strings defined after the first size, as when the values that 
+    * defined them failed to decode and were put back.
+    */
+   void Truncate(size_t size) {
+      while (mStrings.size() > size) { mStrings.pop_back(); }
+   }
+
+   /**
+    * @brief Forgets every string, to start on a new stream.
+    */
+   void Clear() { mStrings.clear(); }
+
+  private:
+   std::deque<std::string> mStrings;
+   size_t mCapacity;
+};
+
+/*****************************************************************************************
+ ***********************************   Packed Size   *************************************
+ ****************************************************************************************/
+// Number of bytes each integer width class from WIDTH_CLASS encodes to.
+constexpr std::array<size_t, 5> WIDTH_CLASS_SIZE = {1, 2, 3, 5, 9};
+
+/**
+ * @brief Gets the number of bytes EncodeUint encodes val to.
+ */
+constexpr size_t UintSize(uint64_t val) {
+   return val <= POS_FIXINT_MAX ? 1 : WIDTH_CLASS_SIZE[WIDTH_CLASS[std::bit_width(val)]];
+}
+
+/**
+ * @brief Gets the number of bytes EncodeInt encodes val to.
+ */
+constexpr size_t IntSize(int64_t val) {
+   if (val >= NEG_FIXINT_MIN && val <= POS_FIXINT_MAX) { return 1; }
+   uint64_t magnitude = val < 0 ? ~(uint64_t)val : (uint64_t)val;
+   return WIDTH_CLASS_SIZE[WIDTH_CLASS[std::bit_width(magnitude) + 1]];
+}
+
+constexpr size_t StrHeaderSize(size_t len) {
+   return len <= FIXSTR_MAX ? 1 : len <= UINT8_MAX ? 2 : len <= UINT16_MAX ? 3 : 5;
+}
+
+constexpr size_t BinHeaderSize(size_t len) {
+   return len <= UINT8_MAX ? 2 : len <= UINT16_MAX ? 3 : 5;
+}
+
+constexpr size_t ExtHeaderSize(size_t len) {
+   if (len == 1 || len == 2 || len == 4 || len == 8 || len == 16) { return 2; }
+   return len <= UINT8_MAX ? 3 : len <= UINT16_MAX ? 4 : 6;
+}
+
+constexpr size_t ArrHeaderSize(size_t count) {
+   return count <= FIXARR_MAX ? 1 : count <= UINT16_MAX ? 3 : 5;
+}
+
+constexpr size_t MapHeaderSize(size_t count) {
+   return count <= FIXMAP_MAX ? 1 : count <= UINT16_MAX ? 3 : 5;
+}
+
+/**
+ * @brief Works out encoded sizes without encoding anything. 
+ * 
+ * There is an overload of Of for each BasicPacker::Serialize overload, which makes 
+ * the same choice of format. Use PackedSize and MAX_PACKED_SIZE rather than this 
+ * directly.
+ */
+struct PackedSizer {
+   template<typename T>
+   requires IsType<T, bool> || NilType<T>
+   static constexpr size_t Of(T) {
+      return 1;
+   }
+
+   template<typename T>
+   static constexpr size_t Of(const std::optional<T> &val) {
+      return val ? Of(*val) : 1;
+   }
+
+   template<typename... T>
+   static constexpr size_t Of(const std::variant<T...> &val) {
+      return std::visit([](const auto &alternative) { return Of(alternative); }, val);
+   }
+
+   template<typename T>
+   requires UnsignedInt<T>
+   static constexpr size_t Of(T val) {
+      return UintSize(val);
+   }
+
+   template<typename T>
+   requires SignedInt<T>
+   static constexpr size_t Of(T val) {
+      return IntSize(val);
+   }
+
+   template<typename T>
+   requires std::floating_point<T>
+   static constexpr size_t Of(T) {
+      return sizeof(T) + 1;
+   }
+
+   template<typename T>
+   requires StringType<T>
+   static constexpr size_t Of(const T &val) {
+      size_t len = std::string_view(val).size();
+      return StrHeaderSize(len) + len;
+   }
+
+   template<typename T>
+   requires BinaryType<T>
+   static constexpr size_t Of(const T &bin) {
+      size_t len = std::span(bin).size();
+      return BinHeaderSize(len) + len;
+   }
+
+   template<typename T>
+   requires ExtensionType<T>
+   static constexpr size_t Of(const T &val) {
+      size_t len = Extension<T>::Size(val);
+      return ExtHeaderSize(len) + len;
+   }
+
+   /**
+    * @brief A typed array is padded depending on where it lands in the output, so this 
+    * is the most it can take rather than an exact size.
+    */
+   template<typename T>
+   static constexpr size_t Of(const TypedArray<T> &arr) {
+      return TYPED_ARRAY_PREFIX + alignof(T) - 1 + arr.elements.size_bytes();
+   }
+
+   template<typename T>
+   requires ArrayType<T>
+   static constexpr size_t Of(const T &arr) {
+      auto span = std::span(arr);
+      size_t size = ArrHeaderSize(span.size());
+      for (const auto &element : span) { size += Of(element); }
+      return size;
+   }
+
+   template<typename T>
+   requires RangeType<T>
+   static constexpr size_t Of(const T &range) {
+      size_t size = ArrHeaderSize(std::ranges::size(range));
+      for (const auto &element : range) { size += Of(element); }
+      return size;
+   }
+
+   template<typename T>
+   requires MapType<T>
+   static constexpr size_t Of(const T &map) {
+      size_t size = MapHeaderSize(std::ranges::size(map));
+      for (const auto &entry : map) { size += Of(entry.first) + Of(entry.second); }
+      return size;
+   }
+
+   template<typename T>
+   requires Described<T>
+   static constexpr size_t Of(const T &val) {
+      return StructLayout<T>::SEGMENT_BYTES.size() +
+             std::apply([](const auto &...field) { return (Of(field) + ...); },
+                        Describe<T>::Tie(val));
+   }
+
+   /**
+    * @brief Gets the largest number of bytes that any value of type T can encode to.
+    * 
+    * Only defined for types with a fixed shape: scalars, and fixed size arrays, 
+    * described structs, optionals and variants made of them.
+    */
+   template<typename T>
+   static constexpr size_t Max() {
+      if constexpr (IsType<T, bool> || NilType<T>) {
+         return 1;
+      } else if constexpr (OptionalType<T>) {
+         return Max<typename T::value_type>();
+      } else if constexpr (VariantType<T>) {
+         return []<size_t... I>(std::index_sequence<I...>) {
+            return std::max({Max<std::variant_alternative_t<I, T>>()...});
+         }(std::make_index_sequence<std::variant_size_v<T>>());
+      } else if constexpr (UnsignedInt<T> || SignedInt<T>) {
+         return sizeof(T) == 1 ? 2 : sizeof(T) + 1;
+      } else if constexpr (std::floating_point<T>) {
+         return sizeof(T) + 1;
+      } else if constexpr (BinaryType<T> && std::is_bounded_array_v<T>) {
+         return BinHeaderSize(std::extent_v<T>) + std::extent_v<T>;
+      } else if constexpr (BinaryType<T> && requires { std::tuple_size<T>::value; }) {
+         return BinHeaderSize(std::tuple_size_v<T>) + std::tuple_size_v<T>;
+      } else if constexpr (std::is_bounded_array_v<T>) {
+         constexpr size_t count = std::extent_v<T>;
+         return ArrHeaderSize(count) + count * Max<std::remove_cv_t<std::remove_extent_t<T>>>();
+      } else if constexpr (ArrayType<T> && requires { std::tuple_size<T>::value; }) {
+         constexpr size_t count = std::tuple_size_v<T>;
+         return ArrHeaderSize(count) + count * Max<typename T::value_type>();
+      } else if constexpr (Described<T>) {
+         using L = StructLayout<T>;
+         return L::SEGMENT_BYTES.size() + []<size_t... I>(std::index_sequence<I...>) {
+            return (Max<std::remove_cvref_t<std::tuple_element_t<I, typename L::Fields>>>() +
+                    ...);
+         }(std::make_index_sequence<L::COUNT>());
+      } else {
+         static_assert(sizeof(T) == 0, "Type has no fixed maximum packed size");
+      }
+   }
+};
+
+/**
+ * @brief Computes exactly how many bytes serializing values would produce, without 
+ * serializing them.
+ * 
+ * Formats are chosen in the same way as BasicPacker::Serialize. The result can be 
+ * computed at compile time for values that are known at compile time.
+ */
+template<typename... T>
+constexpr size_t PackedSize(const T &...values) {
+   return (PackedSizer::Of(values) + ... + 0);
+}
+
+/**
+ * @brief The most bytes any value of the fixed shape type T can serialize to, such as 
+ * an integer, std::array or a described struct of scalars.
+ */
+template<typename T>
+constexpr size_t MAX_PACKED_SIZE = PackedSizer::Max<T>();
+
+/*****************************************************************************************
+ **********************************   Instrumentation   **********************************
+ ****************************************************************************************/
+/**
+ * @brief The top-level calls that a Stats policy sees begin and end.
+ */
+enum class Operation : uint8_t { Serialize, Deserialize };
+
+/**
+ * A Stats policy is told what a BasicPacker or BasicUnpacker does as it works:
+ * 
+ * - Values(family, count, bytes): count values of family were encoded or decoded, 
+ *   taking bytes. Arrays, maps and structs count only their own headers, and strings, 
+ *   bins and extensions may report their headers and payloads separately, with a 
+ *   count of 0 for the payload. Values are counted as they are read, so one that fails 
+ *   partway through decoding still counts.
+ * - Allocation(): decoding grew a container's storage.
+ * - Flush(bytes): everything up to bytes was handed to the underlying output.
+ * - Error(err): Deserialize is about to throw the exception for err.
+ * - Begin(op) and End(op, failed): a top-level Serialize, Deserialize or 
+ *   TryDeserialize started and finished. failed is set if it threw or returned an error.
+ * 
+ * None of the hooks are called unless ENABLED is true, so NoStats costs nothing.
+ */
+// clang-format off
+template<class T>
+concept StatsPolicy = requires(T &stats, Family family, size_t len, Errc err, Operation op) {
+   { T::ENABLED } -> std::convertible_to<bool>;
+   { stats.Values(family, len, len) };
+   { stats.Allocation() };
+   { stats.Flush(len) };
+   { stats.Error(err) };
+   { stats.Begin(op) };
+   { stats.End(op, true) };
+};
+// clang-format on
+
+/**
+ * @brief The default Stats policy, which records nothing.
+ */
+struct NoStats {
+   static constexpr bool ENABLED = false;
+   void Values(Family, size_t, size_t) {}
+   void Allocation() {}
+   void Flush(size_t) {}
+   void Error(Errc) {}
+   void Begin(Operation) {}
+   void End(Operation, bool) {}
+};
+
+/**
+ * @brief A Stats policy that counts everything it is told. Derive from it and hide 
+ * Begin and End to add tracing, such as a Tracy zone or a perf marker per call.
+ */
+struct CountingStats {
+   static constexpr bool ENABLED = true;
+   static constexpr size_t FAMILIES = (size_t)Family::Invalid + 1;
+
+   std::array<uint64_t, FAMILIES> values {}; // Values of each Family, by index.
+   std::array<uint64_t, FAMILIES> bytes {};  // Bytes taken by values of each Family.
+   uint64_t allocations {0};
+   uint64_t flushed {0};
+   uint64_t errors {0};   // Exceptions thrown by Deserialize.
+   uint64_t calls {0};    // Top-level calls.
+   uint64_t failures {0}; // Top-level calls that threw or returned an error.
+
+   void Values(Family family, size_t count, size_t len) {
+      values[(size_t)family] += count;
+      bytes[(size_t)family] += len;
+   }
+
+   void Allocation() { allocations++; }
+   void Flush(size_t len) { flushed = len; }
+   void Error(Errc) { errors++; }
+   void Begin(Operation) {}
+
+   void End(Operation, bool failed) {
+      calls++;
+      failures += failed;
+   }
+};
+
+/**
+ * @brief Reports the span of a top-level call to a Stats policy, as Begin on 
+ * construction and End on destruction. A call that leaves by throwing is reported as 
+ * failed, as is one that Fail was called for.
+ */
+template<StatsPolicy St>
+class StatsScope {
+  public:
+   StatsScope(St &stats, Operation op) : mStats(stats), mOp(op) {
+      if constexpr (St::ENABLED) {
+         mExceptions = std::uncaught_exceptions();
+         mStats.Begin(mOp);
+      }
+   }
+
+   StatsScope(const StatsScope &) = delete;
+   StatsScope &operator=(const StatsScope &) = delete;
+
+   ~StatsScope() {
+      if constexpr (St::ENABLED) {
+         mStats.End(mOp, mFailed || std::uncaught_exceptions() > mExceptions);
+      }
+   }
+
+   /**
+    * @brief Marks the call as failed, when it returns an error instead of throwing.
+    */
+   void Fail() { mFailed = true; }
+
+  private:
+   St &mStats;
+   Operation mOp;
+   int mExceptions {0};
+   bool mFailed {false};
+};
+
+/*****************************************************************************************
+ ***************************************   Sinks   ***************************************
+ ****************************************************************************************/
+/**
+ * @brief A Sink that writes serialized data out to a std::ostream.
+ * 
+ * Bytes are gathered in an inline buffer of N bytes, and handed to the stream in one 
+ * write whenever it fills up, so the stream sees a few large writes instead of one 
+ * per value. Writes too large to fit in the buffer go straight to the stream. N may be 
+ * 0 to write everything straight through.
+ * 
+ * The buffer is written out on Flush, or else when the sink is destroyed. Errors at 
+ * that point can't be thrown, so they are only reflected in the stream's state.
+ * 
+ * @tparam N The size of the buffer, in bytes.
+ */
+template<size_t N = 4096>
+class BasicStreamSink {
+  public:
+   /**
+   * @brief Construct a new StreamSink, setting stream to the beginning of the buffer.
+   * 
+   * @param stream The byte stream to pack serialized data out to. Must have the 
+   * std::ios::binary and std::ios::out mode flags set.
+   */
+   BasicStreamSink(std::ostream &stream) : mRef(&stream) { mRef->seekp(std::ios::beg); }
+
+   /**
+   * @brief Construct a new StreamSink, setting the stream to a specified start 
+   * position.
+   * 
+   * Useful if you want to serialize data out to a specified position in a file.
+   * 
+   * @param stream The byte stream to pack serialized data out to. Must have the 
+   * std::ios::binary and std::ios::out mode flags set.
+   * @param start The start offset, in bytes, from the beginning of the stream.
+   */
+   BasicStreamSink(std::ostream &stream, size_t start) : mRef(&stream) { mRef->seekp(start); }
+
+   BasicStreamSink(const BasicStreamSink &) = delete;
+   BasicStreamSink &operator=(const BasicStreamSink &) = delete;
+
+   ~BasicStreamSink() {
+      if (mUsed > 0) { mRef->write((const char *)mBuf.data(), mUsed); }
+      if (mUsed > 0 || mUnflushed) { mRef->flush(); }
+   }
+
+   /**
+    * @brief Starts writing to another stream, from start. Anything written since the 
+    * last Flush is flushed out to the old stream first. Once flushed, the old stream 
+    * isn't touched again, even by the destructor, so it may be destroyed.
+    * 
+    * @throws std::runtime_error if there was a failure writing to the old stream.
+    */
+   void Reset(std::ostream &stream, size_t start = 0) {
+      if (mUsed > 0 || mUnflushed) { Flush(); }
+      mRef = &stream;
+      mRef->seekp(start);
+      mWritten = 0;
+   }
+
+   /**
+    * @brief Writes a block of bytes to the stream.
+    * 
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    */
+   void Write(const Byte *data, size_t len) {
+      if (len <= N - mUsed) {
+         std::memcpy(mBuf.data() + mUsed, data, len);
+         mUsed += len;
+         return;
+      }
+
+      Drain();
+      if (len < N) {
+         std::memcpy(mBuf.data(), data, len);
+         mUsed = len;
+      } else {
+         WriteStream(data, len);
+      }
+   }
+
+   void Reserve(size_t) {}
+
+   /**
+    * @brief Writes out any buffered bytes, and flushes the stream.
+    * 
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    */
+   void Flush() {
+      Drain();
+      mRef->flush();
+      mUnflushed = false;
+   }
+
+   size_t Count() { return mWritten + mUsed; }
+
+  private:
+   void Drain() {
+      if (mUsed > 0) {
+         // Cleared first, so that a failed write isn't retried from the destructor.
+         size_t used = mUsed;
+         mUsed = 0;
+         WriteStream(mBuf.data(), used);
+      }
+   }
+
+   void WriteStream(const Byte *data, size_t len) {
+      mRef->write((const char *)data, len);
+      if (mRef->fail()) {
+         mRef->clear();
+         Throw<std::runtime_error>("stream write error");
+      }
+      mWritten += len;
+      mUnflushed = true;
+   }
+
+   size_t mWritten {0};
+   size_t mUsed {0};
+   bool mUnflushed {false}; // Whether bytes went to the stream since the last Flush.
+   std::ostream *mRef;
+   std::array<Byte, N> mBuf;
+};
+
+using StreamSink = BasicStreamSink<>;
+
+/**
+ * @brief A Sink that appends serialized data to a growable ByteArray.
+ * 
+ * No stream state is involved, so each write is a plain append into the vector.
+ */
+class BufferSink {
+  public:
+   /**
+    * @brief Construct a new BufferSink, clearing the buffer so that serialized data 
+    * starts at its beginning. Existing capacity is kept.
+    * 
+    * @param buffer The buffer to pack serialized data out to.
+    */
+   BufferSink(ByteArray &buffer) : mBuf(&buffer) { mBuf->clear(); }
+
+   /**
+    * @brief Construct a new BufferSink, truncating the buffer to a specified start 
+    * position.
+    * 
+    * @param buffer The buffer to pack serialized data out to.
+    * @param start The start offset, in bytes, from the beginning of the buffer.
+    */
+   BufferSink(ByteArray &buffer, size_t start) : mBuf(&buffer), mStart(start) {
+      mBuf->resize(start);
+   }
+
+   /**
+    * @brief Starts appending to another buffer, resized to start as on construction.
+    */
+   void Reset(ByteArray &buffer, size_t start = 0) {
+      mBuf = &buffer;
+      mStart = start;
+      mBuf->resize(start);
+   }
+
+   void Write(const Byte *data, size_t len) {
+      if (len == 1) {
+         mBuf->push_back(*data);
+      } else {
+         mBuf->insert(mBuf->end(), data, data + len);
+      }
+   }
+
+   /**
+    * @brief Ensures at least len more bytes can be written without reallocating.
+    * 
+    * Capacity grows geometrically so repeated small reservations stay amortized.
+    */
+   void Reserve(size_t len) {
+      size_t required = mBuf->size() + len;
+      if (required > mBuf->capacity()) {
+         mBuf->reserve(std::max(required, mBuf->capacity() * 2));
+      }
+   }
+
+   void Flush() {}
+   size_t Count() const { return mBuf->size() - mStart; }
+
+  private:
+   ByteArray *mBuf;
+   size_t mStart {0};
+};
+
+/**
+ * @brief A Sink that writes serialized data into a fixed-size, caller-supplied buffer.
+ */
+class SpanSink {
+  public:
+   /**
+    * @brief Construct a new SpanSink that writes from the beginning of buffer.
+    * 
+    * @param buffer The memory to pack serialized data out to. It must outlive the sink.
+    */
+   SpanSink(std::span<Byte> buffer) : mBuf(buffer) {}
+
+   /**
+    * @brief Starts writing into another buffer, from its beginning.
+    */
+   void Reset(std::span<Byte> buffer) {
+      mBuf = buffer;
+      mPos = 0;
+   }
+
+   /**
+    * @brief Writes a block of bytes into the buffer.
+    * 
+    * @throws std::length_error if the buffer does not have room for len more bytes.
+    */
+   void Write(const Byte *data, size_t len) {
+      if (len > mBuf.size() - mPos) { Throw<std::length_error>("Output buffer too small"); }
+      std::memcpy(mBuf.data() + mPos, data, len);
+      mPos += len;
+   }
+
+   void Reserve(size_t) {}
+   void Flush() {}
+   size_t Count() const { return mPos; }
+
+   /**
+    * @brief Gets the portion of the buffer that has been written to so far.
+    */
+   std::span<Byte> Written() const { return mBuf.first(mPos); }
+
+  private:
+   std::span<Byte> mBuf;
+   size_t mPos {0};
+};
+
+/*****************************************************************************************
+ **************************************   Sources   **************************************
+ ****************************************************************************************/
+/**
+ * @brief A Source that reads serialized data in from a std::istream.
+ */
+class StreamSource {
+  public:
+   /**
+   * @brief Construct a new StreamSource, setting stream to the beginning of the buffer.
+   * 
+   * @param stream The byte stream to unpack serialized data from. Must have the 
+   * std::ios::binary and std::ios::in mode flags set.
+   */
+   StreamSource(std::istream &stream) : mRef(&stream) {
+      mRef->seekg(std::ios::beg);
+   }
+
+   /**
+   * @brief Construct a new StreamSource, setting the stream to a specified start 
+   * position.
+   * 
+   * Useful if you want to deserialize data not at the beginning of a file.
+   * 
+   * @param stream The byte stream to unpack serialized data from. Must have the 
+   * std::ios::binary and std::ios::in mode flags set.
+   * @param start The start offset, in bytes, from the beginning of the stream.
+   */
+   StreamSource(std::istream &stream, size_t start) : mRef(&stream) {
+      mRef->seekg(start);
+   }
+
+   /**
+    * @brief Starts reading from another stream, from start.
+    */
+   void Reset(std::istream &stream, size_t start = 0) {
+      mRef = &stream;
+      mRef->seekg(start);
+      mCount = 0;
+   }
+
+   /**
+    * @brief Gets the next byte without consuming it.
+    * 
+    * @return int The next byte, or EOF if the stream has no more data.
+    */
+   int Peek() { return mRef->rdbuf()->sgetc(); }
+
+   int Get() {
+      int byte = mRef->rdbuf()->sbumpc();
+      if (byte != EOF) { mCount++; }
+      return byte;
+   }
+
+   /**
+    * @brief Reads exactly len bytes from the stream.
+    * 
+    * Goes straight to the streambuf, which copies out of its buffer in one block when 
+    * the bytes are already there.
+    * 
+    * @return false, with nothing consumed, if the stream ran out of data first.
+    */
+   bool Read(Byte *out, size_t len) {
+      size_t count = mRef->rdbuf()->sgetn((char *)out, len);
+      mCount += count;
+      if (count != len) {
+         Rewind(count);
+         return false;
+      }
+      return true;
+   }
+
+   void Rewind(size_t len) {
+      mCount -= len;
+      for (; len > 0; len--) {
+         if (mRef->rdbuf()->sungetc() == EOF) {
+            mRef->rdbuf()->pubseekoff(-(std::streamoff)len, std::ios::cur, std::ios::in);
+            return;
+         }
+      }
+   }
+
+   /**
+    * @brief Gets the number of bytes consumed so far. This is tracked internally, 
+    * rather than asking the stream with tellg.
+    */
+   size_t Count() { return mCount; }
+
+  private:
+   size_t mCount {0};
+   std::istream *mRef;
+};
+
+/**
+ * @brief A Source that reads serialized data directly out of contiguous memory.
+ * 
+ * Reading only moves a cursor over the buffer, and strings can be borrowed from it 
+ * without copying.
+ */
+class SpanSource {
+  public:
+   /**
+    * @brief Construct a new SpanSource that reads from the beginning of buffer.
+    * 
+    * @param buffer The serialized data. It must outlive the source, as well as any 
+    * views borrowed from it.
+    */
+   SpanSource(std::span<const Byte> buffer) : mBuf(buffer) {}
+
+   /**
+    * @brief Starts reading from another buffer, from its beginning.
+    */
+   void Reset(std::span<const Byte> buffer) {
+      mBuf = buffer;
+      mPos = 0;
+   }
+
+   int Peek() const { return mPos < mBuf.size() ? mBuf[mPos] : EOF; }
+   int Get() { return mPos < mBuf.size() ? mBuf[mPos++] : EOF; }
+
+   bool Read(Byte *out, size_t len) {
+      const Byte *data = Borrow(len);
+      if (data == nullptr) { return false; }
+      std::memcpy(out, data, len);
+      return true;
+   }
+
+   /**
+    * @brief Consumes len bytes, returning a pointer to them inside the buffer.
+    * 
+    * @return nullptr, with nothing consumed, if the buffer has fewer than len bytes left.
+    */
+   const Byte *Borrow(size_t len) {
+      if (len > Remaining()) { return nullptr; }
+      const Byte *data = mBuf.data() + mPos;
+      mPos += len;
+      return data;
+   }
+
+   /**
+    * @brief Gets every byte that has not been consumed yet, without consuming it.
+    */
+   std::span<const Byte> Available() const { return mBuf.subspan(mPos); }
+
+   void Rewind(size_t len) { mPos -= std::min(len, mPos); }
+   size_t Count() const { return mPos; }
+   size_t Remaining() const { return mBuf.size() - mPos; }
+
+  private:
+   std::span<const Byte> mBuf;
+   size_t mPos {0};
+};
+
+/**
+ * @brief A Source that reads serialized data out of contiguous memory that has already 
+ * passed Validate.
+ * 
+ * Reads within a value are not checked against the end of the buffer, as validation 
+ * already showed that every value is complete. The unpacker's end of data branches then 
+ * fold away. The first byte of each value still is, so reading past the last value 
+ * returns Errc::EndOfData, as do lengths that are checked against the rest of the 
+ * buffer, such as array counts. Using it on data that hasn't been validated is undefined 
+ * behaviour.
+ */
+class TrustedSource {
+  public:
+   /**
+    * @brief Construct a new TrustedSource that reads from the beginning of buffer.
+    * 
+    * @param buffer The serialized data, for which Validate must have returned Errc::Ok. 
+    * It must outlive the source, as well as any views borrowed from it.
+    */
+   TrustedSource(std::span<const Byte> buffer) : mBuf(buffer) {}
+
+   /**
+    * @brief Starts reading from another validated buffer, from its beginning.
+    */
+   void Reset(std::span<const Byte> buffer) {
+      mBuf = buffer;
+      mPos = 0;
+   }
+
+   int Peek() const { return mPos < mBuf.size() ? mBuf[mPos] : EOF; }
+   int Get() { return mPos < mBuf.size() ? mBuf[mPos++] : EOF; }
+
+   bool Read(Byte *out, size_t len) {
+      std::memcpy(out, mBuf.data() + mPos, len);
+      mPos += len;
+      return true;
+   }
+
+   const Byte *Borrow(size_t len) {
+      const Byte *data = mBuf.data() + mPos;
+      mPos += len;
+      return data;
+   }
+
+   std::span<const Byte> Available() const { return mBuf.subspan(mPos); }
+
+   void Rewind(size_t len) { mPos -= len; }
+   size_t Count() const { return mPos; }
+
+  private:
+   std::span<const Byte> mBuf;
+   size_t mPos {0};
+};
+
+/*****************************************************************************************
+ **************************************   Classes   **************************************
+ ****************************************************************************************/
+/**
+ * @brief Serializes values into msgpack format, writing the result out to a Sink.
+ * 
+ * Most code will want one of the aliases: Packer (std::ostream), BufferPacker 
+ * (growable ByteArray) or SpanPacker (fixed std::span<Byte>).
+ * 
+ * @tparam S The Sink type that serialized bytes are written to.
+ * @tparam St The Stats policy to report what is serialized to. NoStats compiles away.
+ */
+template<Sink S, StatsPolicy St = NoStats>
+class BasicPacker {
+  public:
+   /**
+   * @brief Construct a new Packer object, forwarding the arguments to the Sink.
+   * 
+   * See the constructors of StreamSink, BufferSink and SpanSink for the accepted 
+   * arguments.
+   */
+   template<typename... Args>
+   requires std::constructible_from<S, Args &&...>
+   BasicPacker(Args &&...args) : mSink(std::forward<Args>(args)...) {}
+
+   /**
+    * @brief Gets a count of the number of bytes that have been successfully serialized 
+    * so far. This never has to query the underlying stream.
+    * 
+    * Note that just because bytes have been serialized, does not mean they have 
+    * successfully been written. Serialized data is only guarunteed to be written out 
+    * on a call to Flush, or the destructor.
+    * 
+    * @return size_t The number of bytes successfully serialized so far.
+    */
+   size_t ByteCount() { return mSink.Count(); }
+
+   /**
+    * @brief Writes out everything serialized so far, and flushes the underlying 
+    * stream.
+    * 
+    * This happens anyway when the Packer is destroyed, but only Flush can report a 
+    * failure to write.
+    * 
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    */
+   void Flush() {
+      mSink.Flush();
+      if constexpr (St::ENABLED) { mStats.Flush(mSink.Count()); }
+   }
+
+   /**
+    * @brief Serializes any number of values to the bytestream.
+    * 
+    * Each call is one top-level operation for the Stats policy, which sees it begin 
+    * and end.
+    * 
+    * @tparam T The types of the values to serialize.
+    * @param values The values to serialize.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    * @throws std::length_error or std::invalid_argument if a value is too large to 
+    * encode. See the Encode overload for each type.
+    */
+   template<typename... T>
+   void Serialize(const T &...values) {
+      StatsScope scope(mStats, Operation::Serialize);
+      (Encode(values), ...);
+   }
+
+   /**
+    * @brief Serialize just the header of an array. It must be followed by exactly 
+    * count calls to Serialize, one for each element.
+    * 
+    * @param count The number of elements in the array.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    * @throws std::invalid_argument if count is more than UINT32_MAX.
+    */
+   void SerializeArrayHeader(size_t count) {
+      std::array<Byte, 5> header;
+      size_t headerLen = 1;
+
+      if (count <= FIXARR_MAX) {
+         header[0] = FIXARR_MASK | count;
+      } else if (count <= UINT16_MAX) {
+         header[0] = Formats::ARR16;
+         StoreBigEndian(&header[1], (uint16_t)count);
+         headerLen = 3;
+      } else if (count <= UINT32_MAX) {
+         header[0] = Formats::ARR32;
+         StoreBigEndian(&header[1], (uint32_t)count);
+         headerLen = 5;
+      } else {
+         Throw<std::invalid_argument>("Array exceeds max allowable size");
+      }
+
+      // Every element takes at least one byte, so reserve that much up front.
+      mSink.Reserve(headerLen + count);
+      mSink.Write(header.data(), headerLen);
+      Count(header[0], 1, headerLen);
+   }
+
+   /**
+    * @brief Writes bytes that are already encoded, such as values serialized earlier 
+    * into another buffer, as they are. They are not checked, so must hold complete 
+    * values.
+    * 
+    * @param encoded The encoded bytes to write.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    */
+   void SerializeRaw(std::span<const Byte> encoded) {
+      mSink.Write(encoded.data(), encoded.size());
+   }
+
+   /**
+    * @brief Serialize count key-value pairs as a map, starting at first.
+    * 
+    * Useful when the number of entries is already known, as the range never has to 
+    * be walked to count them.
+    * 
+    * @param first An iterator to the first pair to serialize.
+    * @param count The number of pairs to serialize.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    * @throws std::invalid_argument if count is more than UINT32_MAX.
+    */
+   template<std::input_iterator It>
+   void SerializeMap(It first, size_t count) {
+      SerializeMapHeader(count);
+      for (size_t i = 0; i < count; i++, ++first) {
+         const auto &entry = *first;
+         Encode(entry.first);
+         Encode(entry.second);
+      }
+   }
+
+   /**
+    * @brief Serialize just the header of a map. It must be followed by exactly 
+    * count pairs of calls to Serialize, the key and then the value of each entry.
+    * 
+    * @param count The number of entries in the map.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    * @throws std::invalid_argument if count is more than UINT32_MAX.
+    */
+   void SerializeMapHeader(size_t count) {
+      std::array<Byte, 5> header;
+      size_t headerLen = 1;
+
+      if (count <= FIXMAP_MAX) {
+         header[0] = FIXMAP_MASK | count;
+      } else if (count <= UINT16_MAX) {
+         header[0] = Formats::MAP16;
+         StoreBigEndian(&header[1], (uint16_t)count);
+         headerLen = 3;
+      } else if (count <= UINT32_MAX) {
+         header[0] = Formats::MAP32;
+         StoreBigEndian(&header[1], (uint32_t)count);
+         headerLen = 5;
+      } else {
+         Throw<std::invalid_argument>("Map exceeds max allowable size");
+      }
+
+      // Every entry takes at least two bytes, so reserve that much up front.
+      mSink.Reserve(headerLen + count * 2);
+      mSink.Write(header.data(), headerLen);
+      Count(header[0], 1, headerLen);
+   }
+
+   /**
+    * @brief Rebinds the packer to a new output, forwarding the arguments to the Sink's 
+    * Reset, which takes the same arguments as its constructor. Anything the sink still 
+    * has buffered is written out to the old output first.
+    * 
+    * This lets one packer be reused for message after message, rather than building a 
+    * new one each time. The Stats policy keeps counting across resets.
+    * 
+    * @throws std::runtime_error if there was a failure writing to the old stream.
+    */
+   template<typename... Args>
+   requires requires(S &sink, Args &&...args) { sink.Reset(std::forward<Args>(args)...); }
+   void Reset(Args &&...args) {
+      mSink.Reset(std::forward<Args>(args)...);
+   }
+
+   /**
+    * @brief Interns repeated strings through table, which must outlive its use, or 
+    * stops interning if it is null. See StringTable.
+    * 
+    * The table is kept across Reset, for when the new output continues the same 
+    * stream. SerializeParallel writes strings out in full.
+    */
+   void InternStrings(StringTable *table) { mStrings = table; }
+
+   /**
+    * @brief Gets the Stats policy, with whatever it has recorded so far.
+    */
+   St &Stats() { return mStats; }
+
+  private:
+   /**
+    * @brief Serialize a single boolean value to the bytestream.
+    * 
+    * @param val The value to serialize
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    */
+   template<typename T>
+   requires IsType<T, bool>
+   void Encode(T val) {
+      Byte data = val ? Formats::BTRUE : Formats::BFALSE;
+      mSink.Write(&data, 1);
+      Count(data, 1, 1);
+   }
+
+   /**
+    * @brief Serialize nil, from a nullptr or a std::monostate.
+    * 
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    */
+   template<typename T>
+   requires NilType<T>
+   void Encode(T) {
+      Byte data = Formats::NIL;
+      mSink.Write(&data, 1);
+      Count(data, 1, 1);
+   }
+
+   /**
+    * @brief Serialize an optional value, as nil if it is empty.
+    * 
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    */
+   template<typename T>
+   void Encode(const std::optional<T> &val) {
+      if (val) {
+         Encode(*val);
+      } else {
+         Encode(nullptr);
+      }
+   }
+
+   /**
+    * @brief Serialize whichever alternative a variant holds, with no tag. Deserializing 
+    * works out which alternative it was from how it is encoded.
+    * 
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    * @throws std::bad_variant_access if the variant is valueless.
+    */
+   template<typename... T>
+   void Encode(const std::variant<T...> &val) {
+      std::visit([this](const auto &alternative) { Encode(alternative); }, val);
+   }
+
+   /**
+    * @brief Serialize a single unsigned integer to the bytestream
+    * 
+    * Can serialize 8, 16, 32, 64 bit unsigned integers into 1, 2, 3, 5, or 9 bytes of 
+    * serialized data.
+    * 
+    * @tparam T The unsigned integer width type to serialize
+    * @param val The value to serialize
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    */
+   template<typename T>
+   requires UnsignedInt<T>
+   void Encode(T val) {
+      std::array<Byte, MAX_NUMERIC_SIZE> data;
+      size_t len = EncodeUint(data.data(), val);
+      mSink.Write(data.data(), len);
+      Count(data[0], 1, len);
+   }
+
+   /**
+    * @brief Serialize a single signed integer to the bytestream.
+    * 
+    * Can serialize 8, 16, 32, 64 bit signed integers into 1, 2, 3, 5, or 9 bytes of 
+    * serialized data.
+    * 
+    * @tparam T The unsigned integer width type to serialize
+    * @param val The value to serialize
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    */
+   template<typename T>
+   requires SignedInt<T>
+   void Encode(T val) {
+      std::array<Byte, MAX_NUMERIC_SIZE> data;
+      size_t len = EncodeInt(data.data(), val);
+      mSink.Write(data.data(), len);
+      Count(data[0], 1, len);
+   }
+
+   /**
+    * @brief Serialize a single UTF-8 null-terminated string.
+    * 
+    * @tparam T The string type to serialize (fixed length char array, std::string)
+    * @param val The data to serialize.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    */
+   template<typename T>
+   requires StringType<T>
+   void Encode(const T &val) {
+      std::string_view view(val);
+      if (mStrings != nullptr && view.size() >= mStrings->MinLength() &&
+          EncodeInterned(view)) {
+         return;
+      }
+
+      std::array<Byte, 5> header;
+      size_t headerLen = 1;
+      if (view.length() > UINT32_MAX) {
+         Throw<std::length_error>("String exceeds max length");
+      } else if (view.length() <= FIXSTR_MAX) {
+         header[0] = FIXSTR_MASK | view.length();
+      } else if (view.length() <= UINT8_MAX) {
+         header[0] = Formats::STR8;
+         header[1] = view.length();
+         headerLen = 2;
+      } else if (view.length() <= UINT16_MAX) {
+         header[0] = Formats::STR16;
+         StoreBigEndian(&header[1], (uint16_t)view.length());
+         headerLen = 3;
+      } else {
+         header[0] = Formats::STR32;
+         StoreBigEndian(&header[1], (uint32_t)view.length());
+         headerLen = 5;
+      }
+
+      mSink.Reserve(headerLen + view.length());
+      mSink.Write(header.data(), headerLen);
+      WritePayload((const Byte *)view.data(), view.length());
+      Count(header[0], 1, headerLen + view.length());
+   }
+
+   /**
+    * @brief Serialize raw binary data as a bin, with a single bulk write.
+    * 
+    * @tparam T The contiguous byte container to serialize (ByteArray, std::array, 
+    * std::span<const std::byte>, etc).
+    * @param bin The data to serialize.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    * @throws std::length_error if there are more than UINT32_MAX bytes.
+    */
+   template<typename T>
+   requires BinaryType<T>
+   void Encode(const T &bin) {
+      auto bytes = std::as_bytes(std::span(bin));
+      std::array<Byte, 5> header;
+      size_t headerLen;
+      if (bytes.size() > UINT32_MAX) {
+         Throw<std::length_error>("Binary data exceeds max length");
+      } else if (bytes.size() <= UINT8_MAX) {
+         header[0] = Formats::BIN8;
+         header[1] = bytes.size();
+         headerLen = 2;
+      } else if (bytes.size() <= UINT16_MAX) {
+         header[0] = Formats::BIN16;
+         StoreBigEndian(&header[1], (uint16_t)bytes.size());
+         headerLen = 3;
+      } else {
+         header[0] = Formats::BIN32;
+         StoreBigEndian(&header[1], (uint32_t)bytes.size());
+         headerLen = 5;
+      }
+
+      mSink.Reserve(headerLen + bytes.size());
+      mSink.Write(header.data(), headerLen);
+      WritePayload((const Byte *)bytes.data(), bytes.size());
+      Count(header[0], 1, headerLen + bytes.size());
+   }
+
+   /**
+    * @brief Serialize a value of a type registered as an extension with a 
+    * specialization of Extension, such as a std::chrono::system_clock::time_point.
+    * 
+    * @param val The data to serialize.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    * @throws std::length_error if the payload is more than UINT32_MAX bytes.
+    */
+   template<typename T>
+   requires ExtensionType<T>
+   void Encode(const T &val) {
+      size_t len = Extension<T>::Size(val);
+      SerializeExtHeader(Extension<T>::TYPE, len);
+      Extension<T>::Encode(val,
+                           [this](const Byte *data, size_t n) { mSink.Write(data, n); });
+      Count(Formats::EXT8, 0, len);
+   }
+
+   /**
+    * @brief Serialize a numeric array as a typed array extension, copying its elements 
+    * out with a single write.
+    * 
+    * @param arr The data to serialize.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    * @throws std::length_error if the elements take more than UINT32_MAX bytes.
+    */
+   template<typename T>
+   void Encode(const TypedArray<T> &arr) {
+      size_t bytes = arr.elements.size_bytes();
+      size_t misalign = (mSink.Count() + TYPED_ARRAY_PREFIX) % alignof(T);
+      size_t pad = misalign == 0 ? 0 : alignof(T) - misalign;
+      size_t len = 2 + pad + bytes;
+      if (len > UINT32_MAX) {
+         Throw<std::length_error>("Typed array exceeds max length");
+      }
+
+      std::array<Byte, TYPED_ARRAY_PREFIX + alignof(T)> prefix {};
+      prefix[0] = Formats::EXT32;
+      StoreBigEndian(&prefix[1], (uint32_t)len);
+      prefix[5] = (Byte)TYPED_ARRAY_TYPE;
+      prefix[6] = TYPED_ARRAY_CODE<T>;
+      prefix[7] = pad;
+
+      mSink.Reserve(TYPED_ARRAY_PREFIX + len);
+      mSink.Write(prefix.data(), TYPED_ARRAY_PREFIX + pad);
+      mSink.Write((const Byte *)arr.elements.data(), bytes);
+      Count(prefix[0], 1, TYPED_ARRAY_PREFIX + len - 2);
+   }
+
+   /**
+    * @brief Serialize a double precision IEEE 754 floating value.
+    * 
+    * @param val The data to serialize.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    */
+   template<typename T>
+   requires IsType<T, double>
+   void Encode(T val) {
+      std::array<Byte, MAX_NUMERIC_SIZE> data;
+      size_t len = EncodeNumeric(data.data(), val);
+      mSink.Write(data.data(), len);
+      Count(data[0], 1, len);
+   }
+
+   /**
+    * @brief Serialize a single precision IEEE 754 floating value.
+    * 
+    * @param val The data to serialize.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    */
+   template<typename T>
+   requires IsType<T, float>
+   void Encode(T val) {
+      std::array<Byte, MAX_NUMERIC_SIZE> data;
+      size_t len = EncodeNumeric(data.data(), val);
+      mSink.Write(data.data(), len);
+      Count(data[0], 1, len);
+   }
+
+   /**
+    * @brief Serialize an array of values, such as a C array, std::array or std::vector.
+    * 
+    * The array, and each element of it, is serialized in place by reference.
+    * 
+    * @tparam T The array type to serialize.
+    * @param arr The data to serialize.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    * @throws std::invalid_argument if the array has more than UINT32_MAX elements.
+    */
+   template<typename T>
+   requires ArrayType<T>
+   void Encode(const T &arr) {
+      auto span = std::span(arr);
+      SerializeArrayHeader(span.size());
+
+      using Element = std::remove_cv_t<typename decltype(span)::element_type>;
+      if constexpr (NumericType<Element>) {
+         SerializeElements(std::span<const Element>(span));
+      } else {
+         for (const auto &element : span) { Encode(element); }
+      }
+   }
+
+   /**
+    * @brief Serialize any other sized range as an array, such as a std::deque, 
+    * std::list or a view.
+    * 
+    * @tparam T The range type to serialize.
+    * @param range The data to serialize.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    * @throws std::invalid_argument if the range has more than UINT32_MAX elements.
+    */
+   template<typename T>
+   requires RangeType<T>
+   void Encode(const T &range) {
+      SerializeArrayHeader(std::ranges::size(range));
+      for (const auto &element : range) { Encode(element); }
+   }
+
+   /**
+    * @brief Serialize a map, such as a std::map, std::unordered_map or a 
+    * std::vector of std::pair.
+    * 
+    * @tparam T The map type to serialize.
+    * @param map The data to serialize.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    * @throws std::invalid_argument if the map has more than UINT32_MAX entries.
+    */
+   template<typename T>
+   requires MapType<T>
+   void Encode(const T &map) {
+      SerializeMap(std::ranges::begin(map), std::ranges::size(map));
+   }
+
+   /**
+    * @brief Serialize a struct described with PACK_AS_ARRAY, PACK_AS_MAP or a 
+    * specialization of Describe.
+    * 
+    * The header and any map keys are encoded at compile time, so serializing a struct 
+    * just copies those in around the encoded field values.
+    * 
+    * @tparam T The described type to serialize.
+    * @param val The data to serialize.
+    * @throws std::runtime_error if there was a failure writing to the stream.
+    */
+   template<typename T>
+   requires Described<T>
+   void Encode(const T &val) {
+      using L = StructLayout<T>;
+      auto fields = Describe<T>::Tie(val);
+      mSink.Reserve(L::SEGMENT_BYTES.size() + L::COUNT);
+      if (L::IS_MAP && mStrings != nullptr) {
+         // The keys are interned like any other string.
+         mSink.Write(L::SEGMENT_BYTES.data(), L::HEADER_SIZE);
+         Count(L::SEGMENT_BYTES[0], 1, L::HEADER_SIZE);
+         [&]<size_t... I>(std::index_sequence<I...>) {
+            ((Encode(L::NAMES[I]), Encode(std::get<I>(fields))), ...);
+         }(std::make_index_sequence<L::COUNT>());
+         return;
+      }
+
+      Count(L::SEGMENT_BYTES[0], 1, L::SEGMENT_BYTES.size()); // The header and any keys
+      [&]<size_t... I>(std::index_sequence<I...>) {
+         (SerializeField<L, I>(std::get<I>(fields)), ...);
+      }(std::make_index_sequence<L::COUNT>());
+   }
+
+   /**
+    * @brief Writes the constant segment for field I of a described struct, followed by 
+    * the field itself.
+    */
+   template<typename L, size_t I, typename F>
+   void SerializeField(const F &field) {
+      constexpr size_t len = L::OFFSETS[I + 1] - L::OFFSETS[I];
+      if constexpr (len > 0) { mSink.Write(L::SEGMENT_BYTES.data() + L::OFFSETS[I], len); }
+      Encode(field);
+   }
+
+   /**
+    * @brief Writes a string through the attached StringTable: as a reference if it has 
+    * been defined, or else as a definition, if the table has room.
+    * 
+    * @return false, having written nothing, if it needs writing out in full instead.
+    */
+   bool EncodeInterned(std::string_view view) {
+      size_t index = mStrings->Find(view);
+      if (index != SIZE_MAX) {
+         std::array<Byte, 4> payload;
+         size_t len = index <= UINT8_MAX ? 1 : index <= UINT16_MAX ? 2 : 4;
+         if (len == 1) {
+            payload[0] = index;
+         } else if (len == 2) {
+            StoreBigEndian(payload.data(), (uint16_t)index);
+         } else {
+            StoreBigEndian(payload.data(), (uint32_t)index);
+         }
+         SerializeExtHeader(STRING_REFERENCE_TYPE, len);
+         mSink.Write(payload.data(), len);
+         Count(Formats::EXT8, 0, len);
+         return true;
+      }
+
+      if (view.size() > UINT32_MAX || !mStrings->Add(view)) { return false; }
+      SerializeExtHeader(STRING_DEFINITION_TYPE, view.size());
+      WritePayload((const Byte *)view.data(), view.size());
+      Count(Formats::EXT8, 0, view.size());
+      return true;
+   }
+
+   /**
+    * @brief Serializes the header of an extension value, which must be followed by 
+    * exactly len bytes of payload. Payloads of 1, 2, 4, 8 and 16 bytes get a fixext 
+    * header.
+    */
+   void SerializeExtHeader(int8_t type, size_t len) {
+      std::array<Byte, 6> header;
+      size_t headerLen = ExtHeaderSize(len);
+      switch (len) {
+         case 1: header[0] = Formats::FIXEXT1; break;
+         case 2: header[0] = Formats::FIXEXT2; break;
+         case 4: header[0] = Formats::FIXEXT4; break;
+         case 8: header[0] = Formats::FIXEXT8; break;
+         case 16: header[0] = Formats::FIXEXT16; break;
+         default: {
+            if (len <= UINT8_MAX) {
+               header[0] = Formats::EXT8;
+               header[1] = len;
+            } else if (len <= UINT16_MAX) {
+               header[0] = Formats::EXT16;
+               StoreBigEndian(&header[1], (uint16_t)len);
+            } else if (len <= UINT32_MAX) {
+               header[0] = Formats::EXT32;
+               StoreBigEndian(&header[1], (uint32_t)len);
+            } else {
+               Throw<std::length_error>("Extension exceeds max length");
+            }
+         }
+      }
+      header[headerLen - 1] = (Byte)type;
+
+      mSink.Reserve(headerLen + len);
+      mSink.Write(header.data(), headerLen);
+      Count(header[0], 1, headerLen);
+   }
+
+   /**
+    * @brief Tells the Stats policy about count values of the format fmt, taking len 
+    * bytes.
+    */
+   void Count(Byte fmt, size_t count, size_t len) {
+      if constexpr (St::ENABLED) { mStats.Values(FORMAT_TABLE[fmt].family, count, len); }
+   }
+
+   /**
+    * @brief Writes the payload of a string or bin, by reference if the sink is able to.
+    */
+   void WritePayload(const Byte *data, size_t len) {
+      if constexpr (ReferencingSink<S>) {
+         mSink.WriteReference(data, len);
+      } else {
+         mSink.Write(data, len);
+      }
+   }
+
+   /**
+    * @brief Serializes the elements of a numeric array in bulk.
+    * 
+    * Elements are encoded BULK_CHUNK at a time into a staging buffer, which is then 
+    * handed to the sink in a single write.
+    */
+   template<typename T>
+   requires NumericType<T>
+   void SerializeElements(std::span<const T> elements) {
+      std::array<Byte, BULK_CHUNK * MAX_NUMERIC_SIZE> staging;
+
+      for (size_t i = 0; i < elements.size(); i += BULK_CHUNK) {
+         size_t count = std::min(BULK_CHUNK, elements.size() - i);
+         size_t len = 0;
+         if constexpr (IsType<T, float> || IsType<T, double>) {
+            constexpr Byte fmt = sizeof(T) == 4 ? Formats::FLOAT32 : Formats::FLOAT64;
+            kernels::EncodeRecords<sizeof(T)>((const Byte *)&elements[i], fmt,
+                                              staging.data(), count);
+            len = count * (sizeof(T) + 1);
+            Count(fmt, count, len);
+         } else {
+            for (size_t j = 0; j < count; j++) {
+               size_t used = EncodeNumeric(staging.data() + len, elements[i + j]);
+               Count(staging[len], 1, used);
+               len += used;
+            }
+         }
+         mSink.Write(staging.data(), len);
+      }
+   }
+
+   S mSink;
+   StringTable *mStrings {nullptr};
+   [[no_unique_address]] St mStats;
+};
+
+using Packer = BasicPacker<StreamSink>;
+using BufferPacker = BasicPacker<BufferSink>;
+using SpanPacker = BasicPacker<SpanSink>;
+
+/**
+ * @brief Deserializes msgpack formatted values, reading them in from a Source.
+ * 
+ * Most code will want one of the aliases: Unpacker (std::istream) or SpanUnpacker 
+ * (contiguous std::span<const Byte>).
+ * 
+ * @tparam Src The Source type that serialized bytes are read from.
+ * @tparam St The Stats policy to report what is deserialized to. NoStats compiles away.
+ */
+template<Source Src, StatsPolicy St = NoStats>
+class BasicUnpacker {
+  public:
+   /**
+   * @brief Construct a new Unpacker object, forwarding the arguments to the Source.
+   * 
+   * See the constructors of StreamSource and SpanSource for the accepted arguments.
+   */
+   template<typename... Args>
+   requires std::constructible_from<Src, Args &&...>
+   BasicUnpacker(Args &&...args) : mSrc(std::forward<Args>(args)...) {}
+
+   /**
+    * @brief Gets a count of the number of bytes of serialized data that have been 
+    * successfully read in so far.
+    * 
+    * Note that the number of bytes deserialized is not the same as the number of bytes 
+    * actually returned by Deserialize.
+    * 
+    * @return size_t The number of bytes successfully deserialized so far.
+    */
+   size_t ByteCount() { return mSrc.Count(); }
+
+   /**
+    * @brief Sets whether deserialized strings are checked to be valid UTF-8, which is 
+    * off by default. Where a string is copied, it is checked in the same pass.
+    * 
+    * Deserialize throws std::runtime_error, and TryDeserialize returns 
+    * Errc::InvalidUtf8, for strings that aren't valid UTF-8.
+    */
+   void ValidateUtf8(bool enable) { mValidateUtf8 = enable; }
+
+   /**
+    * @brief Decodes interned strings through cache, which must outlive its use, or 
+    * stops if it is null. See StringCache.
+    * 
+    * Definitions are kept even from values that are skipped, and forgotten again from 
+    * values that fail to decode and are put back. Interned strings can't be decoded 
+    * into a std::variant.
+    */
+   void InternStrings(StringCache *cache) { mStrings = cache; }
+
+   /**
+    * @brief Rebinds the unpacker to a new input, forwarding the arguments to the 
+    * Source's Reset, which takes the same arguments as its constructor.
+    * 
+    * The ValidateUtf8 setting, the scratch buffer for extensions read from streams, and 
+    * the Stats policy are all kept, so a reused unpacker stops allocating once it has 
+    * warmed up.
+    */
+   template<typename... Args>
+   requires requires(Src &src, Args &&...args) { src.Reset(std::forward<Args>(args)...); }
+   void Reset(Args &&...args) {
+      mSrc.Reset(std::forward<Args>(args)...);
+   }
+
+   /**
+    * @brief Gets the Stats policy, with whatever it has recorded so far.
+    */
+   St &Stats() { return mStats; }
+
+   /**
+    * @brief Deserializes a variable number of values.
+    * 
+    * @throws std::invalid_argument if there are no more bytes to read in the stream.
+    * @throws std::runtime_error If a given type does not match its corresponding format 
+    * specifier.
     * @throws std::length_error If deserializing the data into T would result in a 
+    * narrowing conversion (eg, Deserialized data is UINT64 but T is uint32_t), or there 
+    * are more elements than a fixed size output can hold.
+    * @tparam T The types to deserialize.
+    * @param values The values to be filled with the deserialized data.
+    */
+   template<typename... T>
+   requires(sizeof...(T) > 0)
+   void Deserialize(T &...values) {
+      StatsScope scope(mStats, Operation::Deserialize);
+      (Check(Rollback([&] { return Decode(values); })), ...);
+   }
+
+
+   /**
+    * @brief Deserializes an array into the first outputLen elements of out.
+    * 
+    * @throws std::length_error if the array has more than outputLen elements.
+    */
+   template<typename T>
+   requires ArrayType<T>
+   void Deserialize(T &out, size_t outputLen) {
+      StatsScope scope(mStats, Operation::Deserialize);
+      Check(Rollback([&] { return Decode(out, outputLen); }));
+   }
+
+   /**
+    * @brief Deserializes the header of a map. It must be followed by exactly count 
+    * pairs of calls to Deserialize, the key and then the value of each entry.
+    * 
+    * @param count The number of entries in the map.
+    * @throws std::invalid_argument If there are no more bytes in the stream.
+    * @throws std::runtime_error if the bytestream data does not encode a map.
+    */
+   void DeserializeMapHeader(size_t &count) { Check(TryDeserializeMapHeader(count)); }
+
+   /**
+    * @brief Deserializes the header of an array. It must be followed by exactly count 
+    * calls to Deserialize, one for each element.
+    * 
+    * @param count The number of elements in the array.
+    * @throws std::invalid_argument If there are no more bytes in the stream.
+    * @throws std::runtime_error if the bytestream data does not encode an array.
+    */
+   void DeserializeArrayHeader(size_t &count) { Check(TryDeserializeArrayHeader(count)); }
+
+   /**
+    * @brief Deserializes a variable number of values, reporting failure as an error 
+    * code instead of an exception.
+    * 
+    * This goes through the same decoding as Deserialize, so is cheap enough to probe 
+    * for a value that may or may not be there. On failure the source is left exactly 
+    * where it was before the call, although values may have been partially written.
+    * 
+    * @return Errc Errc::Ok if every value was deserialized, otherwise the reason the 
+    * first one that couldn't be failed.
+    */
+   template<typename... T>
+   requires(sizeof...(T) > 0)
+   Errc TryDeserialize(T &...values) {
+      StatsScope scope(mStats, Operation::Deserialize);
+      Errc err = Rollback([&] {
+         if constexpr (sizeof...(T) == 1) {
+            return Decode(values...);
+         } else {
+            size_t start = mSrc.Count();
+            Errc err = Errc::Ok;
+            (((err = Decode(values)) == Errc::Ok) && ...);
+            return err == Errc::Ok ? err : Unwind(start, err);
+         }
+      });
+      if (err != Errc::Ok) { scope.Fail(); }
+      return err;
+   }
+
+   /**
+    * @brief Deserializes an array into the first outputLen elements of out, reporting 
+    * failure as an error code.
+    * 
+    * @return Errc Errc::OutputTooSmall if the array has more than outputLen elements.
+    */
+   template<typename T>
+   requires ArrayType<T>
+   Errc TryDeserialize(T &out, size_t outputLen) {
+      StatsScope scope(mStats, Operation::Deserialize);
+      Errc err = Rollback([&] { return Decode(out, outputLen); });
+      if (err != Errc::Ok) { scope.Fail(); }
+      return err;
+   }
+
+   /**
+    * @brief Deserializes the header of a map, reporting failure as an error code.
+    */
+   Errc TryDeserializeMapHeader(size_t &count) {
+      LengthHeader header;
+      if (Errc err = ReadMapHeader(header); err != Errc::Ok) { return err; }
+      count = header.len;
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Deserializes the header of an array, reporting failure as an error code.
+    */
+   Errc TryDeserializeArrayHeader(size_t &count) {
+      LengthHeader header;
+      if (Errc err = ReadArrHeader(header); err != Errc::Ok) { return err; }
+      count = header.len;
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Skips over the next value, whatever its type, without decoding it.
+    * 
+    * @throws std::invalid_argument If the source ends before the value does.
+    * @throws std::runtime_error if the value is malformed.
+    */
+   void Skip() { Check(TrySkip()); }
+
+   /**
+    * @brief Skips over the next value, reporting failure as an error code. Nothing is 
+    * consumed on failure.
+    */
+   Errc TrySkip() {
+      if constexpr (ContiguousSource<Src>) {
+         if (mStrings == nullptr) {
+            ScanState state;
+            Errc err = ScanValues(mSrc.Available(), state);
+            if (err == Errc::Ok) { mSrc.Borrow(state.pos); }
+            return err;
+         }
+      }
+
+      // Streams can't be scanned ahead, and definitions of interned strings have to be 
+      // kept, so headers and payloads are read as they go.
+      return Rollback([&] {
+         size_t start = mSrc.Count();
+         std::array<Byte, BULK_CHUNK> scratch;
+         for (size_t pending = 1; pending > 0; pending--) {
+            Byte fmt;
+            if (Errc err = ReadFormat(fmt); err != Errc::Ok) { return Unwind(start, err); }
+            FormatInfo info = FORMAT_TABLE[fmt];
+            if (info.family == Family::Invalid) { return Unwind(start, Errc::TypeMismatch); }
+
+            scratch[0] = fmt;
+            if (!mSrc.Read(scratch.data() + 1, info.header - 1)) {
+               return Unwind(start, Errc::EndOfData);
+            }
+            size_t count = ReadFormatCount(scratch.data(), info);
+            pending += count * info.elements;
+
+            if (info.family == Family::Ext && mStrings != nullptr &&
+                (int8_t)scratch[info.header - 1] == STRING_DEFINITION_TYPE) {
+               std::string_view str;
+               Errc err = ReadDefinition({count, info.header}, mSrc.Count() - info.header, str);
+               if (err != Errc::Ok) { return Unwind(start, err); }
+               continue;
+            }
+            for (size_t left = info.elements == 0 ? count : 0; left > 0;) {
+               size_t chunk = std::min(left, scratch.size());
+               if (!mSrc.Read(scratch.data(), chunk)) { return Unwind(start, Errc::EndOfData); }
+               left -= chunk;
+            }
+         }
+         return Errc::Ok;
+      });
+   }
+
+  private:
+   // Every Decode overload leaves the source where it found it if it fails.
+
+   /**
+    * @brief Deserializes a single boolean value.
+    * 
+    * @param out The value to be filled with the deserialized data.
+    * @return Errc::EndOfData if the bytestream contains no more data.
+    * @return Errc::TypeMismatch if the bytestream data does not encode a boolean.
+    */
+   template<typename T>
+   requires IsType<T, bool>
+   Errc Decode(T &out) {
+      Byte fmt;
+      FormatInfo info;
+      if (Errc err = ReadFormat(Family::Bool, fmt, info); err != Errc::Ok) { return err; }
+      out = fmt == Formats::BTRUE;
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Deserializes nil.
+    * 
+    * @return Errc::EndOfData if the bytestream contains no more data.
+    * @return Errc::TypeMismatch if the bytestream data does not encode nil.
+    */
+   template<typename T>
+   requires NilType<T>
+   Errc Decode(T &) {
+      Byte fmt;
+      FormatInfo info;
+      return ReadFormat(Family::Nil, fmt, info);
+   }
+
+   /**
+    * @brief Deserializes nil into an empty optional, or anything else into its value. 
+    * A value that is already there is decoded into in place, reusing its buffers.
+    * 
+    * @return Errc::EndOfData if the bytestream contains no more data.
+    * @return Any error from deserializing the value.
+    */
+   template<typename T>
+   Errc Decode(std::optional<T> &out) {
+      int next = mSrc.Peek();
+      if (next == EOF) { return Errc::EndOfData; }
+      if (next == Formats::NIL) {
+         mSrc.Get();
+         out.reset();
+         return Errc::Ok;
+      }
+      if (!out) { out.emplace(); }
+      return Decode(*out);
+   }
+
+   /**
+    * @brief Deserializes a variant, into the first alternative that can hold a value 
+    * encoded the way the next one is. 
+    * 
+    * The alternative is picked with a lookup on the first byte, in a table built at 
+    * compile time, so alternatives are not tried one after another. Alternatives must 
+    * be default constructible. If the variant already holds the chosen alternative, it 
+    * is decoded into in place.
+    * 
+    * @return Errc::EndOfData if the bytestream contains no more data.
+    * @return Errc::TypeMismatch if no alternative can hold the value.
+    * @return Any error from deserializing the chosen alternative, such as 
+    * Errc::Narrowing if it is an integer type too narrow for the value.
+    */
+   template<typename... T>
+   Errc Decode(std::variant<T...> &out) {
+      using V = std::variant<T...>;
+      int next = mSrc.Peek();
+      if (next == EOF) { return Errc::EndOfData; }
+      size_t index = ALTERNATIVES<V>[next];
+      if (index == sizeof...(T)) { return Errc::TypeMismatch; }
+      return (this->*ALTERNATIVE_DECODERS<V>[index])(out);
+   }
+
+   /**
+    * @brief Deserializes a single unsigned integer value of width 8, 16, 32, 64 bits.
+    * 
+    * @tparam T The type of the out parameter. T must be able to accomodate the 
+    * deserialized value without narrowing conversions, else Errc::Narrowing is 
+    * returned.
+    * @param out The value to be filled with the deserialized data.
+    * @return Errc::EndOfData if the bytestream contains no more data.
+    * @return Errc::TypeMismatch if the bytestream data does not encode an unsigned int.
+    * @return Errc::Narrowing If deserializing the data into T would result in a 
+    * narrowing conversion.
+    */
+   template<typename T>
+   requires UnsignedInt<T>
+   Errc Decode(T &out) {
+      Byte fmtOrData;
+      FormatInfo info;
+      if (Errc err = ReadFormat(Family::Uint, fmtOrData, info); err != Errc::Ok) {
+         return err;
+      }
+
+      switch (info.count) {
+         case 0: {
+            // Positive fixint
+            out = fmtOrData;
+            return Errc::Ok;
+         }
+         case 1: return ReadMultiByteUint<uint8_t>(out);
+         case 2: return ReadMultiByteUint<uint16_t>(out);
+         case 4: return ReadMultiByteUint<uint32_t>(out);
+         default: return ReadMultiByteUint<uint64_t>(out);
+      }
+   }
+
+   /**
+    * @brief Deserializes a single signed integer value of width 8, 16, 32, 64 bits.
+    * 
+    * @tparam T The type of the out parameter. T must be able to accomodate the 
+    * deserialized value without narrowing conversions, else Errc::Narrowing is 
+    * returned.
+    * @param out The value to be filled with the deserialized data.
+    * @return Errc::EndOfData if the bytestream contains no more data.
+    * @return Errc::TypeMismatch if the bytestream data does not encode a signed int.
+    * @return Errc::Narrowing If deserializing the data into T would result in a 
     * narrowing conversion.
     */
    template<typename T>
-   requires UnsignedInt<T>
-   void Deserialize(T &out) {
-      if (mRef.peek() == EOF) {
-         mRef.clear();
-         throw std::invalid_argument("No more data to read");
-      }
-      // clear out param because it may have a larger width with extra data.
-      out = 0;
-
-      char fmtOrData = Formats::NIL;
-      fmtOrData = mRef.peek(); // Nondestructive peek so we can forward
-
-      switch ((Formats)fmtOrData) {
-         case UINT8: {
-            mRef.get(fmtOrData); // Pop the format specifier
-            char data = 0;
-            mRef.get(data);
-            out = (uint8_t)data;
-            break;
-         }
-         case UINT16: {
-            ReadMultiByteUint<uint16_t>(out);
-            break;
-         }
-         case UINT32: {
-            ReadMultiByteUint<uint32_t>(out);
-            break;
+   requires SignedInt<T>
+   Errc Decode(T &out) {
+      Byte fmtOrData;
+      FormatInfo info;
+      if (Errc err = ReadFormat(fmtOrData, info); err != Errc::Ok) { return err; }
+      bool fixint = info.family == Family::Uint && info.count == 0;
+      if (info.family != Family::Int && !fixint) {
+         mSrc.Rewind(1);
+         return Errc::TypeMismatch;
+      }
+      Count(info.family, 1, info.header + info.count);
+
+      switch (info.count) {
+         case 0: {
+            // Positive or negative fixint
+            out = (int8_t)fmtOrData;
+            return Errc::Ok;
+         }
+         case 1: return ReadMultiByteInt<int8_t>(out);
+         case 2: return ReadMultiByteInt<int16_t>(out);
+         case 4: return ReadMultiByteInt<int32_t>(out);
+         default: return ReadMultiByteInt<int64_t>(out);
+      }
+   }
+
+   /**
+    * @brief Deserializes a UTF-8 string into a fixed-size C-style character array.
+    * 
+    * The fixed length array must contain enough space for each deserialized UTF-8
+    * character as well as a null-terminator which is automatically appended by this 
+    * function.
+    * 
+    * @tparam N The number of bytes that the fixed length character array can hold.
+    * @return Errc::EndOfData If there are no more bytes in the stream.
+    * @return Errc::OutputTooSmall if the array is too small to hold each deserialized 
+    * byte plus a null terminator.
+    * @return Errc::TypeMismatch if the bytestream data does not encode a string.
+    */
+   template<size_t N>
+   Errc Decode(char (&str)[N]) {
+      if (PeekInterned()) {
+         size_t start = mSrc.Count();
+         std::string_view interned;
+         if (Errc err = DecodeInterned(interned); err != Errc::Ok) { return err; }
+         if (N < interned.size() + 1) { return Unwind(start, Errc::OutputTooSmall); }
+         std::memcpy(str, interned.data(), interned.size());
+         str[interned.size()] = '\0';
+         return Errc::Ok;
+      }
+
+      LengthHeader header;
+      if (Errc err = ReadStrHeader(header); err != Errc::Ok) { return err; }
+      if (N < header.len + 1) {
+         mSrc.Rewind(header.size);
+         return Errc::OutputTooSmall;
+      }
+
+      if (Errc err = ReadPayload((Byte *)str, header); err != Errc::Ok) { return err; }
+      str[header.len] = '\0';
+      return CheckUtf8((const Byte *)str, header.len, header.size + header.len);
+   }
+
+   /**
+    * @brief Deserializes a UTF-8 string into a std::string, or any other basic_string 
+    * of char. A std::pmr::string is filled from its own memory resource.
+    * 
+    * The string is sized once from the header, so it allocates at most once, or not at 
+    * all if it already has the capacity.
+    * 
+    * @return Errc::EndOfData If there are no more bytes in the stream.
+    * @return Errc::TypeMismatch if the bytestream data does not encode a string.
+    * @return Errc::InvalidUtf8 if validation is enabled and the string is not UTF-8.
+    */
+   template<typename T>
+   requires CharString<T>
+   Errc Decode(T &out) {
+      if (PeekInterned()) {
+         std::string_view interned;
+         if (Errc err = DecodeInterned(interned); err != Errc::Ok) { return err; }
+         Resize(out, interned.size());
+         std::memcpy(out.data(), interned.data(), interned.size());
+         return Errc::Ok;
+      }
+
+      size_t start = mSrc.Count();
+      LengthHeader header;
+      if (Errc err = ReadStrHeader(header); err != Errc::Ok) { return err; }
+      return ReadPayload(out, header, start, mValidateUtf8);
+   }
+
+   /**
+    * @brief Deserializes a bin into a contiguous container of bytes.
+    * 
+    * Resizable containers such as ByteArray are sized once to fit and filled with a 
+    * single read, in the same way as std::string. Fixed size ones such as std::array 
+    * must be large enough to hold the payload, and keep any bytes past its end.
+    * 
+    * @return Errc::EndOfData If there are no more bytes in the stream.
+    * @return Errc::TypeMismatch if the bytestream data does not encode a bin.
+    * @return Errc::OutputTooSmall if a fixed size container is too small for the payload.
+    */
+   template<typename T>
+   requires BinaryType<T>
+   Errc Decode(T &out) {
+      size_t start = mSrc.Count();
+      LengthHeader header;
+      if (Errc err = ReadBinHeader(header); err != Errc::Ok) { return err; }
+
+      if constexpr (requires { out.resize(header.len); }) {
+         return ReadPayload(out, header, start, false);
+      } else {
+         auto bytes = std::as_writable_bytes(std::span(out));
+         if (header.len > bytes.size()) {
+            mSrc.Rewind(header.size);
+            return Errc::OutputTooSmall;
+         }
+         return ReadPayload((Byte *)bytes.data(), header);
+      }
+   }
+
+   /**
+    * @brief Deserializes a IEEE 754 floating point value.
+    * 
+    * @tparam T The type (float, double) of the out parameter to deserialize into.
+    * @param out The location to place the deserialized data.
+    * @return Errc::EndOfData If there are no more bytes in the stream.
+    * @return Errc::TypeMismatch if the bytestream data does not encode a float.
+    * @return Errc::Narrowing If deserializing the data into T would result in 
+    * loss of precision.
+    */
+   template<typename T>
+   requires std::floating_point<T>
+   Errc Decode(T &out) {
+      Byte fmt;
+      FormatInfo info;
+      if (Errc err = ReadFormat(Family::Float, fmt, info); err != Errc::Ok) { return err; }
+
+      if (info.count == 4) {
+         if (std::numeric_limits<T>::max() < std::numeric_limits<float>::max()) {
+            mSrc.Rewind(1);
+            return Errc::Narrowing;
+         }
+         uint32_t bits;
+         if (Errc err = ReadBigEndian(bits); err != Errc::Ok) { return err; }
+         out = std::bit_cast<float>(bits);
+      } else {
+         if (std::numeric_limits<T>::max() < std::numeric_limits<double>::max()) {
+            mSrc.Rewind(1);
+            return Errc::Narrowing;
+         }
+         uint64_t bits;
+         if (Errc err = ReadBigEndian(bits); err != Errc::Ok) { return err; }
+         out = std::bit_cast<double>(bits);
+      }
+      return Errc::Ok;
+   }
+
+   template<typename T, size_t N>
+   requires(not IsType<T, char const> && not ByteLike<T>)
+   Errc Decode(T (&arr)[N]) {
+      return Decode(arr, N);
+   }
+
+   template<typename T>
+   requires ArrayType<T>
+   Errc Decode(T &out) {
+      size_t len = std::span(out).size();
+      return Decode(out, len);
+   }
+
+   template<typename T>
+   requires ArrayType<T>
+   Errc Decode(T &out, size_t outputLen) {
+      size_t start = mSrc.Count();
+      LengthHeader header;
+      if (Errc err = ReadArrHeader(header); err != Errc::Ok) { return err; }
+      if (header.len > outputLen) {
+         mSrc.Rewind(header.size);
+         return Errc::OutputTooSmall;
+      }
+
+      using Element = std::remove_reference_t<decltype(out[0])>;
+      if constexpr (NumericType<Element>) {
+         Errc err = DecodeElements(std::span(out).data(), header.len);
+         if (err != Errc::Ok) { return Unwind(start, err); }
+      } else {
+         for (size_t i = 0; i < header.len; i++) {
+            if (Errc err = Decode(out[i]); err != Errc::Ok) { return Unwind(start, err); }
          }
-         case UINT64: {
-            ReadMultiByteUint<uint64_t>(out);
-            break;
+      }
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Deserializes an array into a std::vector, resizing it to fit.
+    * 
+    * The vector is sized once from the array header. Elements that already exist are 
+    * decoded into in place, so decoding the same shape of message again reuses their 
+    * buffers instead of allocating new ones. As every element takes at least one byte, 
+    * a header claiming more elements than a contiguous source has bytes left is 
+    * rejected before anything is allocated. Streams can't be measured up front, so 
+    * for them the vector grows in bounded steps as elements actually arrive.
+    * 
+    * New elements are constructed with the vector's allocator, so a std::pmr::vector 
+    * and any std::pmr strings or containers inside it all come from one memory resource.
+    * 
+    * Vectors of numbers also accept a TypedArray of the same element type, which is 
+    * copied in with a single read.
+    * 
+    * @return Errc::EndOfData If there are no more bytes in the stream.
+    * @return Errc::TypeMismatch if the bytestream data does not encode an array.
+    */
+   template<typename T, typename A>
+   requires(not PairType<T> && not ByteLike<T>)
+   Errc Decode(std::vector<T, A> &out) {
+      if constexpr (NumericType<T>) {
+         int next = mSrc.Peek();
+         if (next != EOF && FORMAT_TABLE[next].family == Family::Ext) {
+            return DecodeTypedArray(out);
          }
-         default: {
-            if ((fmtOrData & POS_FIXINT_MASK) == 0) {
-               // Positive fixint
-               mRef.get(fmtOrData); // Pop out the stored val
-               out = (uint8_t)fmtOrData;
-               break;
-            } else {
-               throw std::runtime_error("ByteArray does not match type uint");
+      }
+
+      size_t start = mSrc.Count();
+      LengthHeader header;
+      size_t initial;
+      if (Errc err = ReadArrHeader(header); err != Errc::Ok) { return err; }
+      if (Errc err = InitialSize<T>(header, 1, initial); err != Errc::Ok) { return err; }
+
+      Resize(out, initial);
+      for (size_t i = 0; i < header.len;) {
+         if (i == out.size()) { Resize(out, std::min(header.len, out.size() * 2)); }
+
+         if constexpr (NumericType<T>) {
+            Errc err = DecodeElements(out.data() + i, out.size() - i);
+            if (err != Errc::Ok) { return Unwind(start, err); }
+         } else {
+            for (size_t j = i; j < out.size(); j++) {
+               if (Errc err = Decode(out[j]); err != Errc::Ok) { return Unwind(start, err); }
             }
          }
+         i = out.size();
       }
+      return Errc::Ok;
    }
 
    /**
-    * @brief Deserializes a single signed integer value of width 8, 16, 32, 64 bits.
+    * @brief Deserializes a map into a node based container, such as a std::map or 
+    * std::unordered_map. Any existing entries are removed first.
     * 
-    * @tparam T The type of the out parameter. T must be able to accomodate the 
-    * deserialized value without narrowing conversions, else std::length_error is 
-    * generated.
-    * @param out The value to be filled with the deserialized data.
-    * @throws std::invalid_argument if the bytestream contains no more data.
-    * @throws std::runtime_error if the bytestream data does not encode a signed int.
-    * @throws std::length_error If deserializing the data into T would result in a 
-    * narrowing conversion.
+    * @return Errc::EndOfData If there are no more bytes in the stream.
+    * @return Errc::TypeMismatch if the bytestream data does not encode a map, or a key 
+    * or value does not match its type.
     */
    template<typename T>
-   requires SignedInt<T>
-   void Deserialize(T &out) {
-      if (mRef.peek() == EOF) {
-         mRef.clear();
-         throw std::invalid_argument("No more data to read");
-      }
-      // clear out param because it may have a larger width with extra data.
-      out = 0;
-
-      char fmtOrData = Formats::NIL;
-      fmtOrData = mRef.peek(); // Nondestructive peek so we can forward
-      switch ((Formats)fmtOrData) {
-         case INT8: {
-            mRef.get(fmtOrData); // Pop the format specifier
-            char data = 0;
-            mRef.get(data);
-            out = (int8_t)data;
-            break;
+   requires MapType<T> && (not FlatMapType<T>)
+   Errc Decode(T &out) {
+      size_t start = mSrc.Count();
+      LengthHeader header;
+      size_t initial;
+      if (Errc err = ReadMapHeader(header); err != Errc::Ok) { return err; }
+      if (Errc err = InitialSize<typename T::value_type>(header, 2, initial);
+          err != Errc::Ok) {
+         return err;
+      }
+
+      out.clear();
+      if constexpr (requires { out.reserve(initial); }) { out.reserve(initial); }
+      for (size_t i = 0; i < header.len; i++) {
+         auto key = MakeElement<typename T::key_type>(out);
+         auto value = MakeElement<typename T::mapped_type>(out);
+         Errc err = Decode(key);
+         if (err == Errc::Ok) { err = Decode(value); }
+         if (err != Errc::Ok) { return Unwind(start, err); }
+         out.emplace_hint(out.end(), std::move(key), std::move(value));
+         if constexpr (St::ENABLED) { mStats.Allocation(); } // One node per entry
+      }
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Deserializes a map into a flat map: a vector of key-value pairs, sorted 
+    * by key.
+    * 
+    * The vector is sized once from the map header and every pair is decoded into in 
+    * place, so there is no allocation per entry and existing keys and values reuse their 
+    * buffers. Entries from an encoder that wrote them in order, such as any std::map, 
+    * are filled in a single pass. Otherwise they are sorted once at the end.
+    * 
+    * @return Errc::EndOfData If there are no more bytes in the stream.
+    * @return Errc::TypeMismatch if the bytestream data does not encode a map, or a key 
+    * or value does not match its type.
+    */
+   template<typename T>
+   requires FlatMapType<T>
+   Errc Decode(T &out) {
+      size_t start = mSrc.Count();
+      LengthHeader header;
+      size_t initial;
+      if (Errc err = ReadMapHeader(header); err != Errc::Ok) { return err; }
+      if (Errc err = InitialSize<typename T::value_type>(header, 2, initial);
+          err != Errc::Ok) {
+         return err;
+      }
+
+      bool sorted = true;
+      Resize(out, initial);
+      for (size_t i = 0; i < header.len; i++) {
+         if (i == out.size()) { Resize(out, std::min(header.len, out.size() * 2)); }
+         Errc err = Decode(out[i].first);
+         if (err == Errc::Ok) { err = Decode(out[i].second); }
+         if (err != Errc::Ok) { return Unwind(start, err); }
+         if (i > 0 && out[i].first < out[i - 1].first) { sorted = false; }
+      }
+
+      if (!sorted) {
+         std::ranges::sort(out, [](const auto &a, const auto &b) { return a.first < b.first; });
+      }
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Deserializes a struct described with PACK_AS_ARRAY, PACK_AS_MAP or a 
+    * specialization of Describe.
+    * 
+    * Map keys may come in any order, but are checked against the declared order first. 
+    * Entries with keys that don't name a field are skipped, and fields without an 
+    * entry are left as they were, so that fields can be added and removed over time.
+    * 
+    * @return Errc::EndOfData If there are no more bytes in the stream.
+    * @return Errc::TypeMismatch if the bytestream data does not have the same layout 
+    * as T, or a field does not match its type.
+    */
+   template<typename T>
+   requires Described<T>
+   Errc Decode(T &out) {
+      using L = StructLayout<T>;
+      auto fields = Describe<T>::Tie(out);
+
+      size_t start = mSrc.Count();
+      LengthHeader header;
+      Errc err = L::IS_MAP ? ReadMapHeader(header) : ReadArrHeader(header);
+      if (err != Errc::Ok) { return err; }
+      if (!L::IS_MAP && header.len != L::COUNT) {
+         mSrc.Rewind(header.size);
+         return Errc::TypeMismatch;
+      }
+
+      if constexpr (L::IS_MAP) {
+         for (size_t i = 0; i < header.len && err == Errc::Ok; i++) {
+            size_t index;
+            err = ReadFieldKey<L>(std::min(i, L::COUNT - 1), index);
+            if (err != Errc::Ok) { break; }
+            if (index == L::COUNT) {
+               err = TrySkip();
+               continue;
+            }
+            [&]<size_t... I>(std::index_sequence<I...>) {
+               ((index == I ? (void)(err = Decode(std::get<I>(fields))) : void()), ...);
+            }(std::make_index_sequence<L::COUNT>());
          }
-         case INT16: {
-            ReadMultiByteInt<int16_t>(out);
-            break;
+      } else {
+         std::apply([&](auto &...field) { (void)(((err = Decode(field)) == Errc::Ok) && ...); },
+                    fields);
+      }
+      return err == Errc::Ok ? err : Unwind(start, err);
+   }
+
+   /**
+    * @brief Deserializes a UTF-8 string without copying it.
+    * 
+    * The resulting view points directly into the source buffer, and is only valid for 
+    * as long as that buffer is, or for interned strings, into the StringCache. Only 
+    * available when unpacking from contiguous memory.
+    * 
+    * @return Errc::EndOfData If there are no more bytes in the buffer.
+    * @return Errc::TypeMismatch if the buffer data does not encode a string.
+    */
+   Errc Decode(std::string_view &out)
+   requires ContiguousSource<Src>
+   {
+      if (PeekInterned()) { return DecodeInterned(out); }
+
+      size_t start = mSrc.Count();
+      std::span<const Byte> bytes;
+      if (Errc err = BorrowStr(bytes); err != Errc::Ok) { return err; }
+      if (Errc err = CheckUtf8(bytes.data(), bytes.size(), mSrc.Count() - start);
+          err != Errc::Ok) {
+         return err;
+      }
+      out = std::string_view((const char *)bytes.data(), bytes.size());
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Deserializes a value of a type registered as an extension with a 
+    * specialization of Extension.
+    * 
+    * @return Errc::EndOfData If there are no more bytes in the stream.
+    * @return Errc::TypeMismatch if the bytestream data does not encode an extension of 
+    * the registered type, or whatever error the extension's Decode returns.
+    */
+   template<typename T>
+   requires ExtensionType<T>
+   Errc Decode(T &out) {
+      size_t start = mSrc.Count();
+      LengthHeader header;
+      int8_t type;
+      if (Errc err = ReadExtHeader(header, type); err != Errc::Ok) { return err; }
+      if (type != Extension<T>::TYPE) {
+         mSrc.Rewind(header.size);
+         return Errc::TypeMismatch;
+      }
+
+      std::span<const Byte> payload;
+      if constexpr (ContiguousSource<Src>) {
+         if (Errc err = BorrowPayload(header, payload); err != Errc::Ok) { return err; }
+      } else {
+         if (Errc err = ReadPayload(mScratch, header, start, false); err != Errc::Ok) {
+            return err;
          }
-         case INT32: {
-            ReadMultiByteInt<int32_t>(out);
-            break;
+         payload = mScratch;
+      }
+
+      if (Errc err = Extension<T>::Decode(payload, out); err != Errc::Ok) {
+         return Unwind(start, err);
+      }
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Deserializes a TypedArray without copying it.
+    * 
+    * The resulting span points directly into the source buffer, and is only valid for 
+    * as long as that buffer is. Only available when unpacking from contiguous memory.
+    * 
+    * @return Errc::EndOfData If there are no more bytes in the buffer.
+    * @return Errc::TypeMismatch if the buffer data does not encode a typed array of T, 
+    * or was written with the other byte order.
+    * @return Errc::Misaligned if its elements are not aligned in memory, because the 
+    * buffer doesn't start at an alignment boundary, or the packer didn't start at its 
+    * beginning. See TypedArray.
+    * 
+    * In either of the last two cases, it can still be deserialized into a std::vector<T>.
+    */
+   template<typename T>
+   requires NumericType<T> && (not ByteLike<T>) && ContiguousSource<Src>
+   Errc Decode(std::span<const T> &out) {
+      size_t start = mSrc.Count();
+      LengthHeader header;
+      Byte code;
+      if (Errc err = ReadTypedArrayHeader<T>(header, code); err != Errc::Ok) {
+         return err;
+      }
+
+      std::span<const Byte> bytes;
+      if (Errc err = BorrowPayload(header, bytes); err != Errc::Ok) { return err; }
+      if (code != TYPED_ARRAY_CODE<T>) { return Unwind(start, Errc::TypeMismatch); }
+      if ((uintptr_t)bytes.data() % alignof(T) != 0) {
+         return Unwind(start, Errc::Misaligned);
+      }
+      out = {(const T *)bytes.data(), bytes.size() / sizeof(T)};
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Deserializes the raw bytes of a bin or string without copying them.
+    * 
+    * The resulting span points directly into the source buffer, and is only valid for 
+    * as long as that buffer is. Only available when unpacking from contiguous memory.
+    * 
+    * @return Errc::EndOfData If there are no more bytes in the buffer.
+    * @return Errc::TypeMismatch if the buffer data does not encode a bin or string.
+    */
+   template<typename B>
+   requires ByteLike<B> && ContiguousSource<Src>
+   Errc Decode(std::span<const B> &out) {
+      LengthHeader header;
+      Errc err = ReadBinHeader(header);
+      if (err == Errc::TypeMismatch) { err = ReadStrHeader(header); }
+      if (err != Errc::Ok) { return err; }
+
+      std::span<const Byte> bytes;
+      if (Errc err = BorrowPayload(header, bytes); err != Errc::Ok) { return err; }
+      out = {(const B *)bytes.data(), bytes.size()};
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Deserializes the elements of a numeric array in bulk.
+    * 
+    * Contiguous sources are decoded in place with one pass over the buffer. Streams 
+    * read float and double arrays BULK_CHUNK elements at a time, as each element has 
+    * a fixed width. Float and double arrays are converted with the vector kernels. 
+    * Anything the bulk pass can't handle, such as an element of the wrong type, is left 
+    * to the regular per-element path, which reports the error. Elements decoded before 
+    * the error are not put back.
+    */
+   template<typename T>
+   requires NumericType<T>
+   Errc DecodeElements(T *out, size_t count) {
+      size_t i = 0;
+
+      if constexpr (ContiguousSource<Src>) {
+         std::span<const Byte> avail = mSrc.Available();
+         size_t offset = 0;
+         if constexpr (IsType<T, float> || IsType<T, double>) {
+            constexpr Byte fmt = sizeof(T) == 4 ? Formats::FLOAT32 : Formats::FLOAT64;
+            size_t records = std::min(count, avail.size() / (sizeof(T) + 1));
+            i = kernels::DecodeRecords<sizeof(T)>(avail.data(), fmt, (Byte *)out, records);
+            offset = i * (sizeof(T) + 1);
+            Count(Family::Float, i, offset);
          }
-         case INT64: {
-            ReadMultiByteInt<int64_t>(out);
-            break;
+         for (; i < count; i++) {
+            size_t used = DecodeNumeric(avail.data() + offset, avail.size() - offset, out[i]);
+            if (used == 0) { break; }
+            Count(FORMAT_TABLE[avail[offset]].family, 1, used);
+            offset += used;
          }
-         default: {
-            if ((fmtOrData & NEG_FIXINT_MIN) == NEG_FIXINT_MIN) {
-               // Negative fixint
-               mRef.get(fmtOrData); // Pop out the stored val
-               out = (int8_t)fmtOrData;
-               break;
-            } else if ((fmtOrData & POS_FIXINT_MASK) == 0) {
-               mRef.get(fmtOrData);
-               out = (int8_t)fmtOrData;
+         mSrc.Borrow(offset);
+      } else if constexpr (IsType<T, float> || IsType<T, double>) {
+         constexpr Byte fmt = sizeof(T) == 4 ? Formats::FLOAT32 : Formats::FLOAT64;
+         constexpr size_t width = sizeof(T) + 1;
+         std::array<Byte, BULK_CHUNK * width> staging;
+
+         while (i < count) {
+            size_t chunk = std::min(BULK_CHUNK, count - i);
+            if (!mSrc.Read(staging.data(), chunk * width)) { break; }
+
+            size_t j = kernels::DecodeRecords<sizeof(T)>(staging.data(), fmt,
+                                                         (Byte *)(out + i), chunk);
+            i += j;
+            Count(Family::Float, j, j * width);
+
+            if (j < chunk) {
+               mSrc.Rewind((chunk - j) * width);
                break;
-            } else {
-               throw std::runtime_error("ByteArray does not match type int");
             }
          }
       }
+
+      for (; i < count; i++) {
+         if (Errc err = Decode(out[i]); err != Errc::Ok) { return err; }
+      }
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief The decoded header of a str, arr or map value.
+    */
+   struct LengthHeader {
+      size_t len;  // Number of payload bytes (str) or elements (arr, map).
+      size_t size; // Number of bytes the header itself occupied in the source.
+   };
+
+   /**
+    * @brief Whether deserializing into a T could accept a value whose first byte is 
+    * fmt, going by the format alone.
+    */
+   template<typename T>
+   static constexpr bool Accepts(Byte fmt) {
+      using enum Family;
+      FormatInfo info = FORMAT_TABLE[fmt];
+      Family family = info.family;
+      if constexpr (IsType<T, bool>) {
+         return family == Bool;
+      } else if constexpr (UnsignedInt<T>) {
+         return family == Uint;
+      } else if constexpr (SignedInt<T>) {
+         return family == Int || (family == Uint && info.count == 0);
+      } else if constexpr (std::floating_point<T>) {
+         return family == Float;
+      } else if constexpr (NilType<T>) {
+         return family == Nil;
+      } else if constexpr (OptionalType<T>) {
+         return family == Nil || Accepts<typename T::value_type>(fmt);
+      } else if constexpr (VariantType<T>) {
+         return ALTERNATIVES<T>[fmt] != std::variant_size_v<T>;
+      } else if constexpr (ExtensionType<T>) {
+         return family == Ext;
+      } else if constexpr (Described<T>) {
+         return family == (Describe<T>::layout == Layout::Map ? Map : Array);
+      } else if constexpr (IsType<T, std::span<const Byte>> ||
+                           IsType<T, std::span<const std::byte>>) {
+         return family == Bin || family == Str;
+      } else if constexpr (BinaryType<T>) {
+         return family == Bin;
+      } else if constexpr (StringType<T> || CharString<T>) {
+         return family == Str;
+      } else if constexpr (MapType<T>) {
+         return family == Map;
+      } else if constexpr (ConstSpanType<T>) {
+         return family == Ext; // Borrowed typed arrays
+      } else if constexpr (NumericVector<T>) {
+         return family == Array || family == Ext;
+      } else {
+         return family == Array;
+      }
+   }
+
+   /**
+    * @brief For every possible first byte, the index of the first alternative of the 
+    * variant V that can hold a value starting with it, or the number of alternatives if 
+    * none can.
+    */
+   template<typename V>
+   static constexpr std::array<uint8_t, 256> ALTERNATIVES = [] {
+      std::array<uint8_t, 256> table {};
+      for (size_t fmt = 0; fmt < table.size(); fmt++) {
+         table[fmt] = []<size_t... I>(Byte fmt, std::index_sequence<I...>) {
+            size_t index = sizeof...(I);
+            (void)((Accepts<std::variant_alternative_t<I, V>>(fmt) && (index = I, true)) ||
+                   ...);
+            return index;
+         }((Byte)fmt, std::make_index_sequence<std::variant_size_v<V>>());
+      }
+      return table;
+   }();
+
+   /**
+    * @brief Deserializes alternative I of a variant.
+    */
+   template<typename V, size_t I>
+   Errc DecodeAlternative(V &out) {
+      if (out.index() != I) { out.template emplace<I>(); }
+      return Decode(std::get<I>(out));
+   }
+
+   template<typename V>
+   static constexpr auto ALTERNATIVE_DECODERS = []<size_t... I>(std::index_sequence<I...>) {
+      return std::array {&BasicUnpacker::DecodeAlternative<V, I>...};
+   }(std::make_index_sequence<std::variant_size_v<V>>());
+
+   /**
+    * @brief Makes a temporary to decode an element of container into. It uses the 
+    * container's allocator where the element takes one, so that moving it into a 
+    * std::pmr container draws from the same memory resource instead of copying.
+    */
+   template<typename E, typename C>
+   static E MakeElement(const C &container) {
+      if constexpr (requires { container.get_allocator(); }) {
+         return std::make_obj_using_allocator<E>(container.get_allocator());
+      } else {
+         return E();
+      }
+   }
+
+   /**
+    * @brief Throws the exception corresponding to err, if it is an error.
+    */
+   void Check(Errc err) {
+      if (err != Errc::Ok) {
+         if constexpr (St::ENABLED) { mStats.Error(err); }
+         ThrowError(err);
+      }
+   }
+
+   /**
+    * @brief Tells the Stats policy about count values of family, taking len bytes.
+    */
+   void Count(Family family, size_t count, size_t len) {
+      if constexpr (St::ENABLED) { mStats.Values(family, count, len); }
+   }
+
+   /**
+    * @brief Runs decode, and if it fails, forgets any interned strings it defined, as 
+    * the source has been put back to before their definitions.
+    */
+   template<typename F>
+   Errc Rollback(F &&decode) {
+      size_t defined = mStrings != nullptr ? mStrings->Size() : 0;
+      Errc err = decode();
+      if (err != Errc::Ok && mStrings != nullptr) { mStrings->Truncate(defined); }
+      return err;
+   }
+
+   /**
+    * @brief Whether a StringCache is attached and the next value is an extension, so 
+    * may be an interned string.
+    */
+   bool PeekInterned() {
+      if (mStrings == nullptr) { return false; }
+      int next = mSrc.Peek();
+      return next != EOF && FORMAT_TABLE[next].family == Family::Ext;
+   }
+
+   /**
+    * @brief Deserializes an interned string, keeping it in the StringCache if it is a 
+    * definition.
+    * 
+    * @return Errc::EndOfData if the source ends before the value does.
+    * @return Errc::TypeMismatch if the value is neither a definition nor a reference 
+    * to a string that has been defined.
+    * @return Errc::OutputTooSmall if the cache is full.
+    */
+   Errc DecodeInterned(std::string_view &out) {
+      size_t start = mSrc.Count();
+      LengthHeader header;
+      int8_t type;
+      if (Errc err = ReadExtHeader(header, type); err != Errc::Ok) { return err; }
+      if (type == STRING_DEFINITION_TYPE) { return ReadDefinition(header, start, out); }
+      if (type != STRING_REFERENCE_TYPE ||
+          (header.len != 1 && header.len != 2 && header.len != 4)) {
+         return Unwind(start, Errc::TypeMismatch);
+      }
+
+      std::array<Byte, 4> payload;
+      if (!mSrc.Read(payload.data(), header.len)) { return Unwind(start, Errc::EndOfData); }
+      size_t index = header.len == 1   ? payload[0]
+                     : header.len == 2 ? LoadBigEndian<uint16_t>(payload.data())
+                                       : LoadBigEndian<uint32_t>(payload.data());
+      if (index >= mStrings->Size()) { return Unwind(start, Errc::TypeMismatch); }
+      out = mStrings->Find(index);
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Reads the payload of a string definition, whose header has already been 
+    * consumed, into the StringCache.
+    * 
+    * @param start Where the source was before the header.
+    * @param out Set to the string, in the cache.
+    * @return Errc::OutputTooSmall if the cache is full, or any error from ReadPayload. 
+    * Nothing is consumed in either case.
+    */
+   Errc ReadDefinition(LengthHeader header, size_t start, std::string_view &out) {
+      std::string str;
+      if (Errc err = ReadPayload(str, header, start, mValidateUtf8); err != Errc::Ok) {
+         return err;
+      }
+      if (!mStrings->Add(std::move(str))) { return Unwind(start, Errc::OutputTooSmall); }
+      out = mStrings->Find(mStrings->Size() - 1);
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Resizes a container being decoded into, telling the Stats policy if that 
+    * allocated.
+    */
+   template<typename T>
+   void Resize(T &out, size_t len) {
+      if constexpr (St::ENABLED && requires { out.capacity(); }) {
+         size_t capacity = out.capacity();
+         out.resize(len);
+         if (out.capacity() != capacity) { mStats.Allocation(); }
+      } else {
+         out.resize(len);
+      }
+   }
+
+   /**
+    * @brief Puts back everything consumed since the source was at start, and passes 
+    * err through.
+    */
+   Errc Unwind(size_t start, Errc err) {
+      mSrc.Rewind(mSrc.Count() - start);
+      return err;
+   }
+
+   /**
+    * @brief Consumes the next format specifier.
+    * 
+    * @return Errc::EndOfData if the source contains no more data.
+    */
+   Errc ReadFormat(Byte &out) {
+      int fmt = mSrc.Get();
+      if (fmt == EOF) { return Errc::EndOfData; }
+      out = fmt;
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Consumes the next format specifier, and looks up the layout of the value it 
+    * starts in FORMAT_TABLE.
+    * 
+    * @return Errc::EndOfData if the source contains no more data.
+    */
+   Errc ReadFormat(Byte &out, FormatInfo &info) {
+      if (Errc err = ReadFormat(out); err != Errc::Ok) { return err; }
+      info = FORMAT_TABLE[out];
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Consumes the format specifier of a value of the given family, and looks up 
+    * its layout.
+    * 
+    * @return Errc::EndOfData if the source contains no more data.
+    * @return Errc::TypeMismatch if the value belongs to some other family. Nothing is 
+    * consumed.
+    */
+   Errc ReadFormat(Family family, Byte &out, FormatInfo &info) {
+      if (Errc err = ReadFormat(out, info); err != Errc::Ok) { return err; }
+      if (info.family != family) {
+         mSrc.Rewind(1);
+         return Errc::TypeMismatch;
+      }
+      // Values with a length field are counted once it has been read.
+      if (info.lengthSize == 0) {
+         Count(family, 1, info.header + (info.elements ? 0 : info.count));
+      }
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Reads the big endian value that follows an already consumed format 
+    * specifier.
+    * 
+    * @return Errc::EndOfData if the source ends before the value does. The format 
+    * specifier is put back first, so nothing is consumed.
+    */
+   template<typename T>
+   Errc ReadBigEndian(T &out) {
+      T val;
+      if (!mSrc.Read((Byte *)&val, sizeof(T))) {
+         mSrc.Rewind(1);
+         return Errc::EndOfData;
+      }
+      out = FromBigEndian(val);
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Reads a big endian length field of type T into a header of the given size.
+    */
+   template<typename T>
+   Errc ReadLength(LengthHeader &out, size_t size) {
+      T len;
+      if (Errc err = ReadBigEndian(len); err != Errc::Ok) { return err; }
+      out = {len, size};
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Consumes the header of a str, arr or map value of the given family.
+    * 
+    * The length field is fetched with a single read, whatever its width.
+    * 
+    * @return Errc::EndOfData if the source ends inside the header.
+    * @return Errc::TypeMismatch if the data encodes a value of some other family. 
+    * Nothing is consumed in either case.
+    */
+   Errc ReadLengthHeader(Family family, LengthHeader &out) {
+      Byte fmt;
+      FormatInfo info;
+      if (Errc err = ReadFormat(family, fmt, info); err != Errc::Ok) { return err; }
+      Errc err = Errc::Ok;
+      switch (info.lengthSize) {
+         case 0: {
+            out = {info.count, 1};
+            return Errc::Ok;
+         }
+         case 1: err = ReadLength<uint8_t>(out, info.header); break;
+         case 2: err = ReadLength<uint16_t>(out, info.header); break;
+         default: err = ReadLength<uint32_t>(out, info.header); break;
+      }
+      if (err == Errc::Ok) { Count(family, 1, out.size + (info.elements ? 0 : out.len)); }
+      return err;
+   }
+
+   /**
+    * @brief Consumes the header of a string.
+    */
+   Errc ReadStrHeader(LengthHeader &out) { return ReadLengthHeader(Family::Str, out); }
+
+   /**
+    * @brief Consumes the header of a bin.
+    */
+   Errc ReadBinHeader(LengthHeader &out) { return ReadLengthHeader(Family::Bin, out); }
+
+   /**
+    * @brief Consumes the header of an array.
+    */
+   Errc ReadArrHeader(LengthHeader &out) { return ReadLengthHeader(Family::Array, out); }
+
+   /**
+    * @brief Consumes the header of a map.
+    */
+   Errc ReadMapHeader(LengthHeader &out) { return ReadLengthHeader(Family::Map, out); }
+
+   /**
+    * @brief Consumes the header of an extension, including its type.
+    * 
+    * @return Errc::EndOfData if the source ends inside the header.
+    * @return Errc::TypeMismatch if the data does not encode an extension. Nothing is 
+    * consumed in either case.
+    */
+   Errc ReadExtHeader(LengthHeader &out, int8_t &type) {
+      std::array<Byte, 6> header;
+      FormatInfo info;
+      if (Errc err = ReadFormat(Family::Ext, header[0], info); err != Errc::Ok) {
+         return err;
+      }
+      if (!mSrc.Read(header.data() + 1, info.header - 1)) {
+         mSrc.Rewind(1);
+         return Errc::EndOfData;
+      }
+      out = {ReadFormatCount(header.data(), info), info.header};
+      type = (int8_t)header[info.header - 1];
+      if (info.lengthSize > 0) { Count(Family::Ext, 1, out.size + out.len); }
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Consumes everything before the elements of a typed array of T: the header, 
+    * the element code and the padding. 
+    * 
+    * @param out Set to the number of bytes of elements, and everything consumed.
+    * @param code Set to the element code, with the byte order bit set to match the 
+    * machine if the elements need swapping.
+    * @return Errc::EndOfData if the source ends before the elements start.
+    * @return Errc::TypeMismatch if the data does not encode a typed array of T. Nothing 
+    * is consumed in either case.
+    */
+   template<typename T>
+   Errc ReadTypedArrayHeader(LengthHeader &out, Byte &code) {
+      size_t start = mSrc.Count();
+      LengthHeader header;
+      int8_t type;
+      if (Errc err = ReadExtHeader(header, type); err != Errc::Ok) { return err; }
+      std::array<Byte, 2 + UINT8_MAX> prefix;
+      if (type != TYPED_ARRAY_TYPE || header.len < 2) {
+         return Unwind(start, Errc::TypeMismatch);
+      } else if (!mSrc.Read(prefix.data(), 2)) {
+         return Unwind(start, Errc::EndOfData);
+      }
+
+      code = prefix[0];
+      size_t pad = prefix[1];
+      if ((code & 0x7f) != (TYPED_ARRAY_CODE<T> & 0x7f) || header.len - 2 < pad ||
+          (header.len - 2 - pad) % sizeof(T) != 0) {
+         return Unwind(start, Errc::TypeMismatch);
+      } else if (!mSrc.Read(prefix.data() + 2, pad)) {
+         return Unwind(start, Errc::EndOfData);
+      }
+      out = {header.len - 2 - pad, mSrc.Count() - start};
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Deserializes a typed array into a vector, with one read of its elements, 
+    * swapping their byte order afterwards if they were written on a machine of the 
+    * other endianness.
+    */
+   template<typename T, typename A>
+   Errc DecodeTypedArray(std::vector<T, A> &out) {
+      size_t start = mSrc.Count();
+      LengthHeader header;
+      Byte code;
+      if (Errc err = ReadTypedArrayHeader<T>(header, code); err != Errc::Ok) {
+         return err;
+      }
+      if (Errc err = ReadPayload(out, header, start, false); err != Errc::Ok) {
+         return err;
+      }
+
+      if constexpr (sizeof(T) > 1) {
+         if (code != TYPED_ARRAY_CODE<T>) {
+            Byte *data = (Byte *)out.data();
+            kernels::Swap<sizeof(T)>(data, data, out.size());
+         }
+      }
+      return Errc::Ok;
    }
 
    /**
-    * @brief Deserializes a UTF-8 string into a fixed-size C-style character array.
-    * 
-    * The fixed length array must contain enough space for each deserialized UTF-8
-    * character as well as a null-terminator which is automatically appended by this 
-    * function.
+    * @brief Reads the key of a described struct field, and looks up which field it is.
     * 
-    * @tparam N The number of bytes that the fixed length character array can hold.
-    * @throws std::invalid_argument If there are no more bytes in the stream.
-    * @throws std::length_error if the array is too small to hold each deserialized 
-    * byte plus a null terminator.
-    * @throws std::runtime_error if the bytestream data does not encode a string.
+    * @tparam L The StructLayout of the struct.
+    * @param expected The field that comes next in declaration order, which is tried first.
+    * @param index Set to the index of the field, or L::COUNT if it doesn't name one.
+    * @return Errc::TypeMismatch if the key is not a string.
     */
-   template<size_t N>
-   void Deserialize(char (&str)[N]) {
-      if (mRef.peek() == EOF) {
-         mRef.clear();
-         throw std::invalid_argument("No more data to read");
-      }
-
-      char fmt = Formats::NIL;
-      mRef.get(fmt);
-      switch ((Formats)fmt) {
-         case STR8: {
-            uint8_t len = 0;
-            mRef.get((char &)len);
-            if (N < len + 1) {
-               mRef.unget();
-               throw std::length_error("Char array too small");
-            }
-            mRef.read(str, len);
-            str[len] = '\0';
-            break;
-         }
-         case STR16: {
-            uint16_t len = 0;
-            mRef.read((char *)&len, 2);
-            len = ToLittleEndian(len);
-            if (N < len + 1) {
-               mRef.unget();
-               throw std::length_error("Char array too small");
-            }
-            mRef.read(str, len);
-            str[len] = '\0';
-            break;
-         }
-         case STR32: {
-            uint32_t len = 0;
-            mRef.read((char *)&len, 4);
-            len = ToLittleEndian(len);
-            if (N < len + 1) {
-               mRef.unget();
-               throw std::length_error("Char array too small");
-            }
-            mRef.read(str, len);
-            str[len] = '\0';
-            break;
+   template<typename L>
+   Errc ReadFieldKey(size_t expected, size_t &index) {
+      std::string_view key;
+      std::array<char, L::MAX_NAME> scratch;
+      LengthHeader header;
+      if (PeekInterned()) {
+         if (Errc err = DecodeInterned(key); err != Errc::Ok) { return err; }
+      } else if (Errc err = ReadStrHeader(header); err != Errc::Ok) {
+         return err;
+      } else if constexpr (ContiguousSource<Src>) {
+         std::span<const Byte> bytes;
+         if (Errc err = BorrowPayload(header, bytes); err != Errc::Ok) { return err; }
+         key = std::string_view((const char *)bytes.data(), bytes.size());
+      } else if (header.len <= L::MAX_NAME) {
+         if (Errc err = ReadPayload((Byte *)scratch.data(), header); err != Errc::Ok) {
+            return err;
          }
-         default: {
-            if ((fmt & FIXSTR_MASK) == FIXSTR_MASK) {
-               uint8_t len = fmt & FIXSTR_MAX;
-               if (N < len + 1) {
-                  mRef.unget();
-                  throw std::length_error("Char array too small");
-               }
-               mRef.read(str, len);
-               str[len] = '\0';
-               break;
-            } else {
-               throw std::runtime_error("ByteArray does not match type String");
-            }
+         key = std::string_view(scratch.data(), header.len);
+      } else {
+         // Longer than any field name, so it can't be one.
+         mSrc.Rewind(header.size);
+         index = L::COUNT;
+         return TrySkip();
+      }
+
+      index = L::COUNT;
+      if (key == L::NAMES[expected]) {
+         index = expected;
+      } else {
+         for (size_t i = 0; i < L::COUNT; i++) {
+            if (key == L::NAMES[i]) { index = i; }
          }
       }
+      return Errc::Ok;
    }
 
    /**
-    * @brief Deserializes a UTF-8 string.
+    * @brief Works out how many elements of type T to allocate up front for the 
+    * container described by an already consumed header.
     * 
-    * @throws std::invalid_argument If there are no more bytes in the stream.
-    * @throws std::runtime_error if the bytestream data does not encode a string.
+    * @param minSize The fewest bytes that a single element can be encoded in.
+    * @param out Set to the number of elements to allocate.
+    * @return Errc::EndOfData if a contiguous source has too few bytes left to possibly 
+    * hold every element. The header is put back first.
     */
    template<typename T>
-   requires IsType<T, std::string>
-   void Deserialize(T &out) {
-      if (mRef.peek() == EOF) {
-         mRef.clear();
-         throw std::invalid_argument("No more data to read");
+   Errc InitialSize(LengthHeader header, size_t minSize, size_t &out) {
+      if constexpr (ContiguousSource<Src>) {
+         if (header.len > mSrc.Available().size() / minSize) {
+            mSrc.Rewind(header.size);
+            return Errc::EndOfData;
+         }
+         out = header.len;
+      } else {
+         out = std::min(header.len, std::max<size_t>(MAX_UNTRUSTED_RESERVE / sizeof(T), 1));
       }
+      return Errc::Ok;
+   }
 
-      char fmt = Formats::NIL;
-      fmt = mRef.get();
-      switch ((Formats)fmt) {
-         case STR8: {
-            mRef.get(fmt);
-            uint8_t len = (uint8_t)fmt;
-            out.resize((uint8_t)len);
-            mRef.read(out.data(), len);
-            out.append(1, '\0');
-            break;
-         }
-         case STR16: {
-            uint16_t len = 0;
-            mRef.read((char *)&len, 2);
-            len = ToLittleEndian(len);
-            out.resize(len);
-            mRef.read(out.data(), len);
-            out.append(1, '\0');
-            break;
-         }
-         case STR32: {
-            uint32_t len = 0;
-            mRef.read((char *)&len, 4);
-            len = ToLittleEndian(len);
-            out.resize(len);
-            mRef.read(out.data(), len);
-            out.append(1, '\0');
-            break;
-         }
-         default: {
-            if ((fmt & FIXSTR_MASK) == FIXSTR_MASK) {
-               uint8_t len = fmt & FIXSTR_MAX;
-               out.resize(len);
-               mRef.read(out.data(), len);
-               out.append(1, '\0');
-               break;
-            } else {
-               throw std::runtime_error("ByteArray does not match type String");
-            }
-         }
+   /**
+    * @brief Reads the payload that follows an already consumed str or bin header.
+    * 
+    * @return Errc::EndOfData if the source ends before the payload does. The header 
+    * is put back first, so nothing is consumed.
+    */
+   Errc ReadPayload(Byte *out, LengthHeader header) {
+      if (!mSrc.Read(out, header.len)) {
+         mSrc.Rewind(header.size);
+         return Errc::EndOfData;
       }
+      return Errc::Ok;
    }
 
    /**
-    * @brief Deserializes a IEEE 754 floating point value.
+    * @brief Reads the payload that follows an already consumed str or bin header into 
+    * a resizable container of bytes, such as a std::string or ByteArray.
     * 
-    * @tparam T The type (float, double) of the out parameter to deserialize into.
-    * @param out The location to place the deserialized data.
-    * @throws std::invalid_argument If there are no more bytes in the stream.
-    * @throws std::runtime_error if the bytestream data does not encode a string.
-    * @throws std::length_error If deserializing the data into T would result in 
-    * loss of precision.
+    * The container is sized once from the header, so it allocates at most once, or not 
+    * at all if it already has the capacity. From a contiguous source, the payload is 
+    * checked to be all there before anything is allocated. Streams can't be measured up 
+    * front, so for them a payload longer than MAX_UNTRUSTED_RESERVE grows the container 
+    * in bounded steps as it actually arrives.
+    * 
+    * @param start Where the source was before the header.
+    * @param utf8 Whether to check that the payload is UTF-8, while copying it.
+    * @return Errc::EndOfData if the source ends before the payload does.
+    * @return Errc::InvalidUtf8 if utf8 is set and the payload is not UTF-8. The header 
+    * is put back first in either case, so nothing is consumed.
     */
    template<typename T>
-   requires std::floating_point<T>
-   void Deserialize(T &out) {
-      if (mRef.peek() == EOF) {
-         mRef.clear();
-         throw std::invalid_argument("No more data to read");
-      }
-      out = 0;
-
-      char fmt = Formats::NIL;
-      fmt = mRef.get();
-      switch ((Formats)fmt) {
-         case Formats::FLOAT32: {
-            if (std::numeric_limits<T>::max() < std::numeric_limits<float>::max()) {
-               throw std::length_error("Narrowing conversion");
-            }
-            uint32_t data = 0;
-            mRef.read((char *)&data, 4);
-            data = ToLittleEndian(data);
-            memcpy(&out, &data, 4);
-            break;
+   Errc ReadPayload(T &out, LengthHeader header, size_t start, bool utf8) {
+      // Typed arrays read their elements through here too.
+      constexpr size_t width = sizeof(std::ranges::range_value_t<T>);
+      size_t count = header.len / width;
+
+      if constexpr (ContiguousSource<Src>) {
+         std::span<const Byte> bytes;
+         if (Errc err = BorrowPayload(header, bytes); err != Errc::Ok) { return err; }
+         Resize(out, count);
+         if (!utf8) {
+            std::memcpy(out.data(), bytes.data(), bytes.size());
+         } else if (!kernels::CopyUtf8(bytes.data(), (Byte *)out.data(), bytes.size())) {
+            return Unwind(start, Errc::InvalidUtf8);
          }
-         case Formats::FLOAT64: {
-            if (std::numeric_limits<T>::max() < std::numeric_limits<double>::max()) {
-               throw std::length_error("Narrowing conversion");
+         return Errc::Ok;
+      } else {
+         constexpr size_t step = std::max<size_t>(MAX_UNTRUSTED_RESERVE / width, 1);
+         Resize(out, std::min(count, step));
+         for (size_t done = 0; done < count;) {
+            if (done == out.size()) { Resize(out, std::min(count, done + step)); }
+            if (!mSrc.Read((Byte *)(out.data() + done), (out.size() - done) * width)) {
+               return Unwind(start, Errc::EndOfData);
             }
-            uint64_t data = 0;
-            mRef.read((char *)&data, 8);
-            data = ToLittleEndian(data);
-            memcpy(&out, &data, 8);
-            break;
+            done = out.size();
          }
-         default: {
-            throw std::runtime_error("ByteArray does not match type float");
+         if (utf8 && !kernels::CopyUtf8((const Byte *)out.data(), nullptr, out.size())) {
+            return Unwind(start, Errc::InvalidUtf8);
          }
+         return Errc::Ok;
       }
    }
 
-   template<typename T, size_t N>
-   requires(not IsType<T, char const>)
-   void Deserialize(T (&arr)[N]) {
-      Deserialize(arr, N);
+   /**
+    * @brief Checks a str payload that has already been consumed, if UTF-8 validation is 
+    * enabled.
+    * 
+    * @param consumed The number of bytes the str took up, header included.
+    * @return Errc::InvalidUtf8 if the payload is not UTF-8. The str is put back first, 
+    * so nothing is consumed.
+    */
+   Errc CheckUtf8(const Byte *payload, size_t len, size_t consumed) {
+      if (mValidateUtf8 && !kernels::CopyUtf8(payload, nullptr, len)) {
+         mSrc.Rewind(consumed);
+         return Errc::InvalidUtf8;
+      }
+      return Errc::Ok;
    }
 
-   template<typename T>
-   requires ArrayType<T>
-   void Deserialize(T &out) {
-      size_t len = std::span(out).size();
-      Deserialize(out, len);
+   /**
+    * @brief Borrows the payload that follows an already consumed str header.
+    * 
+    * @return Errc::EndOfData if the source ends before the payload does. The header 
+    * is put back first, so nothing is consumed.
+    */
+   Errc BorrowPayload(LengthHeader header, std::span<const Byte> &out)
+   requires ContiguousSource<Src>
+   {
+      const Byte *data = mSrc.Borrow(header.len);
+      if (data == nullptr) {
+         mSrc.Rewind(header.size);
+         return Errc::EndOfData;
+      }
+      out = {data, header.len};
+      return Errc::Ok;
    }
 
-   template<typename T>
-   requires ArrayType<T>
-   void Deserialize(T &out, size_t outputLen) {
-      if (mRef.peek() == EOF) {
-         mRef.clear();
-         throw std::invalid_argument("No more data to read");
+   /**
+    * @brief Borrows a whole str value, header and payload.
+    */
+   Errc BorrowStr(std::span<const Byte> &out)
+   requires ContiguousSource<Src>
+   {
+      LengthHeader header;
+      if (Errc err = ReadStrHeader(header); err != Errc::Ok) { return err; }
+      return BorrowPayload(header, out);
+   }
+
+   /**
+    * @brief Reads in a multibyte unsigned integer following its format specifier.
+    * 
+    * Type U must have a width capable of holding any possible value of type T.
+    * 
+    * @tparam T The C++ unsigned integral type matching the msgpack format specifier
+    * @tparam U The unsigned integral type of the provided output parameter.
+    * @return Errc::Narrowing if the width of type U is too small to accomodate any
+    * value of type T. (ie, a narrowing conversion would occur)
+    */
+   template<typename T, typename U>
+   Errc ReadMultiByteUint(U &out) {
+      if (std::numeric_limits<U>::max() < std::numeric_limits<T>::max()) {
+         mSrc.Rewind(1);
+         return Errc::Narrowing;
+      }
+
+      T val;
+      if (Errc err = ReadBigEndian(val); err != Errc::Ok) { return err; }
+      out = val;
+      return Errc::Ok;
+   }
+
+   /**
+    * @brief Reads in a multibyte signed integer following its format specifier.
+    * 
+    * @tparam T The C++ signed integral type matching the msgpack format specifier
+    * @tparam U The signed integral type of the provided output parameter.
+    * @return Errc::Narrowing if the width of type U is too small to accomodate any
+    * value of type T. (ie, a narrowing conversion would occur)
+    */
+   template<typename T, typename U>
+   Errc ReadMultiByteInt(U &out) {
+      if (std::numeric_limits<U>::max() < std::numeric_limits<T>::max() ||
+          (std::numeric_limits<U>::min() > std::numeric_limits<T>::min())) {
+         mSrc.Rewind(1);
+         return Errc::Narrowing;
       }
 
-      char fmt = Formats::NIL;
-      fmt = mRef.peek(); // Nondestructive peek
+      std::make_unsigned_t<T> val;
+      if (Errc err = ReadBigEndian(val); err != Errc::Ok) { return err; }
+      out = (T)val;
+      return Errc::Ok;
+   }
 
-      switch ((Formats)fmt) {
-         case Formats::ARR16: {
-            mRef.get(fmt); // pop the specifier
-            uint16_t arrLen = ToLittleEndian(PeekMultiBytesUint<uint16_t>());
+   Src mSrc;
+   bool mValidateUtf8 {false};
+   ByteArray mScratch; // Holds extension payloads read from streams.
+   StringCache *mStrings {nullptr};
+   [[no_unique_address]] St mStats;
+};
 
-            if (arrLen > outputLen) {
-               mRef.unget(); // Put the format specifier back
-               throw std::length_error("Input array is not large enough");
-            }
+using Unpacker = BasicUnpacker<StreamSource>;
+using SpanUnpacker = BasicUnpacker<SpanSource>;
+using TrustedUnpacker = BasicUnpacker<TrustedSource>;
 
-            // Can safely modify more than 1 byte of the stream now.
-            mRef.ignore(2);
+/*****************************************************************************************
+ ***************************************   Pools   ***************************************
+ ****************************************************************************************/
+/**
+ * @brief Keeps idle packers or unpackers of type T around to be reused, so that a server 
+ * handling many short messages needn't build a new one, with its buffers, for each.
+ * 
+ * Acquire hands out a Lease on an idle object, rebound to new arguments with its Reset, 
+ * or on a newly constructed one if none are idle. When the lease ends the object is 
+ * flushed, if it has a Flush, and goes back to the pool, unless flushing failed. A pool is not thread safe. Use 
+ * Local for one pool per thread, and end each lease on the thread that acquired it.
+ * 
+ * @code
+ * auto packer = Pool<BufferPacker>::Local().Acquire(buffer);
+ * packer->Serialize(reply);
+ * @endcode
+ */
+template<typename T>
+class Pool {
+  public:
+   /**
+    * @brief Exclusive use of a pooled object, until the lease is destroyed. It must not 
+    * outlive the pool.
+    */
+   class Lease {
+     public:
+      Lease(Lease &&other) noexcept :
+         mPool(other.mPool), mObject(std::move(other.mObject)) {}
 
-            for (uint16_t i = 0; i < arrLen; i++) { Deserialize(out[i]); }
-            break;
+      Lease &operator=(Lease &&other) noexcept {
+         if (this != &other) {
+            Return();
+            mPool = other.mPool;
+            mObject = std::move(other.mObject);
          }
-         case Formats::ARR32: {
-            mRef.get(fmt); // pop the specifier
-            uint32_t arrLen = ToLittleEndian(PeekMultiBytesUint<uint32_t>());
+         return *this;
+      }
 
-            if (arrLen > outputLen) {
-               mRef.unget(); // Put the format specifier back
-               throw std::length_error("Input array is not large enough");
-            }
+      ~Lease() { Return(); }
 
-            // Can safely modify more than 1 byte of the stream now.
-            mRef.ignore(4);
+      T &operator*() const { return *mObject; }
+      T *operator->() const { return mObject.get(); }
 
-            for (uint32_t i = 0; i < arrLen; i++) { Deserialize(out[i]); }
-            break;
-         }
-         default: {
-            if ((fmt & FIXARR_MASK) == FIXARR_MASK) {
-               uint8_t arrLen = fmt & 0b1111;
+     private:
+      friend class Pool;
 
-               if (arrLen > outputLen) {
-                  throw std::length_error("Input array is not large enough");
-               }
+      Lease(Pool &pool, std::unique_ptr<T> object) :
+         mPool(&pool), mObject(std::move(object)) {}
 
-               mRef.get(fmt); // pop the specifier
-               for (uint8_t i = 0; i < arrLen; i++) { Deserialize(out[i]); }
-            } else {
-               throw std::runtime_error("ByteArray does not match type array");
+      void Return() noexcept {
+         if (!mObject) { return; }
+         if constexpr (requires(T &object) { object.Flush(); }) {
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+            try {
+               mObject->Flush();
+            } catch (...) {
+               // Nothing more can be done when the lease ends. Flush first to see errors. 
+               // The object may still hold on to what it failed to write, so it can't 
+               // be reused, or it would write to the old output after it's gone.
+               mObject.reset();
+               return;
             }
+#else
+            mObject->Flush();
+#endif
          }
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+         try {
+            mPool->mIdle.push_back(std::move(mObject));
+         } catch (...) {
+            // Out of memory for the free list, so just let the object go.
+         }
+#else
+         mPool->mIdle.push_back(std::move(mObject));
+#endif
+         mObject.reset();
       }
+
+      Pool *mPool;
+      std::unique_ptr<T> mObject;
+   };
+
+   Pool() = default;
+   Pool(const Pool &) = delete;
+   Pool &operator=(const Pool &) = delete;
+
+   /**
+    * @brief Leases an idle object, calling its Reset with args, or constructs a new one 
+    * from args if there are none.
+    * 
+    * @throws Any exception from Reset, in which case the idle object is discarded, or 
+    * from constructing a new one.
+    */
+   template<typename... Args>
+   requires std::constructible_from<T, Args...> &&
+            requires(T &object, Args &&...args) { object.Reset(std::forward<Args>(args)...); }
+   [[nodiscard]] Lease Acquire(Args &&...args) {
+      if (mIdle.empty()) { return {*this, std::make_unique<T>(std::forward<Args>(args)...)}; }
+      std::unique_ptr<T> object = std::move(mIdle.back());
+      mIdle.pop_back();
+      object->Reset(std::forward<Args>(args)...);
+      return {*this, std::move(object)};
    }
 
-   template<typename T>
-   void Deserialize(std::vector<T> &out) {
-      if (mRef.peek() == EOF) {
-         mRef.clear();
-         throw std::invalid_argument("No more data to read");
+   /**
+    * @brief Gets the number of objects waiting to be reused.
+    */
+   size_t Idle() const { return mIdle.size(); }
+
+   /**
+    * @brief Destroys the idle objects.
+    */
+   void Clear() { mIdle.clear(); }
+
+   /**
+    * @brief Gets the calling thread's own pool of T, which lasts until the thread exits.
+    */
+   static Pool &Local() {
+      thread_local Pool pool;
+      return pool;
+   }
+
+  private:
+   std::vector<std::unique_ptr<T>> mIdle;
+};
+
+/*****************************************************************************************
+ ******************************   Incremental Unpacking   ********************************
+ ****************************************************************************************/
+/**
+ * @brief Splits msgpack data that arrives in pieces, such as from a socket, back into 
+ * whole top-level values.
+ * 
+ * Bytes are handed over with Feed as they arrive, in chunks of any size. Only the value 
+ * currently being received is kept, and scanning it picks up where the last call left 
+ * off, so a large value arriving in many pieces is still only walked once. Scanning 
+ * only reads headers. Nothing is decoded until a value is complete.
+ */
+class IncrementalUnpacker {
+  public:
+   /**
+    * @brief Appends the next chunk of received data.
+    * 
+    * Invalidates any spans previously returned by Next.
+    */
+   void Feed(std::span<const Byte> bytes) {
+      if (mStart > 0) {
+         mBuf.erase(mBuf.begin(), mBuf.begin() + mStart);
+         mStart = 0;
       }
+      mBuf.insert(mBuf.end(), bytes.begin(), bytes.end());
+   }
 
-      char fmt = Formats::NIL;
-      fmt = mRef.peek(); // Nondestructive peek
+   /**
+    * @brief Takes the next complete top-level value.
+    * 
+    * @param object Set to the encoded value. It stays valid until the next call to Feed.
+    * @return Errc::EndOfData if the value hasn't fully arrived yet. Call again after 
+    * the next Feed.
+    * @return Errc::TypeMismatch if the data contains a byte that can't start a value. 
+    * The stream can't be recovered from this, other than with Clear.
+    */
+   Errc Next(std::span<const Byte> &object) {
+      if (Errc err = Scan(); err != Errc::Ok) { return err; }
+      object = std::span<const Byte>(mBuf).subspan(mStart, mState.pos);
+      Take();
+      return Errc::Ok;
+   }
 
-      switch ((Formats)fmt) {
-         case Formats::ARR16: {
-            mRef.get(fmt); // pop the specifier
-            uint16_t arrLen = ToLittleEndian(PeekMultiBytesUint<uint16_t>());
+   /**
+    * @brief Deserializes the next complete top-level value into out.
+    * 
+    * @return Errc::EndOfData if the value hasn't fully arrived yet. Otherwise, the result 
+    * of deserializing it. The value is only taken if that succeeds, so on failure it can 
+    * be retried as another type, or dropped with Next.
+    */
+   template<typename T>
+   Errc TryDeserialize(T &out) {
+      if (Errc err = Scan(); err != Errc::Ok) { return err; }
+      std::span<const Byte> object = std::span<const Byte>(mBuf).subspan(mStart, mState.pos);
+      BasicUnpacker<SpanSource> unpacker {object};
+      Errc err = unpacker.TryDeserialize(out);
+      if (err == Errc::Ok) { Take(); }
+      return err;
+   }
 
-            // Can safely modify more than 1 byte of the stream now.
-            mRef.ignore(2);
+   /**
+    * @brief Gets the number of bytes received but not yet taken.
+    */
+   size_t Buffered() const { return mBuf.size() - mStart; }
 
-            for (uint16_t i = 0; i < arrLen; i++) {
-               out.resize(arrLen);
-               Deserialize(out[i]);
-            }
-            break;
-         }
-         case Formats::ARR32: {
-            mRef.get(fmt); // pop the specifier
-            uint32_t arrLen = ToLittleEndian(PeekMultiBytesUint<uint32_t>());
+   /**
+    * @brief Throws away everything buffered, to start again from a new value.
+    */
+   void Clear() {
+      mBuf.clear();
+      mStart = 0;
+      mState = {};
+   }
 
-            // Can safely modify more than 1 byte of the stream now.
-            mRef.ignore(4);
+  private:
+   /**
+    * @brief Scans forward until the value starting at mStart is complete, resuming 
+    * from wherever the last call stopped.
+    */
+   Errc Scan() {
+      if (mState.pending == 0) { return Errc::Ok; }
+      return ScanValues(std::span<const Byte>(mBuf).subspan(mStart), mState);
+   }
 
-            for (uint32_t i = 0; i < arrLen; i++) {
-               out.resize(arrLen);
-               Deserialize(out[i]);
-            }
-            break;
+   /**
+    * @brief Takes the complete value at mStart, and starts on the one after it.
+    */
+   void Take() {
+      mStart += mState.pos;
+      mState = {};
+   }
+
+   ByteArray mBuf;
+   size_t mStart {0}; // Where the value currently being received starts.
+   ScanState mState;  // How far that value has been scanned.
+};
+
+/*****************************************************************************************
+ ***************************************   Views   ***************************************
+ ****************************************************************************************/
+/**
+ * @brief A lazy, read only view of an encoded value, that can be navigated without 
+ * knowing its layout ahead of time.
+ * 
+ * Nothing is decoded until asked for. Finding an element of an array or map only walks 
+ * the headers of the elements before it, and records where each of them starts, so 
+ * later lookups of those elements take constant time. Looking up a map by key records 
+ * the keys walked past in a hash table in the same way. Leaf values are decoded with 
+ * As or TryAs, just like Deserialize.
+ * 
+ * As lookups fill in these indices, a View must not be read from several threads at 
+ * once, though copies of it can be.
+ * 
+ * A View points into the buffer it was created from, which must outlive it and any 
+ * views or borrowed strings taken from it.
+ */
+class View {
+  public:
+   View() = default;
+
+   /**
+    * @brief Views the first value encoded in data.
+    * 
+    * @param data The encoded data. Anything after the first value can be reached with 
+    * Next.
+    * @param index Whether arrays and maps should record the offsets of their elements as 
+    * they are looked up. Disable it to save the allocation when each container is only 
+    * looked into once.
+    */
+   explicit View(std::span<const Byte> data, bool index = true) :
+      mBuf(data), mIndex(index) {}
+
+   /**
+    * @brief Gets the family of the value, or Family::Invalid if there is no value.
+    */
+   Family Type() const {
+      return mBuf.empty() ? Family::Invalid : FORMAT_TABLE[mBuf[0]].family;
+   }
+
+   /**
+    * @brief Gets the number of elements of an array or map, or the number of payload 
+    * bytes of a str, bin or ext. Other values have a size of 0.
+    * 
+    * @throws std::invalid_argument if the buffer ends inside the header.
+    */
+   size_t Size() const {
+      switch (Type()) {
+         case Family::Array:
+         case Family::Map:
+         case Family::Str:
+         case Family::Bin:
+         case Family::Ext: return ReadFormatCount(Header().data(), Info());
+         default: return 0;
+      }
+   }
+
+   /**
+    * @brief Gets an element of an array, or the value of an entry of a map, by position.
+    * 
+    * @throws std::runtime_error if this is not an array or map, or is malformed.
+    * @throws std::out_of_range if index is not less than Size.
+    * @throws std::invalid_argument if the buffer ends before the element does.
+    */
+   View operator[](size_t index) const {
+      bool isMap = Type() == Family::Map;
+      if (!isMap && Type() != Family::Array) {
+         Throw<std::runtime_error>("View is not an array or map");
+      }
+      if (index >= Size()) { Throw<std::out_of_range>("View index out of range"); }
+      return Element(isMap ? index * 2 + 1 : index);
+   }
+
+   /**
+    * @brief Gets the value of the entry of a map with a str key matching key.
+    * 
+    * @throws std::runtime_error if this is not a map, or is malformed.
+    * @throws std::out_of_range if no entry has that key.
+    * @throws std::invalid_argument if the buffer ends before the map does.
+    */
+   View operator[](std::string_view key) const {
+      std::optional<View> value = Find(key);
+      if (!value) { Throw<std::out_of_range>("Key not found in map"); }
+      return *value;
+   }
+
+   /**
+    * @brief Gets the key of an entry of a map, by position.
+    * 
+    * @throws std::runtime_error if this is not a map, or is malformed.
+    * @throws std::out_of_range if index is not less than Size.
+    * @throws std::invalid_argument if the buffer ends before the key does.
+    */
+   View Key(size_t index) const {
+      if (Type() != Family::Map) { Throw<std::runtime_error>("View is not a map"); }
+      if (index >= Size()) { Throw<std::out_of_range>("View index out of range"); }
+      return Element(index * 2);
+   }
+
+   /**
+    * @brief Looks up the value of the entry of a map with a str key matching key.
+    * 
+    * @return std::nullopt if no entry has that key.
+    * @throws std::runtime_error if this is not a map, or is malformed.
+    * @throws std::invalid_argument if the buffer ends before the map does.
+    */
+   std::optional<View> Find(std::string_view key) const {
+      if (Type() != Family::Map) { Throw<std::runtime_error>("View is not a map"); }
+      size_t count = Size();
+      if (!mIndex) {
+         for (size_t i = 0; i < count; i++) {
+            std::string_view name;
+            if (KeyAt(i, name) && name == key) { return Element(i * 2 + 1); }
          }
-         default: {
-            if ((fmt & FIXARR_MASK) == FIXARR_MASK) {
-               uint8_t arrLen = fmt & 0b1111;
-
-               mRef.get(fmt); // pop the specifier
-               for (uint8_t i = 0; i < arrLen; i++) {
-                  out.resize(arrLen);
-                  Deserialize(out[i]);
-               }
-            } else {
-               throw std::runtime_error("ByteArray does not match type array");
-            }
+         return std::nullopt;
+      }
+
+      // Keys are indexed as they are walked past, the first of any duplicates winning.
+      auto found = mKeys.find(key);
+      if (found != mKeys.end()) { return Element(found->second * 2 + 1); }
+      for (; mKeysIndexed < count; mKeysIndexed++) {
+         std::string_view name;
+         if (!KeyAt(mKeysIndexed, name) || !mKeys.emplace(name, mKeysIndexed).second) {
+            continue;
          }
+         if (name == key) { return Element(mKeysIndexed++ * 2 + 1); }
       }
+      return std::nullopt;
    }
 
-  private:
+   /**
+    * @brief Decodes the value as T, exactly as Deserialize would.
+    * 
+    * @throws Whatever Deserialize would throw for T.
+    */
    template<typename T>
-   T PeekMultiBytesUint() {
-      std::array<Byte, sizeof(T)> arr;
-      std::streampos save = mRef.tellg();
-
-      for (size_t i = 0; i < sizeof(T); i++) {
-         mRef.seekg(save + std::streamoff(i));
-         arr[i] = mRef.peek();
-      }
+   T As() const {
+      T out {};
+      BasicUnpacker<SpanSource> unpacker {mBuf};
+      unpacker.Deserialize(out);
+      return out;
+   }
 
-      mRef.seekg(save);
-      return std::bit_cast<T>(arr);
+   /**
+    * @brief Decodes the value into out, exactly as TryDeserialize would.
+    */
+   template<typename T>
+   Errc TryAs(T &out) const {
+      BasicUnpacker<SpanSource> unpacker {mBuf};
+      return unpacker.TryDeserialize(out);
    }
 
    /**
-    * @brief Reads in a multibyte unsigned integer from the byte stream.
+    * @brief Gets the complete encoding of the value.
     * 
-    * Type U must have a width capable of holding any possible value of type T.
+    * @throws std::runtime_error if the value is malformed.
+    * @throws std::invalid_argument if the buffer ends before the value does.
+    */
+   std::span<const Byte> Encoded() const { return mBuf.first(SizeAt(0)); }
+
+   /**
+    * @brief Skips over this value, without decoding it, to view the one after it.
     * 
-    * @tparam T The C++ unsigned integral type matching the msgpack format specifier
-    * @tparam U The unsigned integral type of the provided output parameter.
-    * @param out The value to be filled with the read data.
-    * @throws std::length_error if the width of type U is too small to accomodate any
-    * value of type T. (ie, a narrowing conversion would occur)
+    * @return View A view with no value, if this was the last one in the buffer.
+    * @throws std::runtime_error if the value is malformed.
+    * @throws std::invalid_argument if the buffer ends before the value does.
     */
-   template<typename T, typename U>
-   void ReadMultiByteUint(U &out) {
-      if (std::numeric_limits<U>::max() < std::numeric_limits<T>::max()) {
-         throw std::length_error("Narrowing conversion");
-      }
+   View Next() const { return View(mBuf.subspan(SizeAt(0)), mIndex); }
+
+  private:
+   FormatInfo Info() const { return FORMAT_TABLE[mBuf[0]]; }
+
+   std::span<const Byte> Header() const {
+      if (mBuf.size() < Info().header) { ThrowError(Errc::EndOfData); }
+      return mBuf.first(Info().header);
+   }
 
-      char fmt;
-      mRef.get(fmt); // Pop the format specifier
-      T val = 0;
-      mRef.read((char *)&val, sizeof(T));
-      out = ToLittleEndian(val);
+   /**
+    * @brief Gets the encoded size of the value starting at offset.
+    */
+   size_t SizeAt(size_t offset) const {
+      ScanState state;
+      Errc err = ScanValues(mBuf.subspan(offset), state);
+      if (err != Errc::Ok) { ThrowError(err); }
+      return state.pos;
    }
 
    /**
-    * @brief Reads in a multibyte signed integer from the byte stream.
+    * @brief Gets element i of an array or map, where map keys and values count as 
+    * separate elements.
     * 
-    * @tparam T The C++ signed integral type matching the msgpack format specifier
-    * @tparam U The signed integral type of the provided output parameter.
-    * @param out The value to be filled with the read data.
-    * @throws std::length_error if the width of type U is too small to accomodate any
-    * value of type T. (ie, a narrowing conversion would occur)
+    * When indexing, the offsets of the elements walked over to get there are recorded, 
+    * and never have to be walked over again.
     */
-   template<typename T, typename U>
-   void ReadMultiByteInt(U &out) {
-      if (std::numeric_limits<U>::max() < std::numeric_limits<T>::max() ||
-          (std::numeric_limits<U>::min() > std::numeric_limits<T>::min())) {
-         throw std::length_error("Narrowing conversion");
+   View Element(size_t i) const {
+      if (!mIndex) {
+         size_t offset = Header().size();
+         for (size_t j = 0; j < i; j++) { offset += SizeAt(offset); }
+         return View(mBuf.subspan(offset), mIndex);
+      }
+
+      if (mOffsets.empty()) {
+         mOffsets.reserve(std::min(Size() * (Type() == Family::Map ? 2 : 1), mBuf.size()));
+         mOffsets.push_back(Header().size());
+      }
+      while (mOffsets.size() <= i) {
+         mOffsets.push_back(mOffsets.back() + SizeAt(mOffsets.back()));
       }
+      return View(mBuf.subspan(mOffsets[i]), mIndex);
+   }
 
-      char fmt;
-      mRef.get(fmt); // Pop the format specifier
-      T val = 0;
-      size_t bbbb = sizeof(T);
-      mRef.read((char *)&val, sizeof(T));
-      out = (T)ToLittleEndian((std::make_unsigned_t<T>)val);
+   /**
+    * @brief Gets the key of entry i of a map, straight out of the buffer.
+    * 
+    * @return false if the key is not a str, or is cut short.
+    */
+   bool KeyAt(size_t i, std::string_view &name) const {
+      View key = Element(i * 2);
+      if (key.Type() != Family::Str || key.mBuf.size() < key.Info().header) { return false; }
+      size_t header = key.Info().header;
+      size_t len = key.Size();
+      if (len > key.mBuf.size() - header) { return false; }
+      name = std::string_view((const char *)key.mBuf.data() + header, len);
+      return true;
    }
 
-   size_t mStreamStart {0};
-   std::istream &mRef;
+   // The indices below are filled in by const lookups, so a View must not be used from 
+   // several threads at once. Copies of it can be.
+   std::span<const Byte> mBuf;           // From the start of the value to the end.
+   bool mIndex {true};
+   mutable std::vector<size_t> mOffsets; // Offset of each element, once indexed.
+   mutable std::unordered_map<std::string_view, size_t> mKeys; // Entry of each str key.
+   mutable size_t mKeysIndexed {0};      // How many entries' keys are in mKeys.
 };
-}; // namespace pack
\ No newline at end of file
+}; // namespace pack
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "msgpack.hpp"
+
+// Parallel encoding. This needs threads, which may need linking in, so is kept out of
+// msgpack.hpp.
+
+namespace pack {
+
+/**
+ * @brief The fewest elements SerializeParallel gives a thread at a time. Smaller chunks 
+ * cost more in buffers and handoffs than they gain.
+ */
+constexpr size_t PARALLEL_MIN_CHUNK = 1024;
+
+/**
+ * @brief The number of chunks SerializeParallel aims to give each thread, so that threads 
+ * which finish early can pick up work from slower ones.
+ */
+constexpr size_t PARALLEL_CHUNKS_PER_THREAD = 8;
+
+/**
+ * @brief Calls work(task) for every task from 0 to count, on up to threads threads. 
+ * Threads take tasks one at a time until none are left, so ones that finish early pick 
+ * up the slack from slower ones. The calling thread takes tasks too.
+ * 
+ * @param count The number of tasks.
+ * @param threads The number of threads to work on, including the calling thread. 0 uses 
+ * std::thread::hardware_concurrency.
+ * @param work Called with the index of each task, from several threads at once.
+ * @throws Any exception from work. The first one stops the remaining tasks from being 
+ * started, and is rethrown once every thread has stopped.
+ */
+template<typename F>
+void ParallelFor(size_t count, size_t threads, F &&work) {
+   if (threads == 0) { threads = std::max(1u, std::thread::hardware_concurrency()); }
+   std::atomic<size_t> next {0};
+   std::exception_ptr error;
+   std::mutex errorLock;
+
+   auto worker = [&] {
+      for (size_t task = next++; task < count; task = next++) {
+#if defined(__cpp_exceptions) || defined(_CPPUNWIND)
+         try {
+            work(task);
+         } catch (...) {
+            std::lock_guard lock(errorLock);
+            if (!error) { error = std::current_exception(); }
+            next = count; // Leave the remaining tasks undone.
+         }
+#else
+         work(task);
+#endif
+      }
+   };
+
+   {
+      std::vector<std::jthread> workers;
+      size_t spawn = std::min(threads, count) - std::min<size_t>(count, 1);
+      workers.reserve(spawn);
+      for (size_t i = 0; i < spawn; i++) { workers.emplace_back(worker); }
+      worker();
+   }
+   if (error) { std::rethrow_exception(error); }
+}
+
+/**
+ * @brief Serialize a large range as an array, encoding its elements on several threads.
+ * 
+ * The range is split into chunks, which are encoded with ParallelFor. Each chunk is 
+ * sized with PackedSizer first, so that it is encoded into a buffer allocated exactly 
+ * once. The array header and then the chunks are written to packer in order, so the 
+ * output is identical to packer.Serialize(range), except that strings in the chunks are 
+ * never interned. The calling thread encodes chunks as well, and ranges too small to 
+ * split are serialized on it directly.
+ * 
+ * The Stats policy sees the whole call as a single Serialize. Values encoded in the 
+ * chunks are counted on their own threads, then reported once per family.
+ * 
+ * This pays off for arrays of strings and structs, whose elements are costly to encode, 
+ * at the expense of holding their encoded form in memory until every chunk is done.
+ * 
+ * @param packer The packer to serialize to.
+ * @param range The elements to serialize. Elements are only read, from several threads 
+ * at once.
+ * @param threads The number of threads to encode on, including the calling thread. 0 
+ * uses std::thread::hardware_concurrency.
+ * @throws std::runtime_error if there was a failure writing to the stream.
+ * @throws std::invalid_argument if the range has more than UINT32_MAX elements.
+ * @throws Any exception from serializing an element, after every thread has stopped.
+ */
+template<Sink S, StatsPolicy St, typename R>
+requires std::ranges::random_access_range<const R> && std::ranges::sized_range<const R> &&
+         (!StringType<R>) && (!BinaryType<R>) && (!MapType<R>)
+void SerializeParallel(BasicPacker<S, St> &packer, const R &range, size_t threads = 0) {
+   size_t count = std::ranges::size(range);
+   if (threads == 0) { threads = std::max(1u, std::thread::hardware_concurrency()); }
+   size_t chunkSize = std::max(PARALLEL_MIN_CHUNK,
+                               count / (threads * PARALLEL_CHUNKS_PER_THREAD) + 1);
+   size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+   if (threads == 1 || chunkCount < 2) {
+      packer.Serialize(range);
+      return;
+   }
+
+   // Chunks only count values if the packer's policy wants them.
+   using ChunkStats = std::conditional_t<St::ENABLED, CountingStats, NoStats>;
+   StatsScope scope(packer.Stats(), Operation::Serialize);
+   std::vector<ByteArray> chunks(chunkCount);
+   std::vector<ChunkStats> chunkStats(chunkCount);
+   auto first = std::ranges::begin(range);
+   ParallelFor(chunkCount, threads, [&](size_t chunk) {
+      size_t begin = chunk * chunkSize;
+      size_t end = std::min(begin + chunkSize, count);
+      size_t len = 0;
+      for (size_t i = begin; i < end; i++) { len += PackedSizer::Of(first[i]); }
+      chunks[chunk].reserve(len);
+      BasicPacker<BufferSink, ChunkStats> chunkPacker(chunks[chunk]);
+      for (size_t i = begin; i < end; i++) { chunkPacker.Serialize(first[i]); }
+      chunkStats[chunk] = chunkPacker.Stats();
+   });
+
+   packer.SerializeArrayHeader(count);
+   for (const ByteArray &chunk : chunks) { packer.SerializeRaw(chunk); }
+   if constexpr (St::ENABLED) {
+      for (size_t family = 0; family < CountingStats::FAMILIES; family++) {
+         uint64_t values = 0, bytes = 0;
+         for (const CountingStats &stats : chunkStats) {
+            values += stats.values[family];
+            bytes += stats.bytes[family];
+         }
+         if (bytes > 0) { packer.Stats().Values((Family)family, values, bytes); }
+      }
+   }
+}
+}; // namespace pack
@@ -0,0 +1,39 @@
+// Built with -fno-exceptions, to check that the header still compiles without them and 
+// that TryDeserialize reports errors on its own.
+#include "pack/msgpack.hpp"
+
+#include <sstream>
+
+#define CHECK(expr)                                   \
+   if (!(expr)) { return __LINE__; }
+
+int main() {
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(70000u, "text", std::vector<double> {0.5, 1.5});
+   }
+
+   pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+   uint16_t narrow;
+   CHECK(unpacker.TryDeserialize(narrow) == pack::Errc::Narrowing);
+   uint32_t value;
+   std::string_view text;
+   std::vector<double> doubles;
+   CHECK(unpacker.TryDeserialize(value, text, doubles) == pack::Errc::Ok);
+   CHECK(value == 70000 && text == "text" && doubles.size() == 2);
+   CHECK(unpacker.TryDeserialize(value) == pack::Errc::EndOfData);
+
+   std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+   {
+      pack::Packer packer(stream);
+      packer.Serialize(true, -3);
+   }
+   pack::Unpacker streamUnpacker(stream);
+   int number;
+   bool flag;
+   CHECK(streamUnpacker.TryDeserialize(number) == pack::Errc::TypeMismatch);
+   CHECK(streamUnpacker.TryDeserialize(flag, number) == pack::Errc::Ok);
+   CHECK(flag && number == -3);
+   return 0;
+}
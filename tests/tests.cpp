@@ -2,6 +2,21 @@
 #include "catch.hpp"
 
 #include <pack/msgpack.hpp>
+#include <pack/parallel.hpp>
+#include <pack/async.hpp>
+#if defined(__unix__) || defined(__APPLE__)
+#include <pack/mmap.hpp>
+#include <pack/batch.hpp>
+#include <pack/indexed.hpp>
+#include <fcntl.h>
+#endif
+#include <fstream>
+#include <deque>
+#include <list>
+#include <ranges>
+#include <map>
+#include <unordered_map>
+#include <memory_resource>
 
 TEST_CASE("Boolean") {
    std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
@@ -284,30 +299,181 @@ TEST_CASE("String") {
       std::string string;
       unpacker.Deserialize(arr, string);
       REQUIRE(std::strcmp(arr, three.c_str()) == 0);
-      REQUIRE(std::strcmp(string.c_str(), thirtyone.c_str()) == 0);
+      REQUIRE(string == thirtyone);
       REQUIRE(unpacker.ByteCount() == 36);
 
       char arr2[43] = {0};
       std::string string3;
       unpacker.Deserialize(arr2, string3);
       REQUIRE(std::strcmp(arr2, fortytwo.c_str()) == 0);
-      REQUIRE(std::strcmp(string3.c_str(), uint8max.c_str()) == 0);
+      REQUIRE(string3 == uint8max);
       REQUIRE(unpacker.ByteCount() == 337);
 
       char arr3[UINT8_MAX * 5 + 1] = {0};
       std::string string4;
       unpacker.Deserialize(arr3, string4);
       REQUIRE(std::strcmp(arr3, str16.c_str()) == 0);
-      REQUIRE(std::strcmp(string4.c_str(), str16max.c_str()) == 0);
+      REQUIRE(string4 == str16max);
       REQUIRE(unpacker.ByteCount() == 67153);
 
       std::string string5;
       unpacker.Deserialize(string5);
-      REQUIRE(std::strcmp(string5.c_str(), large.c_str()) == 0);
+      REQUIRE(string5 == large);
       REQUIRE(unpacker.ByteCount() == 167158);
    }
 }
 
+TEST_CASE("String Decode") {
+   std::string small = StringOfSize(10);
+   std::string big = StringOfSize(3 * pack::MAX_UNTRUSTED_RESERVE / 2);
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(small, "", big);
+   }
+
+   // Round trips compare equal, and an existing buffer is reused.
+   std::string out;
+   out.reserve(64);
+   const char *data = out.data();
+   pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+   unpacker.Deserialize(out);
+   REQUIRE(out == small);
+   REQUIRE(out.data() == data);
+   unpacker.Deserialize(out);
+   REQUIRE(out.empty());
+
+   // Streamed strings longer than MAX_UNTRUSTED_RESERVE arrive in steps.
+   std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+   stream.write((const char *)buffer.data(), buffer.size());
+   pack::Unpacker streamUnpacker(stream);
+   std::string first, empty, last;
+   streamUnpacker.Deserialize(first, empty, last);
+   REQUIRE(last == big);
+
+   std::stringstream truncated(std::ios::binary | std::ios::out | std::ios::in);
+   truncated.write((const char *)buffer.data() + small.size() + 2, buffer.size() - 20);
+   pack::Unpacker truncatedUnpacker(truncated);
+   REQUIRE(truncatedUnpacker.TryDeserialize(empty, last) == pack::Errc::EndOfData);
+   REQUIRE(truncatedUnpacker.ByteCount() == 0);
+}
+
+TEST_CASE("UTF-8 Validation") {
+   std::string text;
+   for (int i = 0; i < 20; i++) { text += StringOfSize(i) + "\u00e9\u4e2d\U0001f600"; }
+   std::vector<std::string> invalid = {
+       "\x80",             // Lone continuation byte
+       "\xc3",             // Truncated sequence
+       "\xc0\xaf",         // Overlong encoding
+       "\xed\xa0\x80",     // Surrogate
+       "\xf4\x90\x80\x80", // Past U+10FFFF
+       "\xff",             // Never valid
+   };
+
+   for (const std::string &bad : invalid) {
+      // Bad sequences are found both in a vector block and in the scalar tail.
+      for (std::string str : {bad, StringOfSize(40) + bad + StringOfSize(40)}) {
+         pack::ByteArray buffer;
+         {
+            pack::BufferPacker packer(buffer);
+            packer.Serialize(text, str);
+         }
+
+         pack::SpanUnpacker unchecked {std::span<const pack::Byte>(buffer)};
+         std::string a, b;
+         unchecked.Deserialize(a, b);
+         REQUIRE(b == str);
+
+         pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+         unpacker.ValidateUtf8(true);
+         unpacker.Deserialize(a);
+         REQUIRE(a == text);
+         size_t before = unpacker.ByteCount();
+         REQUIRE(unpacker.TryDeserialize(b) == pack::Errc::InvalidUtf8);
+         std::string_view view;
+         REQUIRE(unpacker.TryDeserialize(view) == pack::Errc::InvalidUtf8);
+         REQUIRE_THROWS_AS(unpacker.Deserialize(b), std::runtime_error);
+         REQUIRE(unpacker.ByteCount() == before);
+
+         std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+         stream.write((const char *)buffer.data(), buffer.size());
+         pack::Unpacker streamUnpacker(stream);
+         streamUnpacker.ValidateUtf8(true);
+         REQUIRE(streamUnpacker.TryDeserialize(a, b) == pack::Errc::InvalidUtf8);
+         REQUIRE(streamUnpacker.ByteCount() == 0);
+         streamUnpacker.Deserialize(a);
+         REQUIRE(a == text);
+      }
+   }
+}
+
+TEST_CASE("Binary") {
+   pack::ByteArray blob(70000);
+   for (size_t i = 0; i < blob.size(); i++) { blob[i] = (pack::Byte)(i * 7); }
+   std::vector<std::byte> small = {std::byte {1}, std::byte {2}, std::byte {3}};
+   std::array<pack::Byte, 4> fixed = {9, 8, 7, 6};
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(std::span(blob).first(255), std::span(blob).first(256), blob);
+      packer.Serialize(std::span<const std::byte>(small), fixed, pack::ByteArray {});
+      packer.Serialize("text");
+   }
+   REQUIRE(buffer[0] == pack::Formats::BIN8);
+   REQUIRE(buffer[2 + 255] == pack::Formats::BIN16);
+   REQUIRE(buffer[2 + 255 + 3 + 256] == pack::Formats::BIN32);
+   REQUIRE(buffer.size() == pack::PackedSize(std::span(blob).first(255),
+                                             std::span(blob).first(256), blob, small, fixed,
+                                             pack::ByteArray {}, "text"));
+   REQUIRE(pack::Validate(buffer) == pack::Errc::Ok);
+
+   {
+      // Copied out, and borrowed in place.
+      pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+      pack::ByteArray first;
+      std::span<const pack::Byte> second;
+      std::vector<std::byte> third;
+      unpacker.Deserialize(first, second, third);
+      REQUIRE(std::ranges::equal(first, std::span(blob).first(255)));
+      REQUIRE(std::ranges::equal(second, std::span(blob).first(256)));
+      REQUIRE(second.data() == buffer.data() + 2 + 255 + 3);
+      REQUIRE(std::ranges::equal(std::as_bytes(std::span(blob)), third));
+
+      std::array<pack::Byte, 2> tooSmall;
+      REQUIRE(unpacker.TryDeserialize(tooSmall) == pack::Errc::OutputTooSmall);
+      std::span<const std::byte> borrowed;
+      std::array<pack::Byte, 6> roomy {};
+      pack::ByteArray empty = {1, 2, 3};
+      std::span<const pack::Byte> text;
+      unpacker.Deserialize(borrowed, roomy, empty, text);
+      REQUIRE(std::ranges::equal(borrowed, small));
+      REQUIRE(roomy == std::array<pack::Byte, 6> {9, 8, 7, 6, 0, 0});
+      REQUIRE(empty.empty());
+      REQUIRE(text.size() == 4);
+   }
+
+   {
+      // Bins are not strings, and the other way around.
+      pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+      std::string str;
+      REQUIRE(unpacker.TryDeserialize(str) == pack::Errc::TypeMismatch);
+      std::vector<int> ints;
+      REQUIRE(unpacker.TryDeserialize(ints) == pack::Errc::TypeMismatch);
+      pack::View view(buffer);
+      REQUIRE(view.Type() == pack::Family::Bin);
+      REQUIRE(view.Size() == 255);
+   }
+
+   {
+      std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+      stream.write((const char *)buffer.data(), buffer.size());
+      pack::Unpacker unpacker(stream);
+      pack::ByteArray first, second, third;
+      unpacker.Deserialize(first, second, third);
+      REQUIRE(third == blob);
+   }
+}
+
 TEST_CASE("Floating Point") {
    std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
    float pi = 3.14159f;
@@ -387,4 +553,1928 @@ TEST_CASE("Arrays") {
       unpacker.Deserialize(arr5);
       REQUIRE(arr5 == arr5_in);
    }
-}
\ No newline at end of file
+}
+TEST_CASE("Buffer Sinks") {
+   std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+   std::string str = StringOfSize(300);
+   std::vector<int> arr = {1, -200, 70000, 3};
+   {
+      pack::Packer packer(stream);
+      packer.Serialize(true, (uint8_t)200, -12345, 2.5, 1.5f, str, arr);
+   }
+   std::string expected = stream.str();
+
+   pack::ByteArray buffer = {0xff, 0xff};
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(true, (uint8_t)200, -12345, 2.5, 1.5f, str, arr);
+      REQUIRE(packer.ByteCount() == expected.size());
+   }
+   REQUIRE(buffer.size() == expected.size());
+   REQUIRE(std::memcmp(buffer.data(), expected.data(), expected.size()) == 0);
+
+   {
+      pack::BufferPacker packer(buffer, buffer.size());
+      packer.Serialize(false);
+      REQUIRE(packer.ByteCount() == 1);
+   }
+   REQUIRE(buffer.size() == expected.size() + 1);
+   REQUIRE(buffer.back() == pack::Formats::BFALSE);
+
+   std::vector<pack::Byte> storage(expected.size());
+   {
+      pack::SpanPacker packer {std::span(storage)};
+      packer.Serialize(true, (uint8_t)200, -12345, 2.5, 1.5f, str, arr);
+      REQUIRE(packer.ByteCount() == expected.size());
+      REQUIRE_THROWS_AS(packer.Serialize(true), std::length_error);
+   }
+   REQUIRE(std::memcmp(storage.data(), expected.data(), expected.size()) == 0);
+}
+
+TEST_CASE("Span Unpacker") {
+   std::string str = StringOfSize(300);
+   std::vector<int> arr = {1, -200, 70000, 3};
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(true, (uint8_t)200, -12345, 2.5, str, arr, "short", str);
+   }
+
+   pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+   bool b;
+   uint8_t u;
+   int i;
+   double d;
+   std::string copied;
+   std::vector<int> arrOut;
+   unpacker.Deserialize(b, u, i, d, copied, arrOut);
+   REQUIRE(b == true);
+   REQUIRE(u == 200);
+   REQUIRE(i == -12345);
+   REQUIRE(d == 2.5);
+   REQUIRE(copied == str);
+   REQUIRE(arrOut == arr);
+
+   std::string_view view;
+   std::span<const pack::Byte> bytes;
+   unpacker.Deserialize(view, bytes);
+   REQUIRE(view == "short");
+   REQUIRE((const char *)view.data() > (const char *)buffer.data());
+   REQUIRE(bytes.size() == str.size());
+   REQUIRE(bytes.data() + bytes.size() == buffer.data() + buffer.size());
+   REQUIRE(std::memcmp(bytes.data(), str.data(), str.size()) == 0);
+   REQUIRE(unpacker.ByteCount() == buffer.size());
+
+   REQUIRE_THROWS_AS(unpacker.Deserialize(b), std::invalid_argument);
+
+   // A string header that claims more bytes than the buffer holds.
+   pack::ByteArray truncated = {pack::Formats::STR8, 10, 'a', 'b'};
+   pack::SpanUnpacker shortUnpacker {std::span<const pack::Byte>(truncated)};
+   REQUIRE_THROWS_AS(shortUnpacker.Deserialize(view), std::invalid_argument);
+}
+
+TEST_CASE("Header Decode") {
+   std::vector<int> small = {1, 2, 3};
+   std::vector<int> large(UINT16_MAX + 5, 7);
+   std::string str = StringOfSize(UINT8_MAX + 1);
+   const char *path = "pack_header_decode.bin";
+   {
+      std::ofstream file(path, std::ios::binary | std::ios::out | std::ios::trunc);
+      pack::Packer packer(file);
+      packer.Serialize(small, large, str, (int8_t)-100);
+   }
+
+   {
+      std::ifstream file(path, std::ios::binary | std::ios::in);
+      pack::Unpacker unpacker(file);
+
+      // Failed decodes must leave the stream where it was.
+      std::string wrongType;
+      REQUIRE_THROWS_AS(unpacker.Deserialize(wrongType), std::runtime_error);
+      int tooSmall[2];
+      REQUIRE_THROWS_AS(unpacker.Deserialize(tooSmall), std::length_error);
+      REQUIRE(unpacker.ByteCount() == 0);
+
+      std::vector<int> smallOut;
+      std::vector<int> largeOut;
+      std::string strOut;
+      unpacker.Deserialize(smallOut, largeOut, strOut);
+      REQUIRE(smallOut == small);
+      REQUIRE(largeOut == large);
+      REQUIRE(strOut == str);
+
+      // An INT8 format specifier must not be mistaken for a fixarr.
+      std::vector<int> notArray;
+      REQUIRE_THROWS_AS(unpacker.Deserialize(notArray), std::runtime_error);
+      int8_t last;
+      unpacker.Deserialize(last);
+      REQUIRE(last == -100);
+   }
+   std::remove(path);
+
+   // A header whose length field is cut off consumes nothing.
+   pack::ByteArray truncated = {pack::Formats::ARR32, 0, 0};
+   pack::SpanUnpacker unpacker {std::span<const pack::Byte>(truncated)};
+   std::vector<int> out;
+   REQUIRE_THROWS_AS(unpacker.Deserialize(out), std::invalid_argument);
+   REQUIRE(unpacker.ByteCount() == 0);
+}
+
+TEST_CASE("Format Dispatch") {
+   // Every first byte must be accepted by exactly the decoders of its family.
+   for (int fmt = 0; fmt <= UINT8_MAX; fmt++) {
+      std::array<pack::Byte, 32> data {};
+      data[0] = (pack::Byte)fmt;
+      pack::Family family = pack::FORMAT_TABLE[fmt].family;
+      auto accepts = [&](auto out) {
+         pack::SpanUnpacker unpacker {std::span<const pack::Byte>(data)};
+         pack::Errc err = unpacker.TryDeserialize(out);
+         REQUIRE((err == pack::Errc::Ok || unpacker.ByteCount() == 0));
+         return err == pack::Errc::Ok;
+      };
+
+      REQUIRE(accepts(uint64_t()) == (family == pack::Family::Uint));
+      REQUIRE(accepts(int64_t()) == (family == pack::Family::Int || fmt <= pack::POS_FIXINT_MAX));
+      REQUIRE(accepts(bool()) == (family == pack::Family::Bool));
+      REQUIRE(accepts(double()) == (family == pack::Family::Float));
+      REQUIRE(accepts(std::string()) == (family == pack::Family::Str));
+      REQUIRE(accepts(pack::ByteArray()) == (family == pack::Family::Bin));
+      REQUIRE(accepts(std::vector<int>()) == (family == pack::Family::Array));
+      REQUIRE(accepts(std::map<int, int>()) == (family == pack::Family::Map));
+   }
+
+   // The bulk path agrees with the scalar one on which formats fit.
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(std::vector<int64_t>{-1, 127, -32, 1000, -70000, INT64_MIN});
+   }
+   pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+   std::vector<int64_t> out;
+   unpacker.Deserialize(out);
+   REQUIRE(out == std::vector<int64_t>{-1, 127, -32, 1000, -70000, INT64_MIN});
+}
+
+TEST_CASE("Numeric Arrays") {
+   std::vector<float> floats(10000);
+   std::vector<double> doubles(700);
+   std::vector<uint32_t> uints(3000);
+   std::vector<int64_t> ints(3000);
+   for (size_t i = 0; i < floats.size(); i++) { floats[i] = i * 0.25f - 100.0f; }
+   for (size_t i = 0; i < doubles.size(); i++) { doubles[i] = i * -1.5; }
+   for (size_t i = 0; i < uints.size(); i++) { uints[i] = (uint32_t)(i * i * 977); }
+   for (size_t i = 0; i < ints.size(); i++) { ints[i] = (int64_t)(i * i * i) * -31; }
+
+   std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+   {
+      pack::Packer packer(stream);
+      packer.Serialize(std::span<const float>(floats), doubles, uints, ints);
+      // Floats written where doubles are expected must still widen correctly.
+      packer.Serialize(std::vector<float> {1.5f, 2.5f});
+   }
+
+   // Bulk encoding must match encoding each element on its own.
+   std::stringstream scalar(std::ios::binary | std::ios::out | std::ios::in);
+   {
+      pack::Packer packer(scalar);
+      packer.Serialize(std::vector<int> {});
+      for (float f : floats) { packer.Serialize(f); }
+   }
+   REQUIRE(stream.str().substr(3, floats.size() * 5) == scalar.str().substr(1));
+
+   std::string encoded = stream.str();
+   std::span<const pack::Byte> bytes((const pack::Byte *)encoded.data(), encoded.size());
+
+   {
+      pack::Unpacker unpacker(stream);
+      std::vector<float> floatsOut;
+      std::vector<double> doublesOut;
+      std::vector<uint32_t> uintsOut;
+      std::vector<int64_t> intsOut;
+      std::vector<double> widened;
+      unpacker.Deserialize(floatsOut, doublesOut, uintsOut, intsOut, widened);
+      REQUIRE(floatsOut == floats);
+      REQUIRE(doublesOut == doubles);
+      REQUIRE(uintsOut == uints);
+      REQUIRE(intsOut == ints);
+      REQUIRE(widened == std::vector<double> {1.5, 2.5});
+   }
+
+   {
+      pack::SpanUnpacker unpacker {bytes};
+      std::vector<float> floatsOut;
+      std::array<double, 700> doublesOut;
+      std::vector<uint32_t> uintsOut;
+      std::vector<int64_t> intsOut;
+      std::vector<double> widened;
+      unpacker.Deserialize(floatsOut, doublesOut, uintsOut, intsOut, widened);
+      REQUIRE(floatsOut == floats);
+      REQUIRE(std::equal(doubles.begin(), doubles.end(), doublesOut.begin()));
+      REQUIRE(uintsOut == uints);
+      REQUIRE(intsOut == ints);
+      REQUIRE(widened == std::vector<double> {1.5, 2.5});
+   }
+
+   {
+      // Narrowing inside a bulk decode is still reported.
+      pack::SpanUnpacker unpacker {bytes};
+      std::vector<float> skip;
+      unpacker.Deserialize(skip);
+      std::vector<float> narrow;
+      REQUIRE_THROWS_AS(unpacker.Deserialize(narrow), std::length_error);
+   }
+}
+
+TEST_CASE("Byte Order Kernels") {
+   REQUIRE(pack::Byteswap((uint32_t)0x11223344) == 0x44332211);
+   REQUIRE(pack::Byteswap((uint16_t)0x1122) == 0x2211);
+   REQUIRE(pack::FromBigEndian(pack::ToBigEndian((uint64_t)0x0102030405060708)) ==
+           0x0102030405060708);
+   if constexpr (std::endian::native == std::endian::little) {
+      REQUIRE(pack::ToLittleEndian((uint32_t)0x11223344) == 0x11223344);
+   }
+
+   std::vector<uint32_t> values(1000);
+   for (size_t i = 0; i < values.size(); i++) { values[i] = (uint32_t)(i * 2654435761u); }
+   for (size_t count : {0, 1, 3, 4, 7, 8, 9, 31, 33, 1000}) {
+      std::span<const uint32_t> in(values.data(), count);
+      std::vector<uint32_t> out(count);
+      pack::ByteswapArray(in, out.data());
+      for (size_t i = 0; i < count; i++) { REQUIRE(out[i] == pack::Byteswap(values[i])); }
+
+      std::vector<uint64_t> wide(values.begin(), values.begin() + count);
+      std::vector<uint64_t> wideOut(count);
+      pack::ByteswapArray(std::span<const uint64_t>(wide), wideOut.data());
+      for (size_t i = 0; i < count; i++) { REQUIRE(wideOut[i] == pack::Byteswap(wide[i])); }
+   }
+
+   // Every record kernel must agree with the scalar one, including on partial blocks.
+   std::vector<float> floats(37);
+   for (size_t i = 0; i < floats.size(); i++) { floats[i] = i * 1.25f - 7.0f; }
+   std::vector<pack::Byte> expected(floats.size() * 5);
+   pack::kernels::EncodeRecordsScalar<4>((const pack::Byte *)floats.data(),
+                                         pack::Formats::FLOAT32, expected.data(),
+                                         floats.size());
+   for (size_t i = 0; i < floats.size(); i++) {
+      pack::Byte scalar[5];
+      REQUIRE(pack::EncodeNumeric(scalar, floats[i]) == 5);
+      REQUIRE(std::memcmp(scalar, &expected[i * 5], 5) == 0);
+   }
+
+   std::vector<pack::Byte> encoded(expected.size());
+   pack::kernels::EncodeRecords<4>((const pack::Byte *)floats.data(), pack::Formats::FLOAT32,
+                                   encoded.data(), floats.size());
+   REQUIRE(encoded == expected);
+
+   std::vector<float> decoded(floats.size());
+   REQUIRE(pack::kernels::DecodeRecords<4>(encoded.data(), pack::Formats::FLOAT32,
+                                           (pack::Byte *)decoded.data(),
+                                           floats.size()) == floats.size());
+   REQUIRE(decoded == floats);
+
+   // Decoding stops at the first record with the wrong format specifier.
+   encoded[22 * 5] = pack::Formats::FLOAT64;
+   REQUIRE(pack::kernels::DecodeRecords<4>(encoded.data(), pack::Formats::FLOAT32,
+                                           (pack::Byte *)decoded.data(),
+                                           floats.size()) == 22);
+
+   std::vector<double> doubles(19);
+   for (size_t i = 0; i < doubles.size(); i++) { doubles[i] = i * -3.5; }
+   std::vector<pack::Byte> encodedDoubles(doubles.size() * 9);
+   pack::kernels::EncodeRecords<8>((const pack::Byte *)doubles.data(),
+                                   pack::Formats::FLOAT64, encodedDoubles.data(),
+                                   doubles.size());
+   for (size_t i = 0; i < doubles.size(); i++) {
+      pack::Byte scalar[9];
+      pack::EncodeNumeric(scalar, doubles[i]);
+      REQUIRE(std::memcmp(scalar, &encodedDoubles[i * 9], 9) == 0);
+   }
+   std::vector<double> decodedDoubles(doubles.size());
+   REQUIRE(pack::kernels::DecodeRecords<8>(encodedDoubles.data(), pack::Formats::FLOAT64,
+                                           (pack::Byte *)decodedDoubles.data(),
+                                           doubles.size()) == doubles.size());
+   REQUIRE(decodedDoubles == doubles);
+}
+
+// A sized range that can't be copied, so serializing it must work by reference.
+struct NoCopyRange {
+   std::vector<std::string> items;
+   NoCopyRange(std::vector<std::string> in) : items(std::move(in)) {}
+   NoCopyRange(const NoCopyRange &) = delete;
+   auto begin() const { return items.begin(); }
+   auto end() const { return items.end(); }
+   size_t size() const { return items.size(); }
+};
+
+TEST_CASE("Ranges") {
+   std::vector<std::string> strings = {"alpha", "beta", StringOfSize(100), "delta"};
+   std::deque<int> deque = {4, -5, 600};
+   std::list<double> list = {1.5, -2.5};
+   NoCopyRange noCopy(strings);
+
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(strings, deque, list, noCopy);
+      packer.Serialize(std::views::iota(0, 20) | std::views::take(17));
+      packer.SerializeArrayHeader(2);
+      packer.Serialize(true, "manual");
+   }
+
+   pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+   std::vector<std::string> stringsOut;
+   std::vector<int> dequeOut;
+   std::vector<double> listOut;
+   std::vector<std::string> noCopyOut;
+   std::vector<int> iotaOut;
+   unpacker.Deserialize(stringsOut, dequeOut, listOut, noCopyOut, iotaOut);
+   REQUIRE(stringsOut.size() == strings.size());
+   for (size_t i = 0; i < strings.size(); i++) {
+      REQUIRE(stringsOut[i] == strings[i]);
+      REQUIRE(noCopyOut[i] == strings[i]);
+   }
+   REQUIRE(std::equal(deque.begin(), deque.end(), dequeOut.begin(), dequeOut.end()));
+   REQUIRE(std::equal(list.begin(), list.end(), listOut.begin(), listOut.end()));
+   REQUIRE(iotaOut.size() == 17);
+   REQUIRE(iotaOut[16] == 16);
+
+   bool flag;
+   std::string manual;
+   std::span<const pack::Byte> rest = std::span<const pack::Byte>(buffer).subspan(
+       unpacker.ByteCount());
+   REQUIRE(rest[0] == (pack::FIXARR_MASK | 2));
+   pack::SpanUnpacker tail {rest.subspan(1)};
+   tail.Deserialize(flag, manual);
+   REQUIRE(flag);
+   REQUIRE(manual == "manual");
+}
+
+TEST_CASE("Vector Reuse") {
+   std::vector<std::string> strings = {StringOfSize(40), StringOfSize(50), StringOfSize(60)};
+   std::vector<std::vector<int>> nested = {{1, 2, 3}, std::vector<int>(100, 9), {}};
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(strings, nested);
+   }
+
+   std::vector<std::string> stringsOut;
+   std::vector<std::vector<int>> nestedOut;
+   {
+      pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+      unpacker.Deserialize(stringsOut, nestedOut);
+   }
+   REQUIRE(nestedOut == nested);
+   const char *stringData = stringsOut[2].data();
+   const int *nestedData = nestedOut[1].data();
+   const std::string *outer = stringsOut.data();
+
+   // Decoding the same shape again reuses every buffer.
+   {
+      pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+      unpacker.Deserialize(stringsOut, nestedOut);
+   }
+   REQUIRE(nestedOut == nested);
+   REQUIRE(stringsOut.data() == outer);
+   REQUIRE(stringsOut[2].data() == stringData);
+   REQUIRE(nestedOut[1].data() == nestedData);
+
+   // Malicious headers must not allocate for elements that can't be there.
+   pack::ByteArray hostile = {pack::Formats::ARR32, 0xff, 0xff, 0xff, 0xff, 1, 2, 3};
+   {
+      pack::SpanUnpacker unpacker {std::span<const pack::Byte>(hostile)};
+      std::vector<uint64_t> out;
+      REQUIRE_THROWS_AS(unpacker.Deserialize(out), std::invalid_argument);
+      REQUIRE(out.capacity() == 0);
+      REQUIRE(unpacker.ByteCount() == 0);
+   }
+   {
+      std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+      stream.write((const char *)hostile.data(), hostile.size());
+      pack::Unpacker unpacker(stream);
+      std::vector<uint64_t> out;
+      REQUIRE_THROWS_AS(unpacker.Deserialize(out), std::invalid_argument);
+      REQUIRE(out.capacity() * sizeof(uint64_t) <= pack::MAX_UNTRUSTED_RESERVE);
+   }
+
+   // Streams still decode arrays larger than the up front reservation.
+   std::vector<uint64_t> large(pack::MAX_UNTRUSTED_RESERVE / sizeof(uint64_t) * 3 + 5);
+   for (size_t i = 0; i < large.size(); i++) { large[i] = i * 31; }
+   std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+   {
+      pack::Packer packer(stream);
+      packer.Serialize(large);
+   }
+   pack::Unpacker unpacker(stream);
+   std::vector<uint64_t> largeOut;
+   unpacker.Deserialize(largeOut);
+   REQUIRE(largeOut == large);
+}
+
+TEST_CASE("Memory Resources") {
+   std::vector<std::string> names = {StringOfSize(40), StringOfSize(3), StringOfSize(100)};
+   std::map<std::string, std::vector<int>> groups = {{StringOfSize(30), {1, 2, 3}},
+                                                     {StringOfSize(31), {4, 5}}};
+   std::string note = StringOfSize(64);
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(names, groups, groups, note);
+   }
+
+   std::array<std::byte, 4096> storage;
+   std::pmr::monotonic_buffer_resource arena(storage.data(), storage.size(),
+                                             std::pmr::null_memory_resource());
+   // Anything not drawn from the arena would come from here, and fail.
+   std::pmr::memory_resource *previous =
+       std::pmr::set_default_resource(std::pmr::null_memory_resource());
+
+   std::pmr::vector<std::pmr::string> namesOut(&arena);
+   std::pmr::map<std::pmr::string, std::pmr::vector<int>> groupsOut(&arena);
+   std::pmr::vector<std::pair<std::pmr::string, std::pmr::vector<int>>> flatOut(&arena);
+   std::pmr::string text(&arena);
+   pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+   REQUIRE_NOTHROW(unpacker.Deserialize(namesOut, groupsOut, flatOut, text));
+   std::pmr::set_default_resource(previous);
+
+   REQUIRE(namesOut.size() == names.size());
+   for (size_t i = 0; i < names.size(); i++) {
+      REQUIRE(std::string_view(namesOut[i]) == names[i]);
+   }
+   REQUIRE(groupsOut.size() == 2);
+   REQUIRE(flatOut.size() == 2);
+   for (auto &[key, value] : flatOut) {
+      REQUIRE(groupsOut.at(key) == value);
+      REQUIRE(std::ranges::equal(groups.at(std::string(key.c_str())), value));
+   }
+   REQUIRE(std::string_view(text) == note);
+}
+
+TEST_CASE("Maps") {
+   std::map<std::string, int> ordered = {{"one", 1}, {"two", 2}, {"three", -3}};
+   std::unordered_map<int, std::vector<int>> hashed = {{5, {1, 2}}, {-7, {}}};
+   std::map<int, bool> large;
+   for (int i = 0; i < 300; i++) { large[i * 3] = i % 2 == 0; }
+   std::vector<std::pair<int, double>> unsorted = {{9, 0.5}, {2, 1.5}, {5, 2.5}};
+
+   std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+   {
+      pack::Packer packer(stream);
+      packer.Serialize(ordered, hashed, large, unsorted);
+      REQUIRE(packer.ByteCount() > 0);
+      size_t before = packer.ByteCount();
+      packer.Serialize(std::map<int, int> {});
+      REQUIRE(packer.ByteCount() == before + 1);
+
+      // Encode from an iterator, with the entry count supplied up front.
+      std::list<std::pair<int, int>> entries = {{1, 10}, {2, 20}};
+      packer.SerializeMap(entries.begin(), entries.size());
+   }
+
+   std::string encoded = stream.str();
+   REQUIRE((pack::Byte)encoded[0] == (pack::FIXMAP_MASK | 3));
+
+   {
+      pack::Unpacker unpacker(stream);
+      std::map<std::string, int> orderedOut;
+      std::unordered_map<int, std::vector<int>> hashedOut;
+      std::map<int, bool> largeOut;
+      std::vector<std::pair<int, double>> unsortedOut;
+      std::map<int, int> emptyOut = {{1, 1}};
+      std::vector<std::pair<int, int>> entriesOut;
+      unpacker.Deserialize(orderedOut, hashedOut, largeOut, unsortedOut, emptyOut, entriesOut);
+      REQUIRE(orderedOut.size() == 3);
+      auto ordIt = orderedOut.begin();
+      for (const auto &[key, value] : ordered) {
+         REQUIRE(ordIt->first == key);
+         REQUIRE((ordIt++)->second == value);
+      }
+      REQUIRE(hashedOut.size() == 2);
+      REQUIRE(hashedOut[5] == std::vector<int> {1, 2});
+      REQUIRE(largeOut == large);
+      REQUIRE(emptyOut.empty());
+      REQUIRE(entriesOut == std::vector<std::pair<int, int>> {{1, 10}, {2, 20}});
+      // Flat maps come out sorted by key.
+      REQUIRE(unsortedOut == std::vector<std::pair<int, double>> {{2, 1.5}, {5, 2.5}, {9, 0.5}});
+   }
+
+   {
+      // Decoding a flat map from a sorted source fills it in one pass, in place.
+      std::span<const pack::Byte> bytes((const pack::Byte *)encoded.data(), encoded.size());
+      pack::SpanUnpacker unpacker {bytes};
+      std::vector<std::pair<std::string, int>> flat;
+      flat.reserve(3);
+      const auto *storage = flat.data();
+      unpacker.Deserialize(flat);
+      REQUIRE(flat.data() == storage);
+      REQUIRE(flat[0].first == "one");
+      REQUIRE(flat[1].first == "three");
+      REQUIRE(flat[2].second == 2);
+
+      std::vector<int> notMap;
+      REQUIRE_THROWS_AS(unpacker.Deserialize(notMap), std::runtime_error);
+      size_t count;
+      unpacker.DeserializeMapHeader(count);
+      REQUIRE(count == 2);
+   }
+
+   pack::ByteArray hostile = {pack::Formats::MAP32, 0x10, 0, 0, 0, 1, 2};
+   pack::SpanUnpacker unpacker {std::span<const pack::Byte>(hostile)};
+   std::vector<std::pair<int, int>> flat;
+   REQUIRE_THROWS_AS(unpacker.Deserialize(flat), std::invalid_argument);
+   REQUIRE(flat.capacity() == 0);
+}
+
+struct Vec3 {
+   float x;
+   float y;
+   float z;
+   PACK_AS_ARRAY(x, y, z)
+   bool operator==(const Vec3 &) const = default;
+};
+
+struct Telemetry {
+   std::string name;
+   uint32_t sequence;
+   Vec3 position;
+   std::vector<int> samples;
+   PACK_AS_MAP(name, sequence,
+               position, samples)
+};
+
+// Described without touching the type.
+struct External {
+   int a;
+   bool b;
+};
+
+template<>
+struct pack::Describe<External> {
+   static auto Tie(External &val) { return std::tie(val.a, val.b); }
+   static auto Tie(const External &val) { return std::tie(val.a, val.b); }
+   static constexpr Layout layout = Layout::Array;
+   static constexpr std::string_view names = "a, b";
+};
+
+TEST_CASE("Described Structs") {
+   using Layout = pack::StructLayout<Telemetry>;
+   static_assert(Layout::COUNT == 4);
+   static_assert(Layout::NAMES[2] == "position");
+   static_assert(Layout::SEGMENT_BYTES[0] == (pack::FIXMAP_MASK | 4));
+   static_assert(Layout::SEGMENT_BYTES[1] == (pack::FIXSTR_MASK | 4));
+   static_assert(pack::StructLayout<Vec3>::SEGMENT_BYTES.size() == 1);
+
+   Telemetry in {"probe", 77, {1.0f, -2.0f, 3.5f}, {1, 2, 3}};
+   External ext {-40, true};
+   std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+   {
+      pack::Packer packer(stream);
+      packer.Serialize(in, ext);
+   }
+
+   // Must be the same bytes as a map built by hand.
+   std::stringstream manual(std::ios::binary | std::ios::out | std::ios::in);
+   {
+      pack::Packer packer(manual);
+      packer.SerializeMapHeader(4);
+      packer.Serialize("name", in.name, "sequence", in.sequence, "position");
+      packer.Serialize(std::array<float, 3> {1.0f, -2.0f, 3.5f});
+      packer.Serialize("samples", in.samples);
+      packer.SerializeArrayHeader(2);
+      packer.Serialize(ext.a, ext.b);
+   }
+   REQUIRE(stream.str() == manual.str());
+
+   {
+      pack::Unpacker unpacker(stream);
+      Telemetry out {};
+      External extOut {};
+      unpacker.Deserialize(out, extOut);
+      REQUIRE(out.name == "probe");
+      REQUIRE(out.sequence == 77);
+      REQUIRE(out.position.z == 3.5f);
+      REQUIRE(out.samples == in.samples);
+      REQUIRE(extOut.a == -40);
+      REQUIRE(extOut.b);
+   }
+
+   // Keys may arrive in any order.
+   pack::ByteArray reordered;
+   {
+      pack::BufferPacker packer(reordered);
+      packer.SerializeMapHeader(4);
+      packer.Serialize("samples", std::vector<int> {9}, "position", in.position);
+      packer.Serialize("sequence", 5u, "name", "x");
+   }
+   pack::SpanUnpacker unpacker {std::span<const pack::Byte>(reordered)};
+   Telemetry out {};
+   unpacker.Deserialize(out);
+   REQUIRE(out.samples == std::vector<int> {9});
+   REQUIRE(out.sequence == 5);
+   REQUIRE(out.position.y == -2.0f);
+
+   pack::ByteArray wrong;
+   {
+      pack::BufferPacker packer(wrong);
+      packer.Serialize(std::vector<float> {1.0f, 2.0f});
+   }
+   pack::SpanUnpacker wrongUnpacker {std::span<const pack::Byte>(wrong)};
+   Vec3 vec;
+   REQUIRE_THROWS_AS(wrongUnpacker.Deserialize(vec), std::runtime_error);
+   REQUIRE(wrongUnpacker.ByteCount() == 0);
+}
+
+TEST_CASE("Try Deserialize") {
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(300u, "name", std::vector<int> {1, 2, -3}, -5);
+   }
+
+   pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+   bool flag;
+   uint8_t small;
+   REQUIRE(unpacker.TryDeserialize(flag) == pack::Errc::TypeMismatch);
+   REQUIRE(unpacker.TryDeserialize(small) == pack::Errc::Narrowing);
+   REQUIRE(unpacker.ByteCount() == 0);
+
+   uint16_t value;
+   std::string_view name;
+   REQUIRE(unpacker.TryDeserialize(value, name) == pack::Errc::Ok);
+   REQUIRE(value == 300);
+   REQUIRE(name == "name");
+
+   // A failure part way through an array puts back the whole array.
+   size_t start = unpacker.ByteCount();
+   std::vector<unsigned> unsignedOut;
+   REQUIRE(unpacker.TryDeserialize(unsignedOut) == pack::Errc::TypeMismatch);
+   REQUIRE(unpacker.ByteCount() == start);
+
+   // As does a failure on a later value in the same call.
+   std::vector<int> ints;
+   std::string str;
+   REQUIRE(unpacker.TryDeserialize(ints, str) == pack::Errc::TypeMismatch);
+   REQUIRE(unpacker.ByteCount() == start);
+
+   int last;
+   REQUIRE(unpacker.TryDeserialize(ints, last) == pack::Errc::Ok);
+   REQUIRE(ints == std::vector<int> {1, 2, -3});
+   REQUIRE(last == -5);
+   REQUIRE(unpacker.TryDeserialize(last) == pack::Errc::EndOfData);
+
+   int fixed[2];
+   pack::SpanUnpacker arrays {std::span<const pack::Byte>(buffer)};
+   arrays.Deserialize(value, name);
+   REQUIRE(arrays.TryDeserialize(fixed) == pack::Errc::OutputTooSmall);
+   REQUIRE_THROWS_AS(arrays.Deserialize(fixed), std::length_error);
+
+   // Streams put back a failed array too.
+   std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+   stream.write((const char *)buffer.data(), buffer.size());
+   pack::Unpacker streamUnpacker(stream);
+   streamUnpacker.Deserialize(value, str);
+   start = streamUnpacker.ByteCount();
+   REQUIRE(streamUnpacker.TryDeserialize(unsignedOut) == pack::Errc::TypeMismatch);
+   REQUIRE(streamUnpacker.ByteCount() == start);
+   REQUIRE(streamUnpacker.TryDeserialize(ints) == pack::Errc::Ok);
+   REQUIRE(ints.size() == 3);
+}
+
+TEST_CASE("Packed Size") {
+   static_assert(pack::PackedSize(true, 127u, 128u, -32, -33, 3.0f, 3.0) ==
+                 1 + 1 + 2 + 1 + 2 + 5 + 9);
+   static_assert(pack::PackedSize("hello") == 6);
+   static_assert(pack::PackedSize(std::array<uint16_t, 3> {1, 300, 70}) == 1 + 1 + 3 + 1);
+   static_assert(pack::PackedSize(Vec3 {1.0f, 2.0f, 3.0f}) == 1 + 3 * 5);
+   static_assert(pack::MAX_PACKED_SIZE<Vec3> == pack::PackedSize(Vec3 {}));
+   static_assert(pack::MAX_PACKED_SIZE<std::array<int64_t, 20>> == 3 + 20 * 9);
+   static_assert(pack::MAX_PACKED_SIZE<int8_t[4]> == 1 + 4 * 2);
+   static_assert(pack::MAX_PACKED_SIZE<uint8_t[4]> == 2 + 4);
+   static_assert(pack::MAX_PACKED_SIZE<std::array<std::byte, 300>> == 3 + 300);
+
+   auto check = [](const auto &...values) {
+      pack::ByteArray buffer;
+      {
+         pack::BufferPacker packer(buffer);
+         packer.Serialize(values...);
+      }
+      REQUIRE(pack::PackedSize(values...) == buffer.size());
+   };
+
+   for (uint64_t val : std::initializer_list<uint64_t> {0ull, 127ull, 128ull, 255ull, 256ull, 65535ull, 65536ull,
+                        4294967295ull, 4294967296ull, UINT64_MAX}) {
+      check(val);
+   }
+   for (int64_t val : std::initializer_list<int64_t> {0ll, -1ll, -32ll, -33ll, -128ll, -129ll, 127ll, 128ll, -32768ll,
+                       -32769ll, 32768ll, (int64_t)INT32_MIN, INT32_MIN - 1ll, INT64_MIN,
+                       INT64_MAX}) {
+      check(val);
+   }
+   for (size_t len : std::initializer_list<size_t> {0, 31, 32, 255, 256, 65535, 65536}) {
+      check(std::string(len, 'x'));
+      check(std::vector<bool>(len, true));
+   }
+   check(std::vector<std::vector<int>> {{1, -200}, {}, {70000}});
+   check(std::deque<float> {1.0f, 2.0f});
+   check(std::map<std::string, double> {{"a", 1.0}, {"bb", 2.0}});
+
+   Telemetry telemetry {"probe", 77, {1.0f, -2.0f, 3.5f}, {1, 2, 3}};
+   External ext {-40, true};
+   check(telemetry, ext, Vec3 {});
+}
+
+TEST_CASE("Buffered Stream Sink") {
+   std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+   {
+      pack::BasicPacker<pack::BasicStreamSink<8>> packer(stream);
+      packer.Serialize(1, 2, 3);
+      REQUIRE(packer.ByteCount() == 3);
+      REQUIRE(stream.str().empty());
+
+      // The payload spills the buffer, then is buffered itself.
+      packer.Serialize("abcdef");
+      REQUIRE(stream.str().size() == 4);
+      REQUIRE(packer.ByteCount() == 10);
+
+      // Too big for the buffer, so written straight through.
+      packer.Serialize(std::string(20, 'x'));
+      REQUIRE(stream.str().size() == 31);
+
+      packer.Serialize(true);
+      packer.Flush();
+      REQUIRE(stream.str().size() == 32);
+      packer.Serialize(false);
+   }
+   REQUIRE(stream.str().size() == 33);
+
+   {
+      pack::Unpacker unpacker(stream);
+      int a, b, c;
+      std::string shortStr, longStr;
+      bool t, f;
+      unpacker.Deserialize(a, b, c, shortStr, longStr, t, f);
+      REQUIRE(c == 3);
+      REQUIRE(longStr.size() == 20);
+      REQUIRE(t);
+      REQUIRE_FALSE(f);
+   }
+
+   {
+      std::stringstream direct(std::ios::binary | std::ios::out | std::ios::in);
+      pack::BasicPacker<pack::BasicStreamSink<0>> packer(direct);
+      packer.Serialize(100000u);
+      REQUIRE(direct.str().size() == 5);
+   }
+
+   std::ostream broken(nullptr);
+   pack::Packer failing(broken);
+   failing.Serialize(1);
+   REQUIRE_THROWS_AS(failing.Flush(), std::runtime_error);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+TEST_CASE("Mapped Files") {
+   std::filesystem::path path = std::filesystem::temp_directory_path() / "pack_mapped.bin";
+   std::vector<float> samples(10000, 0.25f);
+   {
+      // Starts far too small, so has to grow several times.
+      pack::MappedPacker packer(path, 16);
+      packer.Serialize("replay", samples, 42);
+      packer.Flush();
+      packer.Serialize(std::string(500, 'z'));
+   }
+   REQUIRE(std::filesystem::file_size(path) == pack::PackedSize("replay", samples, 42) +
+                                                   pack::PackedSize(std::string(500, 'z')));
+
+   {
+      pack::MappedUnpacker unpacker(path);
+      std::string_view name;
+      std::vector<float> samplesOut;
+      int answer;
+      std::string_view padding;
+      unpacker.Deserialize(name, samplesOut, answer, padding);
+      REQUIRE(name == "replay");
+      REQUIRE(samplesOut == samples);
+      REQUIRE(answer == 42);
+      REQUIRE(padding.size() == 500);
+      REQUIRE(unpacker.TryDeserialize(answer) == pack::Errc::EndOfData);
+   }
+
+   {
+      pack::MappedPacker empty(path);
+   }
+   pack::MappedUnpacker emptyUnpacker(path);
+   int value;
+   REQUIRE(emptyUnpacker.TryDeserialize(value) == pack::Errc::EndOfData);
+   std::filesystem::remove(path);
+
+   REQUIRE_THROWS_AS(pack::MappedUnpacker(path), std::runtime_error);
+
+   // A failure to grow leaves what was written, and the sink can carry on.
+   {
+      pack::MappedSink sink(path, 16);
+      sink.Write((const pack::Byte *)"abc", 3);
+      REQUIRE_THROWS_AS(sink.Reserve(SIZE_MAX / 2), std::runtime_error);
+      sink.Write((const pack::Byte *)"defghijklmnopqrstuvwxyz", 23);
+   }
+   std::string letters(26, '\0');
+   std::ifstream(path, std::ios::binary).read(letters.data(), letters.size());
+   REQUIRE(letters == "abcdefghijklmnopqrstuvwxyz");
+   REQUIRE(std::filesystem::file_size(path) == 26);
+
+   // A file that can't be grown to the initial capacity is closed again.
+   int before = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+   ::close(before);
+   REQUIRE_THROWS_AS(pack::MappedPacker(path, SIZE_MAX), std::runtime_error);
+   int after = ::open("/dev/null", O_RDONLY | O_CLOEXEC);
+   ::close(after);
+   REQUIRE(after == before);
+   std::filesystem::remove(path);
+}
+#endif
+
+TEST_CASE("Incremental Unpacker") {
+   Telemetry first {"first", 1, {1.0f, 2.0f, 3.0f}, std::vector<int>(1000, 7)};
+   std::map<std::string, std::vector<std::string>> second {{"a", {"x", "yy"}}, {"b", {}}};
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(first, second, std::string(300, 'q'), 5);
+   }
+
+   // Deliver the data in awkward pieces, including one byte at a time.
+   pack::IncrementalUnpacker unpacker;
+   std::vector<size_t> objectSizes;
+   size_t offset = 0;
+   for (size_t chunk : {1, 1, 1, 2, 3, 700, 1, 64, 1000000}) {
+      size_t len = std::min(chunk, buffer.size() - offset);
+      unpacker.Feed(std::span<const pack::Byte>(buffer).subspan(offset, len));
+      offset += len;
+
+      std::span<const pack::Byte> object;
+      pack::Errc err;
+      while ((err = unpacker.Next(object)) == pack::Errc::Ok) {
+         objectSizes.push_back(object.size());
+      }
+      REQUIRE(err == pack::Errc::EndOfData);
+   }
+   REQUIRE(objectSizes == std::vector<size_t> {pack::PackedSize(first),
+                                               pack::PackedSize(second), 303, 1});
+   REQUIRE(unpacker.Buffered() == 0);
+
+   // Typed decode, only taking values once they're complete and match.
+   pack::IncrementalUnpacker typed;
+   typed.Feed(std::span<const pack::Byte>(buffer).first(10));
+   Telemetry out;
+   REQUIRE(typed.TryDeserialize(out) == pack::Errc::EndOfData);
+   typed.Feed(std::span<const pack::Byte>(buffer).subspan(10));
+   REQUIRE(typed.TryDeserialize(out) == pack::Errc::Ok);
+   REQUIRE(out.samples.size() == 1000);
+   int number;
+   REQUIRE(typed.TryDeserialize(number) == pack::Errc::TypeMismatch);
+   decltype(second) secondOut;
+   REQUIRE(typed.TryDeserialize(secondOut) == pack::Errc::Ok);
+   REQUIRE(secondOut.size() == 2);
+
+   pack::IncrementalUnpacker invalid;
+   const pack::Byte bad[] = {0x92, 0x01, 0xc1};
+   invalid.Feed(bad);
+   std::span<const pack::Byte> object;
+   REQUIRE(invalid.Next(object) == pack::Errc::TypeMismatch);
+   invalid.Clear();
+   REQUIRE(invalid.Next(object) == pack::Errc::EndOfData);
+}
+
+TEST_CASE("Views") {
+   Telemetry telemetry {"probe", 77, {1.0f, -2.0f, 3.5f}, {1, 2, 3}};
+   std::map<std::string, std::vector<std::string>> tags {{"a", {"x", "yy"}}, {"b", {}}};
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(telemetry, tags, 12);
+   }
+
+   for (bool index : {true, false}) {
+      pack::View view(buffer, index);
+      REQUIRE(view.Type() == pack::Family::Map);
+      REQUIRE(view.Size() == 4);
+      REQUIRE(view.Key(1).As<std::string_view>() == "sequence");
+      REQUIRE(view["sequence"].As<uint32_t>() == 77);
+      REQUIRE(view["position"].Type() == pack::Family::Array);
+      REQUIRE(view["position"][2].As<float>() == 3.5f);
+      REQUIRE(view[3][1].As<int>() == 2);
+      REQUIRE(view["name"].Size() == 5);
+      REQUIRE(view["samples"].As<std::vector<int>>() == telemetry.samples);
+      REQUIRE_FALSE(view.Find("missing"));
+      REQUIRE_THROWS_AS(view["missing"], std::out_of_range);
+      REQUIRE_THROWS_AS(view[4], std::out_of_range);
+      REQUIRE_THROWS_AS(view["name"][0], std::runtime_error);
+      REQUIRE(view.Encoded().size() == pack::PackedSize(telemetry));
+
+      int number;
+      REQUIRE(view.TryAs(number) == pack::Errc::TypeMismatch);
+
+      pack::View second = view.Next();
+      REQUIRE(second["a"][1].As<std::string_view>() == "yy");
+      REQUIRE(second["b"].Size() == 0);
+      REQUIRE(second.Next().As<int>() == 12);
+      REQUIRE(second.Next().Next().Type() == pack::Family::Invalid);
+   }
+
+   // The first of duplicate keys wins, whatever order keys are looked up in, and keys 
+   // that aren't strings are passed over.
+   pack::ByteArray entries;
+   {
+      pack::BufferPacker packer(entries);
+      packer.SerializeMapHeader(4);
+      packer.Serialize("key", 1, 5, 2, "key", 3, "last", 4);
+   }
+   pack::View ordered(entries), reversed(entries);
+   REQUIRE(ordered["key"].As<int>() == 1);
+   REQUIRE(ordered["last"].As<int>() == 4);
+   REQUIRE(reversed["last"].As<int>() == 4);
+   REQUIRE(reversed["key"].As<int>() == 1);
+   REQUIRE(reversed["key"].As<int>() == 1);
+   REQUIRE_FALSE(reversed.Find("5"));
+
+   // Truncated data is caught when it is walked over.
+   pack::View truncated(std::span<const pack::Byte>(buffer).first(20));
+   REQUIRE(truncated.Key(0).As<std::string_view>() == "name");
+   REQUIRE_THROWS_AS(truncated["samples"], std::invalid_argument);
+}
+
+TEST_CASE("Skip and Validate") {
+   Telemetry telemetry {"probe", 77, {1.0f, -2.0f, 3.5f}, {1, 2, 3}};
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(telemetry, std::string(70000, 's'), std::vector<double>(300, 1.5), -1);
+   }
+   const pack::Byte exts[] = {0xd4, 0x01, 0xff, 0xc7, 0x02, 0x05, 0xaa, 0xbb, 0xc0, 0xc4,
+                              0x01, 0x00};
+   buffer.insert(buffer.end(), std::begin(exts), std::end(exts));
+
+   REQUIRE(pack::Validate(buffer) == pack::Errc::Ok);
+   for (size_t len = 1; len < pack::PackedSize(telemetry); len++) {
+      REQUIRE(pack::Validate(std::span(buffer).first(len)) == pack::Errc::EndOfData);
+   }
+   REQUIRE(pack::Validate(std::span(buffer).first(buffer.size() - 1)) == pack::Errc::EndOfData);
+   const pack::Byte invalid[] = {0x92, 0x01, 0xc1};
+   REQUIRE(pack::Validate(invalid) == pack::Errc::TypeMismatch);
+   const pack::Byte hugeCount[] = {0xdd, 0xff, 0xff, 0xff, 0xff, 0x01};
+   REQUIRE(pack::Validate(hugeCount) == pack::Errc::EndOfData);
+
+   std::span<const pack::Byte> rest(buffer);
+   REQUIRE(pack::Skip(rest) == pack::Errc::Ok);
+   REQUIRE(rest.size() == buffer.size() - pack::PackedSize(telemetry));
+
+   // Skipping through an unpacker, both contiguous and streamed.
+   std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+   stream.write((const char *)buffer.data(), buffer.size());
+   pack::SpanUnpacker spanUnpacker {std::span<const pack::Byte>(buffer)};
+   pack::Unpacker streamUnpacker(stream);
+   auto check = [](auto &unpacker) {
+      unpacker.Skip();
+      unpacker.Skip();
+      std::vector<double> doubles;
+      unpacker.Deserialize(doubles);
+      REQUIRE(doubles.size() == 300);
+      for (int i = 0; i < 5; i++) { REQUIRE(unpacker.TrySkip() == pack::Errc::Ok); }
+      size_t end = unpacker.ByteCount();
+      REQUIRE(unpacker.TrySkip() == pack::Errc::EndOfData);
+      REQUIRE(unpacker.ByteCount() == end);
+   };
+   check(spanUnpacker);
+   check(streamUnpacker);
+
+   // Validated data can be decoded without end of data checks.
+   pack::TrustedUnpacker trusted {std::span<const pack::Byte>(buffer)};
+   Telemetry out;
+   std::string str;
+   trusted.Deserialize(out, str);
+   REQUIRE(out.sequence == 77);
+   REQUIRE(str.size() == 70000);
+
+   // Reading past the last value is still caught.
+   pack::TrustedUnpacker last {std::span<const pack::Byte>(buffer).first(trusted.ByteCount())};
+   last.Deserialize(out, str);
+   int extra;
+   REQUIRE(last.TryDeserialize(extra) == pack::Errc::EndOfData);
+   REQUIRE(last.TryDeserialize(str) == pack::Errc::EndOfData);
+   REQUIRE(last.TrySkip() == pack::Errc::EndOfData);
+}
+
+struct TelemetryV2 {
+   uint32_t sequence;
+   std::string name;
+   bool flag = false;
+   PACK_AS_MAP(sequence, name, flag)
+};
+
+TEST_CASE("Struct Versioning") {
+   // Unknown fields are skipped, and missing ones left alone.
+   Telemetry telemetry {"probe", 77, {1.0f, -2.0f, 3.5f}, {1, 2, 3}};
+   std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+   {
+      pack::Packer packer(stream);
+      packer.Serialize(telemetry);
+      packer.SerializeMapHeader(2);
+      packer.Serialize(std::string(300, 'k'), 1, "sequence", 5);
+   }
+
+   pack::Unpacker unpacker(stream);
+   TelemetryV2 v2 {0, "", true};
+   unpacker.Deserialize(v2);
+   REQUIRE(v2.sequence == 77);
+   REQUIRE(v2.name == "probe");
+   REQUIRE(v2.flag);
+   unpacker.Deserialize(v2);
+   REQUIRE(v2.sequence == 5);
+}
+
+struct Rgb {
+   uint8_t r, g, b;
+   bool operator==(const Rgb &) const = default;
+};
+
+template<>
+struct pack::Extension<Rgb> {
+   static constexpr int8_t TYPE = 7;
+   static constexpr size_t Size(const Rgb &) { return 3; }
+   static void Encode(const Rgb &val, auto &&write) {
+      const Byte bytes[] = {val.r, val.g, val.b};
+      write(bytes, 3);
+   }
+   static Errc Decode(std::span<const Byte> payload, Rgb &out) {
+      if (payload.size() != 3) { return Errc::TypeMismatch; }
+      out = {payload[0], payload[1], payload[2]};
+      return Errc::Ok;
+   }
+};
+
+TEST_CASE("Extensions") {
+   using namespace std::chrono;
+   sys_seconds secs32 {seconds(1)};
+   system_clock::time_point secs64 = sys_seconds {seconds(int64_t(1) << 33)} + nanoseconds(999999999);
+   system_clock::time_point before = sys_seconds {seconds(-1)} + nanoseconds(5);
+   sys_seconds after {seconds(int64_t(1) << 40)};
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(secs32, secs64, before, after, Rgb {1, 2, 3});
+   }
+   REQUIRE(pack::Validate(buffer) == pack::Errc::Ok);
+   REQUIRE(buffer.size() == pack::PackedSize(secs32, secs64, before, after, Rgb {1, 2, 3}));
+   // Timestamp 32, 64 and 96, as given in the specification.
+   REQUIRE(pack::ByteArray(buffer.begin(), buffer.begin() + 6) ==
+           pack::ByteArray {0xd6, 0xff, 0, 0, 0, 1});
+   REQUIRE(buffer[6] == pack::Formats::FIXEXT8);
+   REQUIRE(buffer[16] == pack::Formats::EXT8);
+   REQUIRE(buffer[17] == 12);
+   REQUIRE(buffer[18] == 0xff);
+
+   auto check = [&](auto &unpacker) {
+      sys_seconds secs32Out;
+      system_clock::time_point secs64Out, beforeOut;
+      sys_days afterOut;
+      Rgb rgb;
+      unpacker.Deserialize(secs32Out, secs64Out, beforeOut);
+      REQUIRE(secs32Out == secs32);
+      REQUIRE(secs64Out == secs64);
+      REQUIRE(beforeOut == before);
+
+      // A different extension type consumes nothing.
+      REQUIRE(unpacker.TryDeserialize(rgb) == pack::Errc::TypeMismatch);
+      unpacker.Deserialize(afterOut, rgb);
+      REQUIRE(afterOut == floor<days>(after));
+      REQUIRE(rgb == Rgb {1, 2, 3});
+   };
+   pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+   check(unpacker);
+
+   std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+   stream.write((const char *)buffer.data(), buffer.size());
+   pack::Unpacker streamUnpacker(stream);
+   check(streamUnpacker);
+
+   // Invalid payloads are rejected without consuming anything.
+   const pack::Byte badNanos[] = {0xd7, 0xff, 0xff, 0xff, 0xff, 0xff, 0, 0, 0, 0};
+   const pack::Byte badSize[] = {0xd5, 0xff, 0, 0};
+   for (std::span<const pack::Byte> bad : {std::span<const pack::Byte>(badNanos),
+                                           std::span<const pack::Byte>(badSize)}) {
+      pack::SpanUnpacker badUnpacker {bad};
+      system_clock::time_point out;
+      REQUIRE(badUnpacker.TryDeserialize(out) == pack::Errc::TypeMismatch);
+      REQUIRE(badUnpacker.ByteCount() == 0);
+   }
+}
+
+TEST_CASE("Typed Arrays") {
+   std::vector<float> floats(1000);
+   std::vector<int32_t> ints(77);
+   std::vector<uint64_t> longs(300);
+   for (size_t i = 0; i < floats.size(); i++) { floats[i] = (float)i * -0.25f; }
+   for (size_t i = 0; i < ints.size(); i++) { ints[i] = (int32_t)(i * 100000) - 3000000; }
+   for (size_t i = 0; i < longs.size(); i++) { longs[i] = i << 40 | i; }
+
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      // Each array lands misaligned without its padding.
+      packer.Serialize(true, pack::TypedArray(floats), pack::TypedArray(ints), 1,
+                       pack::TypedArray(longs), pack::TypedArray(std::vector<double> {}));
+   }
+   REQUIRE(pack::Validate(buffer) == pack::Errc::Ok);
+   REQUIRE(buffer.size() <= pack::PackedSize(true, pack::TypedArray(floats),
+                                             pack::TypedArray(ints), 1,
+                                             pack::TypedArray(longs),
+                                             pack::TypedArray(std::vector<double> {})));
+   REQUIRE(buffer.size() < pack::PackedSize(true, floats, ints, 1, longs));
+
+   {
+      // Borrowed in place, and copied out.
+      pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+      bool flag;
+      std::span<const float> floatView;
+      std::vector<int32_t> intsOut;
+      int one;
+      std::span<const uint64_t> longView;
+      std::vector<double> empty = {1.0};
+      unpacker.Deserialize(flag, floatView, intsOut, one, longView, empty);
+      REQUIRE(std::ranges::equal(floatView, floats));
+      REQUIRE((const pack::Byte *)floatView.data() > buffer.data());
+      REQUIRE((const pack::Byte *)floatView.data() < buffer.data() + buffer.size());
+      REQUIRE(intsOut == ints);
+      REQUIRE(std::ranges::equal(longView, longs));
+      REQUIRE(empty.empty());
+   }
+
+   {
+      // The wrong element type consumes nothing, even when only the width differs.
+      pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer).subspan(1)};
+      std::vector<int32_t> wrong;
+      std::span<const double> wrongView;
+      std::vector<float> right;
+      REQUIRE(unpacker.TryDeserialize(wrong) == pack::Errc::TypeMismatch);
+      REQUIRE(unpacker.TryDeserialize(wrongView) == pack::Errc::TypeMismatch);
+      REQUIRE(unpacker.ByteCount() == 0);
+      unpacker.Deserialize(right);
+      REQUIRE(right == floats);
+   }
+
+   {
+      // Moved off the alignment it was packed for, the array can only be copied out.
+      pack::ByteArray shifted(buffer.size() + 1);
+      std::memcpy(shifted.data() + 1, buffer.data(), buffer.size());
+      pack::SpanUnpacker unpacker {std::span<const pack::Byte>(shifted).subspan(2)};
+      std::span<const float> floatView;
+      std::vector<float> floatsOut;
+      REQUIRE(unpacker.TryDeserialize(floatView) == pack::Errc::Misaligned);
+      REQUIRE(unpacker.ByteCount() == 0);
+      REQUIRE_THROWS_AS(unpacker.Deserialize(floatView), std::runtime_error);
+      unpacker.Deserialize(floatsOut);
+      REQUIRE(floatsOut == floats);
+   }
+
+   {
+      std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+      stream.write((const char *)buffer.data(), buffer.size());
+      pack::Unpacker unpacker(stream);
+      bool flag;
+      std::vector<float> floatsOut;
+      std::vector<int32_t> intsOut;
+      int one;
+      std::vector<uint64_t> longsOut;
+      unpacker.Deserialize(flag, floatsOut, intsOut, one, longsOut);
+      REQUIRE(floatsOut == floats);
+      REQUIRE(longsOut == longs);
+   }
+
+   // Arrays from a machine of the other byte order are swapped on the way in, but 
+   // can't be borrowed.
+   pack::ByteArray foreign;
+   {
+      pack::BufferPacker packer(foreign);
+      packer.Serialize(pack::TypedArray(ints));
+   }
+   size_t start = foreign.size() - ints.size() * 4;
+   foreign[6] ^= 0x80;
+   for (size_t i = start; i < foreign.size(); i += 4) {
+      std::reverse(foreign.begin() + i, foreign.begin() + i + 4);
+   }
+   pack::SpanUnpacker unpacker {std::span<const pack::Byte>(foreign)};
+   std::span<const int32_t> view;
+   REQUIRE(unpacker.TryDeserialize(view) == pack::Errc::TypeMismatch);
+   std::vector<int32_t> swapped;
+   unpacker.Deserialize(swapped);
+   REQUIRE(swapped == ints);
+}
+
+struct Reading {
+   uint32_t sequence;
+   std::optional<float> value;
+   PACK_AS_ARRAY(sequence, value)
+};
+
+TEST_CASE("Nil, Optional and Variant") {
+   using Value = std::variant<std::monostate, bool, uint32_t, int64_t, double, std::string,
+                              std::vector<uint8_t>, Vec3>;
+   const std::vector<Value> values = {std::monostate {}, true, 7u, -7, (uint32_t)UINT32_MAX,
+                                      (int64_t)INT64_MIN, 2.5, std::string("text"),
+                                      std::vector<uint8_t> {1, 2, 3}, Vec3 {1, 2, 3}};
+   const std::vector<size_t> indices = {0, 1, 2, 3, 2, 3, 4, 5, 6, 7};
+   std::optional<std::string> none, some = "some";
+   Reading readings[] = {{1, std::nullopt}, {2, 0.5f}};
+
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker packer(buffer);
+      packer.Serialize(nullptr, none, some, readings[0], readings[1]);
+      for (const Value &value : values) { packer.Serialize(value); }
+   }
+   REQUIRE(buffer[0] == pack::Formats::NIL);
+   REQUIRE(buffer[1] == pack::Formats::NIL);
+   REQUIRE(pack::Validate(buffer) == pack::Errc::Ok);
+   // Less the header values would have as an array.
+   REQUIRE(buffer.size() == pack::PackedSize(nullptr, none, some, readings[0], readings[1]) +
+                                pack::PackedSize(values) - 1);
+   REQUIRE(pack::PackedSize(readings[0]) == 1 + 1 + 1);
+   static_assert(pack::MAX_PACKED_SIZE<std::optional<uint16_t>> == 3);
+   static_assert(pack::MAX_PACKED_SIZE<std::variant<bool, int64_t, float>> == 9);
+
+   pack::SpanUnpacker unpacker {std::span<const pack::Byte>(buffer)};
+   std::monostate nil;
+   std::optional<std::string> noneOut = "stale", someOut;
+   Reading readingsOut[2] = {{0, 9.0f}, {0, std::nullopt}};
+   unpacker.Deserialize(nil, noneOut, someOut, readingsOut[0], readingsOut[1]);
+   REQUIRE(!noneOut);
+   REQUIRE(someOut == "some");
+   REQUIRE(readingsOut[0].sequence == 1);
+   REQUIRE(!readingsOut[0].value);
+   REQUIRE(readingsOut[1].value == 0.5f);
+
+   // Nil is one format, not a wildcard.
+   std::optional<int> number = 1;
+   REQUIRE(unpacker.TryDeserialize(number) == pack::Errc::Ok);
+   REQUIRE(!number);
+   REQUIRE(unpacker.TryDeserialize(nil) == pack::Errc::TypeMismatch);
+
+   // Each value lands in the first alternative that can hold it, so 7 fits the uint32_t.
+   Value out = std::string("reused");
+   for (size_t i = 1; i < values.size(); i++) {
+      unpacker.Deserialize(out);
+      REQUIRE(out.index() == indices[i]);
+      REQUIRE(out == values[i]);
+   }
+
+   // Nothing fits, and nothing is consumed.
+   std::variant<bool, std::string> narrow;
+   std::variant<uint8_t> tooSmall;
+   pack::ByteArray data;
+   {
+      pack::BufferPacker packer(data);
+      packer.Serialize(3.0, 1000u);
+   }
+   pack::SpanUnpacker mismatched {std::span<const pack::Byte>(data)};
+   REQUIRE(mismatched.TryDeserialize(narrow) == pack::Errc::TypeMismatch);
+   REQUIRE(mismatched.ByteCount() == 0);
+   mismatched.Skip();
+   REQUIRE(mismatched.TryDeserialize(tooSmall) == pack::Errc::Narrowing);
+
+   // Containers of any element type can be alternatives.
+   using Names = std::variant<int, std::vector<std::string>>;
+   using Pair = std::variant<bool, std::array<int, 2>>;
+   const std::vector<Names> names = {4, std::vector<std::string> {"a", "b"}};
+   const Pair pair = std::array<int, 2> {5, 6};
+   pack::ByteArray containers;
+   pack::BufferPacker(containers).Serialize(names, pair);
+   pack::SpanUnpacker containerUnpacker {std::span<const pack::Byte>(containers)};
+   std::vector<Names> namesOut;
+   Pair pairOut;
+   containerUnpacker.Deserialize(namesOut, pairOut);
+   REQUIRE(namesOut == names);
+   REQUIRE(pairOut == pair);
+}
+
+template<typename R>
+concept ParallelSerializable = requires(pack::BufferPacker &packer, const R &range) {
+   pack::SerializeParallel(packer, range);
+};
+
+TEST_CASE("Parallel Encoding") {
+   std::vector<Telemetry> records(20000);
+   for (size_t i = 0; i < records.size(); i++) {
+      records[i].name = StringOfSize(i % 40);
+      records[i].sequence = (uint32_t)i;
+      records[i].position = {(float)i, -(float)i, 0.5f};
+      records[i].samples.assign(i % 7, (int)i);
+   }
+   std::deque<std::string> names;
+   for (size_t i = 0; i < 5000; i++) { names.push_back(StringOfSize(i % 300)); }
+
+   pack::ByteArray expected;
+   {
+      pack::BufferPacker packer(expected);
+      packer.Serialize(1, records, names, std::vector<int> {1, 2, 3});
+   }
+
+   // The split changes with the thread count, but the output never does.
+   for (size_t threads : {0, 1, 2, 3, 8}) {
+      pack::ByteArray buffer;
+      {
+         pack::BufferPacker packer(buffer);
+         packer.Serialize(1);
+         pack::SerializeParallel(packer, records, threads);
+         pack::SerializeParallel(packer, names, threads);
+         pack::SerializeParallel(packer, std::vector<int> {1, 2, 3}, threads);
+      }
+      REQUIRE(buffer == expected);
+   }
+
+   std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+   {
+      pack::Packer packer(stream);
+      pack::SerializeParallel(packer, records, 4);
+   }
+   pack::Unpacker unpacker(stream);
+   std::vector<Telemetry> out;
+   unpacker.Deserialize(out);
+   REQUIRE(out.size() == records.size());
+   REQUIRE(out.back().name == records.back().name);
+   REQUIRE(out.back().samples == records.back().samples);
+
+   // Stats see one call, and the same values, however it was split.
+   pack::ByteArray counted;
+   pack::BasicPacker<pack::BufferSink, pack::CountingStats> serial(counted);
+   serial.Serialize(records);
+   for (size_t threads : {1, 4}) {
+      pack::BasicPacker<pack::BufferSink, pack::CountingStats> parallel(counted);
+      pack::SerializeParallel(parallel, records, threads);
+      REQUIRE(parallel.Stats().calls == 1);
+      REQUIRE(parallel.Stats().values == serial.Stats().values);
+      REQUIRE(parallel.Stats().bytes == serial.Stats().bytes);
+   }
+   static_assert(!ParallelSerializable<std::string>);
+   static_assert(!ParallelSerializable<pack::ByteArray>);
+   static_assert(ParallelSerializable<std::vector<std::string>>);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+TEST_CASE("Batches") {
+   std::string large = StringOfSize(5000);
+   pack::ByteArray blob(3000, 7);
+   pack::BatchPacker packer;
+   for (uint32_t i = 0; i < 100; i++) { packer.Serialize(i, "small"); }
+   packer.Serialize(large, blob, std::string_view(large).substr(0, 10));
+   packer.Serialize(std::vector<int> {1, 2, 3});
+
+   // A failed frame leaves nothing behind.
+   REQUIRE_THROWS_AS(packer.Serialize(1, std::views::iota(uint64_t(0), uint64_t(1) << 33)),
+                     std::invalid_argument);
+   REQUIRE(packer.FrameCount() == 102);
+   size_t expected = 100 * pack::BATCH_FRAME_HEADER + pack::BATCH_FRAME_HEADER * 2 +
+                     pack::PackedSize(std::vector<int> {1, 2, 3}) +
+                     pack::PackedSize(large, blob, std::string_view(large).substr(0, 10));
+   for (uint32_t i = 0; i < 100; i++) { expected += pack::PackedSize(i, "small"); }
+   REQUIRE(packer.ByteCount() == expected);
+
+   // Only the two large payloads are referenced, splitting the arena in three.
+   std::span<const iovec> segments = packer.Segments();
+   REQUIRE(segments.size() == 5);
+   REQUIRE(segments[1].iov_base == large.data());
+   REQUIRE(segments[3].iov_base == blob.data());
+
+   std::filesystem::path path = std::filesystem::temp_directory_path() / "pack_batch.bin";
+   int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+   REQUIRE(fd >= 0);
+   REQUIRE(packer.WriteTo(fd) == expected);
+   ::close(fd);
+   pack::ByteArray received(expected);
+   std::ifstream((path), std::ios::binary).read((char *)received.data(), expected);
+   std::filesystem::remove(path);
+
+   // Received in two parts, splitting a frame.
+   size_t split = received.size() - 3;
+   pack::BatchUnpacker unpacker {std::span<const pack::Byte>(received).first(split)};
+   for (uint32_t i = 0; i < 100; i++) {
+      uint32_t number;
+      std::string_view small;
+      unpacker.Deserialize(number, small);
+      REQUIRE(number == i);
+      REQUIRE(small == "small");
+   }
+   std::string largeOut;
+   pack::ByteArray blobOut;
+   REQUIRE(unpacker.TryDeserialize(blobOut) == pack::Errc::TypeMismatch);
+   unpacker.Deserialize(largeOut, blobOut); // The third value is skipped.
+   REQUIRE(largeOut == large);
+   REQUIRE(blobOut == blob);
+   std::vector<int> numbers;
+   REQUIRE(!unpacker.HasFrame());
+   REQUIRE(unpacker.TryDeserialize(numbers) == pack::Errc::EndOfData);
+   REQUIRE(unpacker.Remaining().size() == pack::BATCH_FRAME_HEADER + 4 - 3);
+
+   pack::BatchUnpacker rest {
+      std::span<const pack::Byte>(received).subspan(unpacker.ByteCount())};
+   rest.Deserialize(numbers);
+   REQUIRE(numbers == std::vector<int> {1, 2, 3});
+   REQUIRE(rest.Remaining().empty());
+
+   packer.Clear();
+   REQUIRE(packer.ByteCount() == 0);
+   REQUIRE(packer.Segments().empty());
+
+   // Many short strings in one frame grow the arena geometrically, not one at a time.
+   std::vector<std::string> strings(100000, StringOfSize(40));
+   packer.Serialize(strings);
+   REQUIRE(packer.ByteCount() == pack::BATCH_FRAME_HEADER + pack::PackedSize(strings));
+   REQUIRE(packer.Segments().size() == 1);
+   pack::ByteArray copied;
+   for (const iovec &segment : packer.Segments()) {
+      copied.insert(copied.end(), (const pack::Byte *)segment.iov_base,
+                    (const pack::Byte *)segment.iov_base + segment.iov_len);
+   }
+   std::vector<std::string> stringsOut;
+   pack::BatchUnpacker(std::span<const pack::Byte>(copied)).Deserialize(stringsOut);
+   REQUIRE(stringsOut == strings);
+}
+
+TEST_CASE("Indexed Files") {
+   REQUIRE(pack::Crc32(std::span((const pack::Byte *)"123456789", 9)) == 0xcbf43926);
+
+   std::filesystem::path path = std::filesystem::temp_directory_path() / "pack_indexed.bin";
+   const size_t count = 2500;
+   {
+      pack::IndexedWriter writer(path, 100);
+      for (size_t i = 0; i < count; i++) {
+         writer.Write((uint32_t)i, StringOfSize(i % 50), std::vector<int>(i % 5, (int)i));
+      }
+      REQUIRE(writer.Count() == count);
+   }
+
+   {
+      pack::IndexedReader reader(path);
+      REQUIRE(reader.Count() == count);
+      REQUIRE(reader.BlockCount() == 25);
+      uint32_t sequence;
+      std::string_view text;
+      reader.Read(1234, sequence, text);
+      REQUIRE(sequence == 1234);
+      REQUIRE(text.size() == 1234 % 50);
+      REQUIRE_THROWS_AS(reader.Read(count, sequence), std::out_of_range);
+
+      // Every record is visited exactly once, whatever the thread count.
+      for (size_t threads : {1, 4}) {
+         std::vector<std::atomic<int>> seen(count);
+         reader.ForEach(
+            [&](size_t index, pack::SpanUnpacker &unpacker) {
+               uint32_t number;
+               std::string_view name;
+               std::vector<int> samples;
+               unpacker.Deserialize(number, name, samples);
+               if (number == index && samples.size() == index % 5) { seen[index]++; }
+            },
+            threads);
+         REQUIRE(std::ranges::all_of(seen, [](const auto &n) { return n == 1; }));
+      }
+   }
+
+   // A damaged block is caught by its checksum.
+   {
+      std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+      file.seekp(20);
+      file.put('\xff');
+   }
+   {
+      pack::IndexedReader reader(path);
+      REQUIRE_FALSE(reader.Verify(0));
+      REQUIRE(reader.Verify(1));
+      REQUIRE_THROWS_AS(reader.ForEach([](size_t, pack::SpanUnpacker &) {}, 2),
+                        std::runtime_error);
+   }
+
+   {
+      pack::IndexedWriter empty(path, 10, false);
+   }
+   pack::IndexedReader empty(path);
+   REQUIRE(empty.Count() == 0);
+   REQUIRE(empty.Verify(0));
+   std::filesystem::remove(path);
+
+   pack::ByteArray notIndexed {1, 2, 3};
+   {
+      std::ofstream(path, std::ios::binary).write((const char *)notIndexed.data(), 3);
+   }
+   REQUIRE_THROWS_AS(pack::IndexedReader(path), std::runtime_error);
+   std::filesystem::remove(path);
+}
+#endif
+
+// Starts running straight away, and destroys itself when it finishes.
+struct Detached {
+   struct promise_type {
+      Detached get_return_object() { return {}; }
+      std::suspend_never initial_suspend() noexcept { return {}; }
+      std::suspend_never final_suspend() noexcept { return {}; }
+      void return_void() {}
+      void unhandled_exception() { std::terminate(); }
+   };
+};
+
+TEST_CASE("Coroutines") {
+   pack::AsyncPacker packer(100);
+   pack::AsyncUnpacker unpacker;
+   std::vector<std::string> sent, received;
+   bool sending = true, receiving = true;
+   pack::Errc closed = pack::Errc::Ok;
+
+   auto send = [&]() -> Detached {
+      for (size_t i = 0; i < 50; i++) {
+         sent.push_back(StringOfSize(i * 7));
+         co_await packer.Serialize(uint32_t(i), sent.back());
+         REQUIRE(packer.Pending().size() <= 100);
+      }
+      co_await packer.Flush();
+      sending = false;
+   };
+   auto receive = [&]() -> Detached {
+      uint32_t sequence;
+      std::string text;
+      while ((closed = co_await unpacker.TryDeserialize(sequence, text)) == pack::Errc::Ok) {
+         REQUIRE(sequence == received.size());
+         received.push_back(text);
+      }
+      receiving = false;
+   };
+
+   send();
+   receive();
+   REQUIRE(sending);
+   REQUIRE(receiving);
+
+   // Ferry a few bytes at a time, like a slow connection.
+   while (sending) {
+      std::span<const pack::Byte> pending = packer.Pending();
+      std::span<const pack::Byte> piece = pending.first(std::min<size_t>(pending.size(), 13));
+      unpacker.Feed(piece);
+      packer.Consume(piece.size());
+   }
+   REQUIRE(received == sent);
+   REQUIRE(receiving);
+   REQUIRE(unpacker.Buffered() == 0);
+
+   unpacker.Close();
+   REQUIRE(!receiving);
+   REQUIRE(closed == pack::Errc::EndOfData);
+
+   // Values that have already arrived don't suspend, and errors come out of co_await.
+   pack::AsyncUnpacker ready;
+   pack::ByteArray buffer;
+   {
+      pack::BufferPacker bufferPacker(buffer);
+      bufferPacker.Serialize(-5, "text");
+   }
+   ready.Feed(buffer);
+   bool threw = false;
+   [&]() -> Detached {
+      int number;
+      uint32_t wrong;
+      co_await ready.Deserialize(number);
+      REQUIRE(number == -5);
+      try {
+         co_await ready.Deserialize(wrong);
+      } catch (const std::runtime_error &) {
+         threw = true;
+      }
+   }();
+   REQUIRE(threw);
+   REQUIRE(ready.Buffered() == 5);
+}
+
+// Counts everything, and records when each top-level call begins and ends.
+struct TracingStats : pack::CountingStats {
+   std::vector<std::string> trace;
+   void Begin(pack::Operation op) {
+      trace.push_back(op == pack::Operation::Serialize ? "serialize" : "deserialize");
+   }
+   void End(pack::Operation op, bool failed) {
+      CountingStats::End(op, failed);
+      trace.push_back(failed ? "failed" : "done");
+   }
+};
+
+TEST_CASE("Stats") {
+   using enum pack::Family;
+   auto at = [](const auto &counts, pack::Family family) { return counts[(size_t)family]; };
+   static_assert(sizeof(pack::BufferPacker) ==
+                 sizeof(pack::BasicPacker<pack::BufferSink, pack::CountingStats>) -
+                    sizeof(pack::CountingStats));
+   static_assert(sizeof(pack::SpanUnpacker) ==
+                 sizeof(pack::BasicUnpacker<pack::SpanSource, pack::CountingStats>) -
+                    sizeof(pack::CountingStats));
+
+   pack::ByteArray buffer;
+   std::vector<float> floats(100, 0.5f);
+   std::vector<std::string> names = {"a", std::string(300, 'b')};
+   std::map<int, bool> flags = {{1, true}, {-2, false}};
+   {
+      pack::BasicPacker<pack::BufferSink, TracingStats> packer(buffer);
+      packer.Serialize(floats, names);
+      packer.Serialize(flags, Vec3 {1, 2, 3});
+      REQUIRE_THROWS(packer.Serialize(std::views::iota(uint64_t(0), uint64_t(1) << 33)));
+      packer.Flush();
+
+      TracingStats &stats = packer.Stats();
+      REQUIRE(stats.trace == std::vector<std::string> {"serialize", "done", "serialize", "done",
+                                                       "serialize", "failed"});
+      REQUIRE(stats.calls == 3);
+      REQUIRE(stats.failures == 1);
+      REQUIRE(stats.flushed == buffer.size());
+      REQUIRE(at(stats.values, Float) == 100 + 3);
+      REQUIRE(at(stats.bytes, Float) == 500 + 15);
+      REQUIRE(at(stats.values, Str) == 2);
+      REQUIRE(at(stats.bytes, Str) == 2 + 303);
+      REQUIRE(at(stats.values, Array) == 3); // Including Vec3
+      REQUIRE(at(stats.values, Map) == 1);
+      REQUIRE(at(stats.values, Uint) + at(stats.values, Int) == 2);
+      REQUIRE(at(stats.values, Bool) == 2);
+
+      uint64_t total = 0;
+      for (uint64_t bytes : stats.bytes) { total += bytes; }
+      REQUIRE(total == buffer.size());
+   }
+
+   {
+      pack::BasicUnpacker<pack::SpanSource, pack::CountingStats> unpacker {
+         std::span<const pack::Byte>(buffer)};
+      std::vector<float> floatsOut;
+      std::vector<std::string> namesOut;
+      std::map<int, bool> flagsOut;
+      Vec3 vec;
+      unpacker.Deserialize(floatsOut, namesOut);
+      REQUIRE(unpacker.TryDeserialize(vec) == pack::Errc::TypeMismatch);
+      unpacker.Deserialize(flagsOut, vec);
+      REQUIRE_THROWS(unpacker.Deserialize(vec));
+
+      pack::CountingStats &stats = unpacker.Stats();
+      REQUIRE(stats.calls == 4);
+      REQUIRE(stats.failures == 2);
+      REQUIRE(stats.errors == 1);
+      REQUIRE(at(stats.values, Float) == 100 + 3);
+      REQUIRE(at(stats.bytes, Str) == 2 + 303);
+      REQUIRE(at(stats.values, Map) == 1);
+      // The float vector, the vector of strings, the long string and two map nodes.
+      REQUIRE(stats.allocations == 5);
+
+      uint64_t total = 0;
+      for (uint64_t bytes : stats.bytes) { total += bytes; }
+      REQUIRE(total == buffer.size());
+   }
+
+   {
+      // Length bounded decodes are counted, and put back what they read when they fail.
+      pack::BasicUnpacker<pack::SpanSource, pack::CountingStats> unpacker {
+         std::span<const pack::Byte>(buffer)};
+      std::array<float, 10> few;
+      std::array<float, 100> many;
+      std::array<int, 2> numbers;
+      REQUIRE(unpacker.TryDeserialize(few, few.size()) == pack::Errc::OutputTooSmall);
+      REQUIRE(unpacker.TryDeserialize(many, many.size()) == pack::Errc::Ok);
+      REQUIRE(unpacker.TryDeserialize(numbers, numbers.size()) == pack::Errc::TypeMismatch);
+      REQUIRE(unpacker.ByteCount() == pack::PackedSize(floats));
+
+      pack::CountingStats &stats = unpacker.Stats();
+      REQUIRE(stats.calls == 3);
+      REQUIRE(stats.failures == 2);
+   }
+}
+
+TEST_CASE("Reset and Pools") {
+   std::vector<std::string> names = {"alpha", std::string(300, 'b'), "gamma"};
+   pack::ByteArray first, second;
+   {
+      pack::BufferPacker packer(first);
+      packer.Serialize(names);
+      packer.Reset(second);
+      packer.Serialize(names, 7);
+      REQUIRE(packer.ByteCount() == second.size());
+   }
+   REQUIRE(second.size() > first.size());
+   REQUIRE(std::equal(first.begin(), first.end(), second.begin()));
+
+   // Streams are flushed before being let go, and the sink's buffer carries on.
+   std::stringstream streamA(std::ios::binary | std::ios::out | std::ios::in);
+   std::stringstream streamB(std::ios::binary | std::ios::out | std::ios::in);
+   {
+      pack::Packer packer(streamA);
+      packer.Serialize(names);
+      packer.Reset(streamB);
+      packer.Serialize(names);
+   }
+   REQUIRE(streamA.str() == streamB.str());
+   REQUIRE(streamA.str().size() == first.size());
+
+   // A warmed up unpacker decodes the next message into the same containers without
+   // allocating.
+   pack::BasicUnpacker<pack::SpanSource, pack::CountingStats> unpacker {
+      std::span<const pack::Byte>(first)};
+   std::vector<std::string> out;
+   unpacker.Deserialize(out);
+   size_t allocations = unpacker.Stats().allocations;
+   REQUIRE(allocations > 0);
+   unpacker.Reset(second);
+   int number = 0;
+   unpacker.Deserialize(out, number);
+   REQUIRE(out == names);
+   REQUIRE(number == 7);
+   REQUIRE(unpacker.Stats().allocations == allocations);
+
+   pack::Unpacker streamUnpacker(streamA);
+   streamUnpacker.Deserialize(out);
+   streamUnpacker.Reset(streamB);
+   out.clear();
+   streamUnpacker.Deserialize(out);
+   REQUIRE(out == names);
+
+   pack::Pool<pack::BufferPacker> pool;
+   const pack::BufferPacker *reused;
+   {
+      auto packer = pool.Acquire(first);
+      packer->Serialize(1);
+      reused = &*packer;
+      REQUIRE(pool.Idle() == 0);
+   }
+   REQUIRE(pool.Idle() == 1);
+   {
+      auto packer = pool.Acquire(second, 2);
+      REQUIRE(&*packer == reused);
+      auto another = pool.Acquire(first);
+      REQUIRE(&*another != reused);
+      another->Serialize(4);
+      packer->Serialize(3);
+      another = std::move(packer);
+   }
+   REQUIRE(pool.Idle() == 2);
+   REQUIRE(first == pack::ByteArray {4});
+   REQUIRE(second == pack::ByteArray {second[0], second[1], 3});
+   pool.Clear();
+   REQUIRE(pool.Idle() == 0);
+
+   // An object that fails to flush isn't reused, as it may still refer to its stream.
+   pack::Pool<pack::Packer> streamPool;
+   {
+      auto failing = std::make_unique<std::stringstream>(std::ios::binary | std::ios::out);
+      {
+         auto packer = streamPool.Acquire(*failing);
+         packer->Serialize(1);
+         failing->setstate(std::ios::badbit);
+      }
+      REQUIRE(streamPool.Idle() == 0);
+   }
+   std::stringstream streamD(std::ios::binary | std::ios::out | std::ios::in);
+   {
+      auto packer = streamPool.Acquire(streamD);
+      packer->Serialize(5);
+   }
+   REQUIRE(streamPool.Idle() == 1);
+   REQUIRE(streamD.str() == std::string(1, 5));
+
+   // Each thread has its own pool, and leases end on the thread that took them.
+   pack::Pool<pack::Packer> &local = pack::Pool<pack::Packer>::Local();
+   REQUIRE(&local == &pack::Pool<pack::Packer>::Local());
+   std::stringstream streamC(std::ios::binary | std::ios::out | std::ios::in);
+   {
+      std::stringstream streamD(std::ios::binary | std::ios::out | std::ios::in);
+      auto packer = local.Acquire(streamD);
+      packer->Serialize(names);
+   }
+   {
+      auto packer = local.Acquire(streamC);
+      packer->Serialize(names);
+   }
+   REQUIRE(streamC.str() == streamA.str());
+   const pack::Pool<pack::Packer> *other = nullptr;
+   std::thread([&] { other = &pack::Pool<pack::Packer>::Local(); }).join();
+   REQUIRE(other != &local);
+}
+
+TEST_CASE("String Interning") {
+   std::vector<Telemetry> records;
+   for (uint32_t i = 0; i < 100; i++) {
+      records.push_back({i % 2 ? "engine" : "wheel", i, {1, 2, 3}, {1}});
+   }
+
+   pack::ByteArray plain, interned;
+   pack::BufferPacker(plain).Serialize(records);
+   pack::StringTable table;
+   {
+      pack::BufferPacker packer(interned);
+      packer.InternStrings(&table);
+      packer.Serialize(records);
+   }
+   // The four keys and two names are each defined once.
+   REQUIRE(table.Size() == 6);
+   REQUIRE(interned.size() < plain.size() * 2 / 3);
+
+   pack::StringCache cache;
+   {
+      pack::SpanUnpacker unpacker {std::span<const pack::Byte>(interned)};
+      unpacker.InternStrings(&cache);
+      std::vector<Telemetry> out;
+      unpacker.Deserialize(out);
+      REQUIRE(out.size() == records.size());
+      for (size_t i = 0; i < out.size(); i++) {
+         REQUIRE(out[i].name == records[i].name);
+         REQUIRE(out[i].sequence == records[i].sequence);
+         REQUIRE(out[i].position == records[i].position);
+      }
+      REQUIRE(cache.Size() == table.Size());
+      REQUIRE(cache.Find(table.Find("engine")) == "engine");
+   }
+
+   // Without a cache, interned strings are just extensions.
+   {
+      pack::SpanUnpacker unpacker {std::span<const pack::Byte>(interned)};
+      std::vector<Telemetry> out;
+      REQUIRE(unpacker.TryDeserialize(out) == pack::Errc::TypeMismatch);
+   }
+
+   // Strings shorter than the minimum length are written out in full.
+   pack::ByteArray shortPlain, shortInterned;
+   pack::BufferPacker(shortPlain).Serialize("abc", "abc");
+   {
+      pack::BufferPacker packer(shortInterned);
+      packer.InternStrings(&table);
+      packer.Serialize("abc", "abc");
+   }
+   REQUIRE(shortInterned == shortPlain);
+
+   std::vector<std::string> words = {"alpha", "beta", "alpha", "gamma", "beta"};
+   pack::ByteArray buffer;
+   table.Clear();
+   {
+      pack::BufferPacker packer(buffer);
+      packer.InternStrings(&table);
+      packer.Serialize(words, words, 7);
+   }
+   REQUIRE(table.Size() == 3);
+
+   auto check = [&](auto &unpacker, auto rewind) {
+      cache.Clear();
+      unpacker.InternStrings(&cache);
+
+      // Values that are skipped still define their strings.
+      unpacker.Skip();
+      REQUIRE(cache.Size() == 3);
+
+      // A failed decode forgets the strings it defined, so it can be retried.
+      cache.Clear();
+      rewind();
+      std::vector<std::string> out;
+      std::vector<int> wrong;
+      REQUIRE(unpacker.TryDeserialize(out, wrong) == pack::Errc::TypeMismatch);
+      REQUIRE(cache.Size() == 0);
+      REQUIRE(unpacker.TryDeserialize(out) == pack::Errc::Ok);
+      REQUIRE(out == words);
+      REQUIRE(cache.Size() == 3);
+      unpacker.Deserialize(out);
+      REQUIRE(out == words);
+   };
+   pack::SpanUnpacker spanUnpacker {std::span<const pack::Byte>(buffer)};
+   check(spanUnpacker, [&] { spanUnpacker.Reset(buffer); });
+   std::stringstream stream(std::ios::binary | std::ios::out | std::ios::in);
+   stream.write((const char *)buffer.data(), buffer.size());
+   pack::Unpacker streamUnpacker(stream);
+   check(streamUnpacker, [&] { streamUnpacker.Reset(stream); });
+
+   // Repeats borrow the same string out of the cache.
+   std::vector<std::string_view> views;
+   cache.Clear();
+   spanUnpacker.Reset(buffer);
+   spanUnpacker.Deserialize(views);
+   REQUIRE(views[0].data() == views[2].data());
+   REQUIRE(views[0].data() == cache.Find(0).data());
+
+   // Decoding into strings that already have the capacity doesn't allocate.
+   cache.Clear();
+   pack::BasicUnpacker<pack::SpanSource, pack::CountingStats> counting {
+      std::span<const pack::Byte>(buffer)};
+   counting.InternStrings(&cache);
+   std::vector<std::string> out = words;
+   counting.Skip();
+   counting.Deserialize(out);
+   REQUIRE(out == words);
+   REQUIRE(counting.Stats().allocations == 0);
+
+   // Only strings that have been defined can be referenced, and a full cache is an error.
+   cache.Clear();
+   pack::SpanUnpacker reference {std::span<const pack::Byte>(buffer).subspan(1 + 7)};
+   reference.InternStrings(&cache);
+   std::string str;
+   REQUIRE(reference.TryDeserialize(str) == pack::Errc::TypeMismatch);
+   pack::StringCache small(2);
+   spanUnpacker.Reset(buffer);
+   spanUnpacker.InternStrings(&small);
+   REQUIRE(spanUnpacker.TryDeserialize(out) == pack::Errc::OutputTooSmall);
+   REQUIRE(small.Size() == 0);
+}